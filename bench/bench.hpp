@@ -0,0 +1,423 @@
+// ****************************************************************************
+// daily/future/bench/bench.hpp
+//
+// Minimal benchmark harness. Times a body over a number of iterations and
+// reports ns/op along with heap allocations and bytes per op, counted by
+// replacing the global operator new.
+//
+// Include in exactly one translation unit per benchmark executable. Define
+// DAILY_BENCH_NO_ALLOCATION_COUNTING first to keep the default operator new,
+// the shared counters would otherwise serialise multi threaded benchmarks.
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#pragma once
+#ifndef DAILY_FUTURE_BENCH_BENCH_HPP_
+#define DAILY_FUTURE_BENCH_BENCH_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#include "daily/future/executor_op.hpp"
+
+// -----------------------------------------------------------------------------
+// Global allocation counters. Relaxed atomics so cross thread benchmarks
+// still count correctly.
+namespace bench { namespace detail
+{
+    inline std::atomic<std::size_t>& num_allocations()
+    {
+        static std::atomic<std::size_t> count(0);
+        return count;
+    }
+
+    inline std::atomic<std::size_t>& num_bytes()
+    {
+        static std::atomic<std::size_t> count(0);
+        return count;
+    }
+
+    inline void* counted_malloc(std::size_t size)
+    {
+        num_allocations().fetch_add(1, std::memory_order_relaxed);
+        num_bytes().fetch_add(size, std::memory_order_relaxed);
+        if(void* p = std::malloc(size ? size : 1))
+            return p;
+        throw std::bad_alloc();
+    }
+}}
+
+#ifndef DAILY_BENCH_NO_ALLOCATION_COUNTING
+void* operator new(std::size_t size)
+{
+    return bench::detail::counted_malloc(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return bench::detail::counted_malloc(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+#endif // DAILY_BENCH_NO_ALLOCATION_COUNTING
+
+// -----------------------------------------------------------------------------
+//
+namespace bench
+{
+    typedef std::chrono::steady_clock clock;
+
+    struct result
+    {
+        std::string name;
+        std::size_t iterations;
+        double ns_per_op;
+        double allocations_per_op;
+        double bytes_per_op;
+    };
+
+    // -------------------------------------------------------------------------
+    // Prevents the optimiser from discarding a value.
+    template<typename T>
+    inline void do_not_optimize(T const& value)
+    {
+#if defined(__GNUC__)
+        asm volatile("" : : "g"(&value) : "memory");
+#else
+        static volatile char sink;
+        sink = *reinterpret_cast<char const volatile*>(&value);
+#endif
+    }
+
+    // -------------------------------------------------------------------------
+    // Collects results and prints them as a table, or as CSV with --csv.
+    class runner
+    {
+    public:
+
+        runner(int argc, char** argv)
+            : scale_(1.0)
+        {
+            for(int i = 1; i < argc; ++i)
+            {
+                if(std::strcmp(argv[i], "--csv") == 0)
+                    csv_ = true;
+                else if(std::strncmp(argv[i], "--filter=", 9) == 0)
+                    filter_ = argv[i] + 9;
+                else if(std::strncmp(argv[i], "--scale=", 8) == 0)
+                    scale_ = std::atof(argv[i] + 8);
+            }
+        }
+
+        ~runner()
+        {
+            print();
+        }
+
+        // For suites whose output is meant for a spreadsheet, ie; the
+        // comparison benchmark.
+        void set_csv(bool csv)
+        {
+            csv_ = csv;
+        }
+
+        // Multiplier applied to iteration counts, --scale=0.1 for a quick
+        // smoke run.
+        double scale() const
+        {
+            return scale_;
+        }
+
+        // Runs body(i) for i in [0, iterations) after a short warm up.
+        template<typename Body>
+        void run(std::string const& name, std::size_t iterations, Body&& body)
+        {
+            if(!filter_.empty() && name.find(filter_) == std::string::npos)
+                return;
+
+            iterations = scaled(iterations);
+            for(std::size_t i = 0; i < iterations / 10 + 1; ++i)
+                body(i);
+
+            std::size_t allocations = detail::num_allocations().load();
+            std::size_t bytes = detail::num_bytes().load();
+            clock::time_point start = clock::now();
+            for(std::size_t i = 0; i < iterations; ++i)
+                body(i);
+            clock::time_point end = clock::now();
+            allocations = detail::num_allocations().load() - allocations;
+            bytes = detail::num_bytes().load() - bytes;
+
+            record(name, iterations, end - start, allocations, bytes);
+        }
+
+        // For benchmarks that do their own timing, ie; cross thread ones.
+        void record(
+            std::string const& name,
+            std::size_t iterations,
+            clock::duration elapsed,
+            std::size_t allocations,
+            std::size_t bytes)
+        {
+            double ops = static_cast<double>(iterations ? iterations : 1);
+            results_.push_back({
+                name,
+                iterations,
+                std::chrono::duration<double, std::nano>(elapsed).count() / ops,
+                allocations / ops,
+                bytes / ops
+            });
+
+            if(!csv_)
+                print_row(results_.back());
+        }
+
+        bool selected(std::string const& name) const
+        {
+            return filter_.empty() || name.find(filter_) != std::string::npos;
+        }
+
+        std::size_t scaled(std::size_t iterations) const
+        {
+            std::size_t n = static_cast<std::size_t>(iterations * scale_);
+            return n ? n : 1;
+        }
+
+    private:
+
+        void print_row(result const& r) const
+        {
+            if(!header_printed_)
+            {
+                std::printf("%-48s %12s %12s %12s %12s\n",
+                    "benchmark", "iterations", "ns/op", "allocs/op", "bytes/op");
+                header_printed_ = true;
+            }
+
+            std::printf("%-48s %12zu %12.1f %12.2f %12.1f\n",
+                r.name.c_str(), r.iterations, r.ns_per_op,
+                r.allocations_per_op, r.bytes_per_op);
+            std::fflush(stdout);
+        }
+
+        void print() const
+        {
+            if(!csv_)
+                return;
+
+            std::printf("benchmark,iterations,ns_per_op,allocs_per_op,bytes_per_op\n");
+            for(auto&& r : results_)
+            {
+                std::printf("%s,%zu,%.3f,%.3f,%.3f\n",
+                    r.name.c_str(), r.iterations, r.ns_per_op,
+                    r.allocations_per_op, r.bytes_per_op);
+            }
+        }
+
+        std::vector<result> results_;
+        std::string filter_;
+        double scale_;
+        bool csv_ = false;
+        mutable bool header_printed_ = false;
+    };
+
+    // -------------------------------------------------------------------------
+    // Runs closures immediately, measures the continuation machinery without
+    // any queueing.
+    class inline_executor
+    {
+    public:
+
+        inline_executor get_executor() const noexcept
+        {
+            return *this;
+        }
+
+        void on_work_started() const noexcept
+        {}
+
+        void on_work_finished() const noexcept
+        {}
+
+        template<typename Function, typename Allocator>
+        void dispatch(Function&& f, Allocator const&) const
+        {
+            f();
+        }
+
+        template<typename Function, typename Allocator>
+        void post(Function&& f, Allocator const&) const
+        {
+            f();
+        }
+
+        template<typename Function, typename Allocator>
+        void defer(Function&& f, Allocator const&) const
+        {
+            f();
+        }
+    };
+
+    // -------------------------------------------------------------------------
+    // Bump allocator over a thread local buffer, reset by its owner. Keeps
+    // the harness's own bookkeeping out of the allocation counts.
+    namespace detail
+    {
+        struct scratch_buffer
+        {
+            static constexpr std::size_t size = 4 * 1024 * 1024;
+
+            void* allocate(std::size_t bytes)
+            {
+                bytes = (bytes + 15) & ~std::size_t(15);
+                if(used_ + bytes > size)
+                    throw std::bad_alloc();
+                void* p = data_ + used_;
+                used_ += bytes;
+                return p;
+            }
+
+            void reset()
+            {
+                used_ = 0;
+            }
+
+            alignas(16) char data_[size];
+            std::size_t used_ = 0;
+        };
+
+        inline scratch_buffer& scratch()
+        {
+            // Allocated with malloc so it doesn't show up in the counts.
+            static thread_local std::unique_ptr<scratch_buffer, void(*)(void*)> buffer(
+                new(std::malloc(sizeof(scratch_buffer))) scratch_buffer, &std::free);
+            return *buffer;
+        }
+
+        template<typename T>
+        struct scratch_allocator
+        {
+            typedef T value_type;
+
+            scratch_allocator()
+            {}
+
+            template<typename U>
+            scratch_allocator(scratch_allocator<U> const&)
+            {}
+
+            T* allocate(std::size_t n)
+            {
+                return static_cast<T*>(scratch().allocate(n * sizeof(T)));
+            }
+
+            void deallocate(T*, std::size_t)
+            {}
+
+            template<typename U>
+            bool operator==(scratch_allocator<U> const&) const
+            {
+                return true;
+            }
+
+            template<typename U>
+            bool operator!=(scratch_allocator<U> const&) const
+            {
+                return false;
+            }
+        };
+    }
+
+    // -------------------------------------------------------------------------
+    // Queues closures until run() is called on the same thread, measures
+    // the cost of a queued continuation without any thread handoff.
+    class queue_executor
+    {
+    public:
+
+        queue_executor get_executor() const noexcept
+        {
+            return *this;
+        }
+
+        void on_work_started() const noexcept
+        {}
+
+        void on_work_finished() const noexcept
+        {}
+
+        template<typename Function, typename Allocator>
+        void dispatch(Function&& f, Allocator const&) const
+        {
+            push(std::forward<Function>(f));
+        }
+
+        template<typename Function, typename Allocator>
+        void post(Function&& f, Allocator const&) const
+        {
+            push(std::forward<Function>(f));
+        }
+
+        template<typename Function, typename Allocator>
+        void defer(Function&& f, Allocator const&) const
+        {
+            push(std::forward<Function>(f));
+        }
+
+        static void run()
+        {
+            while(!queue().empty())
+                queue().pop()->complete();
+            detail::scratch().reset();
+        }
+
+    private:
+
+        typedef daily::detail::executor_op op_type;
+
+        template<typename Function>
+        static void push(Function&& f)
+        {
+            queue().push(daily::detail::make_executor_op<op_type>(
+                std::forward<Function>(f), detail::scratch_allocator<char>()));
+        }
+
+        static daily::detail::executor_op_queue<op_type>& queue()
+        {
+            static thread_local daily::detail::executor_op_queue<op_type> queue_;
+            return queue_;
+        }
+    };
+}
+
+#endif // DAILY_FUTURE_BENCH_BENCH_HPP_
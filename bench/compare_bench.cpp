@@ -0,0 +1,397 @@
+// ****************************************************************************
+// daily/future/bench/compare_bench.cpp
+//
+// Runs the same workloads against daily::future, std::future,
+// boost::future and a bare std::function callback baseline, and prints a
+// single CSV table.
+//
+// std::future has no continuations, so its continuation and pipeline rows
+// compose stages with blocking get() calls. boost::future continuations use
+// launch::sync, which like continue_on::any runs on whichever thread
+// satisfies the future.
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#include "bench.hpp"
+#include "daily/future/future.hpp"
+
+#include <boost/thread/future.hpp>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    int add_one(int i)
+    {
+        return i + 1;
+    }
+
+    // -------------------------------------------------------------------------
+    // Per library glue, every workload is written once against these.
+    struct daily_lib
+    {
+        static char const* name() { return "daily"; }
+
+        template<typename T>
+        using promise = daily::promise<T>;
+
+        template<typename T>
+        using future = daily::future<T>;
+
+        static future<int> add_one_then(future<int> f)
+        {
+            return f.then(daily::continue_on::any, [](int i) { return add_one(i); });
+        }
+    };
+
+    struct boost_lib
+    {
+        static char const* name() { return "boost"; }
+
+        template<typename T>
+        using promise = boost::promise<T>;
+
+        template<typename T>
+        using future = boost::future<T>;
+
+        static future<int> add_one_then(future<int> f)
+        {
+            return f.then(boost::launch::sync, [](future<int> r) { return add_one(r.get()); });
+        }
+    };
+
+    struct std_lib
+    {
+        static char const* name() { return "std"; }
+
+        template<typename T>
+        using promise = std::promise<T>;
+
+        template<typename T>
+        using future = std::future<T>;
+    };
+
+    std::string row_name(std::string const& workload, char const* lib)
+    {
+        return workload + "/" + lib;
+    }
+
+    // -------------------------------------------------------------------------
+    // Cross thread ping-pong, one op is a round trip. The promises are created
+    // up front so only the handoff is timed.
+    template<typename Lib>
+    void ping_pong(bench::runner& r)
+    {
+        std::string const name = row_name("ping_pong", Lib::name());
+        if(!r.selected(name))
+            return;
+
+        typedef typename Lib::template promise<int> promise_type;
+        typedef typename Lib::template future<int> future_type;
+
+        std::size_t const round_trips = r.scaled(20000);
+        std::vector<promise_type> requests(round_trips);
+        std::vector<promise_type> replies(round_trips);
+        std::vector<future_type> request_futures;
+        std::vector<future_type> reply_futures;
+        for(std::size_t i = 0; i < round_trips; ++i)
+        {
+            request_futures.push_back(requests[i].get_future());
+            reply_futures.push_back(replies[i].get_future());
+        }
+
+        std::thread responder([&]
+        {
+            for(std::size_t i = 0; i < round_trips; ++i)
+                replies[i].set_value(request_futures[i].get() + 1);
+        });
+
+        std::size_t allocations = bench::detail::num_allocations().load();
+        std::size_t bytes = bench::detail::num_bytes().load();
+        bench::clock::time_point start = bench::clock::now();
+        for(std::size_t i = 0; i < round_trips; ++i)
+        {
+            requests[i].set_value(static_cast<int>(i));
+            bench::do_not_optimize(reply_futures[i].get());
+        }
+        bench::clock::time_point end = bench::clock::now();
+
+        responder.join();
+        r.record(
+            name,
+            round_trips,
+            end - start,
+            bench::detail::num_allocations().load() - allocations,
+            bench::detail::num_bytes().load() - bytes);
+    }
+
+    // The callback equivalent is a pair of mailboxes of std::function.
+    class mailbox
+    {
+    public:
+
+        void post(std::function<void()> f)
+        {
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                queue_.push_back(std::move(f));
+            }
+            ready_.notify_one();
+        }
+
+        void run_one()
+        {
+            std::function<void()> f;
+            {
+                std::unique_lock<std::mutex> lk(mutex_);
+                ready_.wait(lk, [this] { return !queue_.empty(); });
+                f = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            f();
+        }
+
+    private:
+
+        std::mutex mutex_;
+        std::condition_variable ready_;
+        std::deque<std::function<void()>> queue_;
+    };
+
+    void ping_pong_callback(bench::runner& r)
+    {
+        std::string const name = row_name("ping_pong", "callback");
+        if(!r.selected(name))
+            return;
+
+        std::size_t const round_trips = r.scaled(20000);
+        mailbox requests;
+        mailbox replies;
+        int result = 0;
+
+        std::thread responder([&]
+        {
+            for(std::size_t i = 0; i < round_trips; ++i)
+                requests.run_one();
+        });
+
+        std::size_t allocations = bench::detail::num_allocations().load();
+        std::size_t bytes = bench::detail::num_bytes().load();
+        bench::clock::time_point start = bench::clock::now();
+        for(std::size_t i = 0; i < round_trips; ++i)
+        {
+            int value = static_cast<int>(i);
+            requests.post([&replies, &result, value]
+            {
+                replies.post([&result, value] { result = value + 1; });
+            });
+            replies.run_one();
+            bench::do_not_optimize(result);
+        }
+        bench::clock::time_point end = bench::clock::now();
+
+        responder.join();
+        r.record(
+            name,
+            round_trips,
+            end - start,
+            bench::detail::num_allocations().load() - allocations,
+            bench::detail::num_bytes().load() - bytes);
+    }
+
+    // -------------------------------------------------------------------------
+    // A single continuation attached to an already satisfied future.
+    template<typename Lib>
+    void continuation_on_ready(bench::runner& r)
+    {
+        r.run(row_name("continuation_on_ready", Lib::name()), 500000, [](std::size_t i)
+        {
+            typename Lib::template promise<int> p;
+            p.set_value(static_cast<int>(i));
+            bench::do_not_optimize(Lib::add_one_then(p.get_future()).get());
+        });
+    }
+
+    void continuation_on_ready_std(bench::runner& r)
+    {
+        r.run(row_name("continuation_on_ready", std_lib::name()), 500000, [](std::size_t i)
+        {
+            std::promise<int> p;
+            p.set_value(static_cast<int>(i));
+            bench::do_not_optimize(add_one(p.get_future().get()));
+        });
+    }
+
+    void continuation_on_ready_callback(bench::runner& r)
+    {
+        r.run(row_name("continuation_on_ready", "callback"), 500000, [](std::size_t i)
+        {
+            std::function<int(int)> f = [](int v) { return add_one(v); };
+            bench::do_not_optimize(f(static_cast<int>(i)));
+        });
+    }
+
+    // -------------------------------------------------------------------------
+    // N producers joined by one consumer, one op is the whole fan.
+    template<typename Lib>
+    void fan_out_in(bench::runner& r, std::size_t n)
+    {
+        std::string const workload = "fan_out_in/" + std::to_string(n);
+        r.run(row_name(workload, Lib::name()), 200000 / n, [n](std::size_t)
+        {
+            std::vector<typename Lib::template promise<int>> promises(n);
+            std::vector<typename Lib::template future<int>> futures;
+            futures.reserve(n);
+            for(auto&& p : promises)
+                futures.push_back(Lib::add_one_then(p.get_future()));
+
+            for(std::size_t i = 0; i < n; ++i)
+                promises[i].set_value(static_cast<int>(i));
+
+            int sum = 0;
+            for(auto&& f : futures)
+                sum += f.get();
+            bench::do_not_optimize(sum);
+        });
+    }
+
+    void fan_out_in_std(bench::runner& r, std::size_t n)
+    {
+        std::string const workload = "fan_out_in/" + std::to_string(n);
+        r.run(row_name(workload, std_lib::name()), 200000 / n, [n](std::size_t)
+        {
+            std::vector<std::promise<int>> promises(n);
+            std::vector<std::future<int>> futures;
+            futures.reserve(n);
+            for(auto&& p : promises)
+                futures.push_back(p.get_future());
+
+            for(std::size_t i = 0; i < n; ++i)
+                promises[i].set_value(static_cast<int>(i));
+
+            int sum = 0;
+            for(auto&& f : futures)
+                sum += add_one(f.get());
+            bench::do_not_optimize(sum);
+        });
+    }
+
+    void fan_out_in_callback(bench::runner& r, std::size_t n)
+    {
+        std::string const workload = "fan_out_in/" + std::to_string(n);
+        r.run(row_name(workload, "callback"), 200000 / n, [n](std::size_t)
+        {
+            int sum = 0;
+            std::size_t remaining = n;
+            std::function<void()> joined = [&sum] { bench::do_not_optimize(sum); };
+            std::vector<std::function<void(int)>> producers;
+            producers.reserve(n);
+            for(std::size_t i = 0; i < n; ++i)
+            {
+                producers.push_back([&sum, &remaining, &joined](int v)
+                {
+                    sum += add_one(v);
+                    if(--remaining == 0)
+                        joined();
+                });
+            }
+
+            for(std::size_t i = 0; i < n; ++i)
+                producers[i](static_cast<int>(i));
+        });
+    }
+
+    // -------------------------------------------------------------------------
+    // K stages attached to a pending future which is then satisfied.
+    template<typename Lib>
+    void pipeline(bench::runner& r, std::size_t k)
+    {
+        std::string const workload = "pipeline/" + std::to_string(k);
+        r.run(row_name(workload, Lib::name()), 200000 / k, [k](std::size_t)
+        {
+            typename Lib::template promise<int> p;
+            typename Lib::template future<int> f = p.get_future();
+            for(std::size_t i = 0; i < k; ++i)
+                f = Lib::add_one_then(std::move(f));
+            p.set_value(0);
+            bench::do_not_optimize(f.get());
+        });
+    }
+
+    void pipeline_std(bench::runner& r, std::size_t k)
+    {
+        std::string const workload = "pipeline/" + std::to_string(k);
+        r.run(row_name(workload, std_lib::name()), 200000 / k, [k](std::size_t)
+        {
+            std::vector<std::promise<int>> stages(k + 1);
+            std::vector<std::future<int>> futures;
+            futures.reserve(k + 1);
+            for(auto&& p : stages)
+                futures.push_back(p.get_future());
+
+            stages[0].set_value(0);
+            for(std::size_t i = 0; i < k; ++i)
+                stages[i + 1].set_value(add_one(futures[i].get()));
+            bench::do_not_optimize(futures[k].get());
+        });
+    }
+
+    void pipeline_callback(bench::runner& r, std::size_t k)
+    {
+        std::string const workload = "pipeline/" + std::to_string(k);
+        r.run(row_name(workload, "callback"), 200000 / k, [k](std::size_t)
+        {
+            int result = 0;
+            std::function<void(int)> stage = [&result](int v) { result = v; };
+            for(std::size_t i = 0; i < k; ++i)
+                stage = [next = std::move(stage)](int v) { next(add_one(v)); };
+            stage(0);
+            bench::do_not_optimize(result);
+        });
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bench::runner r(argc, argv);
+    r.set_csv(true);
+
+    ping_pong<daily_lib>(r);
+    ping_pong<std_lib>(r);
+    ping_pong<boost_lib>(r);
+    ping_pong_callback(r);
+
+    continuation_on_ready<daily_lib>(r);
+    continuation_on_ready_std(r);
+    continuation_on_ready<boost_lib>(r);
+    continuation_on_ready_callback(r);
+
+    for(std::size_t n : { 4, 64 })
+    {
+        fan_out_in<daily_lib>(r, n);
+        fan_out_in_std(r, n);
+        fan_out_in<boost_lib>(r, n);
+        fan_out_in_callback(r, n);
+    }
+
+    for(std::size_t k : { 1, 8, 64 })
+    {
+        pipeline<daily_lib>(r, k);
+        pipeline_std(r, k);
+        pipeline<boost_lib>(r, k);
+        pipeline_callback(r, k);
+    }
+
+    return 0;
+}
@@ -0,0 +1,134 @@
+// ****************************************************************************
+// daily/future/bench/false_sharing_bench.cpp
+//
+// Measures what a thread polling a state for readiness costs the thread
+// completing it. Each op the producer writes a result into a state and the
+// consumer, which has been spinning on the state's flags without the lock
+// since it acknowledged the previous op, takes it and acknowledges.
+//
+// Built twice, as daily_future_false_sharing_bench with the compact layout
+// and daily_future_false_sharing_bench_separated with
+// DAILY_FUTURE_ENABLE_CACHE_LINE_SEPARATION; compare the two. Rows are
+// prefixed with the layout. The difference only shows with the two threads
+// on different cores.
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#define DAILY_BENCH_NO_ALLOCATION_COUNTING
+#include "bench.hpp"
+#include "daily/future/future.hpp"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    struct payload_256
+    {
+        long values[32];
+    };
+
+    payload_256 make_payload(std::size_t i)
+    {
+        payload_256 p;
+        for(auto&& v : p.values)
+            v = static_cast<long>(i);
+        return p;
+    }
+
+    long first_value(payload_256 const& p)
+    {
+        return p.values[0];
+    }
+
+    int make_payload_int(std::size_t i)
+    {
+        return static_cast<int>(i);
+    }
+
+    long first_value(int i)
+    {
+        return i;
+    }
+
+    // Spins, yielding now and then so a single core still makes progress.
+    template<typename Predicate>
+    void spin_until(Predicate done)
+    {
+        for(unsigned spins = 1; !done(); ++spins)
+        {
+            if((spins & 1023) == 0)
+                std::this_thread::yield();
+        }
+    }
+
+    std::string const& layout_name()
+    {
+        static std::string const name =
+            daily::cache_line_separation_enabled ? "separated" : "compact";
+        return name;
+    }
+
+    // The states are made up front so only the handoff is timed. The op
+    // time is the producer's, from starting a write to seeing it taken.
+    template<typename Payload, typename MakePayload>
+    void poll_benchmark(bench::runner& r, std::string const& payload_name, MakePayload make)
+    {
+        typedef daily::detail::promise_future_shared_state<Payload> state_type;
+
+        std::string const name = layout_name() + "/poll/" + payload_name;
+        if(!r.selected(name))
+            return;
+
+        std::size_t const count = r.scaled(200000);
+        std::vector<std::shared_ptr<state_type>> states;
+        states.reserve(count);
+        for(std::size_t i = 0; i < count; ++i)
+            states.push_back(std::make_shared<state_type>());
+
+        std::atomic<std::size_t> taken(0);
+        std::thread consumer([&]
+        {
+            for(std::size_t i = 0; i < count; ++i)
+            {
+                state_type& state = *states[i];
+                spin_until([&state] { return state.is_finished(); });
+                std::unique_lock<daily::detail::chain_mutex> lk = state.lock();
+                bench::do_not_optimize(first_value(state.get(lk)));
+                lk.unlock();
+                taken.store(i + 1, std::memory_order_release);
+            }
+        });
+
+        bench::clock::time_point start = bench::clock::now();
+        for(std::size_t i = 0; i < count; ++i)
+        {
+            {
+                std::unique_lock<daily::detail::chain_mutex> lk = states[i]->lock();
+                states[i]->set_finished_with_result(make(i), lk);
+            }
+
+            spin_until([&taken, i] { return taken.load(std::memory_order_acquire) > i; });
+        }
+        bench::clock::time_point end = bench::clock::now();
+
+        consumer.join();
+        r.record(name, count, end - start, 0, 0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bench::runner r(argc, argv);
+    poll_benchmark<int>(r, "int", make_payload_int);
+    poll_benchmark<payload_256>(r, "256B", make_payload);
+    return 0;
+}
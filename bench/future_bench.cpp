@@ -0,0 +1,294 @@
+// ****************************************************************************
+// daily/future/bench/future_bench.cpp
+//
+// Micro benchmarks for the promise/future primitives.
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#include "bench.hpp"
+#include "daily/future/future.hpp"
+#include "daily/future/pool_allocator.hpp"
+#include "daily/future/chain_arena.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    int add_one(int i)
+    {
+        return i + 1;
+    }
+
+    void promise_benchmarks(bench::runner& r)
+    {
+        r.run("promise/create", 1000000, [](std::size_t)
+        {
+            daily::promise<int> p;
+            bench::do_not_optimize(p);
+        });
+
+        r.run("promise/create_set_get", 1000000, [](std::size_t i)
+        {
+            daily::promise<int> p;
+            daily::future<int> f = p.get_future();
+            p.set_value(static_cast<int>(i));
+            bench::do_not_optimize(f.get());
+        });
+
+        r.run("promise/create_set_get_void", 1000000, [](std::size_t)
+        {
+            daily::promise<void> p;
+            daily::future<void> f = p.get_future();
+            p.set_value();
+            f.get();
+        });
+    }
+
+    // Attaches a continuation to an already satisfied future or to a
+    // pending one that's satisfied afterwards.
+    template<typename Attach>
+    void then_benchmark(bench::runner& r, std::string const& name, Attach attach)
+    {
+        r.run("then/" + name + "/ready", 500000, [&attach](std::size_t i)
+        {
+            daily::promise<int> p;
+            p.set_value(static_cast<int>(i));
+            daily::future<int> f = attach(p.get_future());
+            bench::queue_executor::run();
+            bench::do_not_optimize(f.get());
+        });
+
+        r.run("then/" + name + "/pending", 500000, [&attach](std::size_t i)
+        {
+            daily::promise<int> p;
+            daily::future<int> f = attach(p.get_future());
+            p.set_value(static_cast<int>(i));
+            bench::queue_executor::run();
+            bench::do_not_optimize(f.get());
+        });
+    }
+
+    template<typename Executor>
+    void executor_benchmarks(bench::runner& r, std::string const& name, Executor ex)
+    {
+        then_benchmark(r, "dispatch/" + name, [ex](daily::future<int> f)
+        {
+            return f.then(daily::execute::dispatch, ex, add_one);
+        });
+
+        then_benchmark(r, "post/" + name, [ex](daily::future<int> f)
+        {
+            return f.then(daily::execute::post, ex, add_one);
+        });
+
+        then_benchmark(r, "defer/" + name, [ex](daily::future<int> f)
+        {
+            return f.then(daily::execute::defer, ex, add_one);
+        });
+    }
+
+    void continuation_benchmarks(bench::runner& r)
+    {
+        then_benchmark(r, "any", [](daily::future<int> f)
+        {
+            return f.then(daily::continue_on::any, add_one);
+        });
+
+        then_benchmark(r, "get", [](daily::future<int> f)
+        {
+            return f.then(daily::continue_on::get, add_one);
+        });
+
+        then_benchmark(r, "set", [](daily::future<int> f)
+        {
+            return f.then(daily::continue_on::set, add_one);
+        });
+
+        executor_benchmarks(r, "inline", bench::inline_executor());
+        executor_benchmarks(r, "queued", bench::queue_executor());
+    }
+
+    // One op is a whole chain, built then satisfied.
+    template<typename Selector>
+    void chain_benchmark(bench::runner& r, std::string const& name, Selector s)
+    {
+        for(std::size_t depth : { 1, 10, 100, 1000 })
+        {
+            r.run(
+                "chain/" + name + "/" + std::to_string(depth),
+                std::max<std::size_t>(1, 100000 / depth),
+                [depth, s](std::size_t)
+                {
+                    daily::promise<int> p;
+                    daily::future<int> f = p.get_future();
+                    for(std::size_t d = 0; d < depth; ++d)
+                        f = f.then(s, add_one);
+                    p.set_value(0);
+                    bench::do_not_optimize(f.get());
+                }
+            );
+        }
+    }
+
+    void chain_benchmarks(bench::runner& r)
+    {
+        chain_benchmark(r, "any", daily::continue_on::any);
+        chain_benchmark(r, "get", daily::continue_on::get);
+        chain_benchmark(r, "set", daily::continue_on::set);
+    }
+
+    // Ping-pong between two threads, one op is a single one way handoff.
+    // The promises are created up front so only the handoff is timed.
+    void handoff_benchmark(bench::runner& r)
+    {
+        std::string const name = "handoff/cross_thread";
+        if(!r.selected(name))
+            return;
+
+        std::size_t const round_trips = r.scaled(20000);
+        std::vector<daily::promise<int>> requests(round_trips);
+        std::vector<daily::promise<int>> replies(round_trips);
+        std::vector<daily::future<int>> request_futures;
+        std::vector<daily::future<int>> reply_futures;
+        for(std::size_t i = 0; i < round_trips; ++i)
+        {
+            request_futures.push_back(requests[i].get_future());
+            reply_futures.push_back(replies[i].get_future());
+        }
+
+        std::thread responder([&]
+        {
+            for(std::size_t i = 0; i < round_trips; ++i)
+                replies[i].set_value(request_futures[i].get() + 1);
+        });
+
+        std::size_t allocations = bench::detail::num_allocations().load();
+        std::size_t bytes = bench::detail::num_bytes().load();
+        bench::clock::time_point start = bench::clock::now();
+        for(std::size_t i = 0; i < round_trips; ++i)
+        {
+            requests[i].set_value(static_cast<int>(i));
+            bench::do_not_optimize(reply_futures[i].get());
+        }
+        bench::clock::time_point end = bench::clock::now();
+
+        responder.join();
+        r.record(
+            name,
+            round_trips * 2,
+            end - start,
+            bench::detail::num_allocations().load() - allocations,
+            bench::detail::num_bytes().load() - bytes);
+    }
+
+    // Each op builds a promise and one continuation here and releases both
+    // on another thread, the usual shape of a chain.
+    template<typename Allocator>
+    void cross_thread_free_benchmark(bench::runner& r, std::string const& name, Allocator alloc)
+    {
+        std::string const full_name = "allocator/cross_thread_free/" + name;
+        if(!r.selected(full_name))
+            return;
+
+        std::size_t const count = r.scaled(200000);
+        std::vector<daily::future<int>> futures(count);
+        std::atomic<std::size_t> published(0);
+        std::thread consumer([&]
+        {
+            for(std::size_t i = 0; i < count; ++i)
+            {
+                while(published.load(std::memory_order_acquire) <= i)
+                    std::this_thread::yield();
+                bench::do_not_optimize(futures[i].get());
+                futures[i] = daily::future<int>();
+            }
+        });
+
+        std::size_t allocations = bench::detail::num_allocations().load();
+        std::size_t bytes = bench::detail::num_bytes().load();
+        bench::clock::time_point start = bench::clock::now();
+        for(std::size_t i = 0; i < count; ++i)
+        {
+            daily::promise<int> p(std::allocator_arg, alloc);
+            futures[i] = p.get_future().then(daily::continue_on::any, add_one, alloc);
+            p.set_value(static_cast<int>(i));
+            published.store(i + 1, std::memory_order_release);
+        }
+
+        consumer.join();
+        bench::clock::time_point end = bench::clock::now();
+        r.record(
+            full_name,
+            count,
+            end - start,
+            bench::detail::num_allocations().load() - allocations,
+            bench::detail::num_bytes().load() - bytes);
+    }
+
+    // A promise and eight continuations built, run and released per op.
+    // MakePromise returns the promise and the allocator for the chain.
+    template<typename MakePromise>
+    void deep_chain_benchmark(bench::runner& r, std::string const& name, MakePromise make_promise)
+    {
+        std::string const full_name = "allocator/deep_chain/" + name;
+        if(!r.selected(full_name))
+            return;
+
+        std::size_t const count = r.scaled(100000);
+        std::size_t allocations = bench::detail::num_allocations().load();
+        std::size_t bytes = bench::detail::num_bytes().load();
+        bench::clock::time_point start = bench::clock::now();
+        for(std::size_t i = 0; i < count; ++i)
+        {
+            auto pa = make_promise();
+            daily::future<int> f = pa.first.get_future();
+            for(int j = 0; j < 8; ++j)
+                f = f.then(daily::continue_on::any, add_one, pa.second);
+            pa.first.set_value(static_cast<int>(i));
+            bench::do_not_optimize(f.get());
+        }
+
+        bench::clock::time_point end = bench::clock::now();
+        r.record(
+            full_name,
+            count,
+            end - start,
+            bench::detail::num_allocations().load() - allocations,
+            bench::detail::num_bytes().load() - bytes);
+    }
+
+    void allocator_benchmarks(bench::runner& r)
+    {
+        cross_thread_free_benchmark(r, "std", daily::future_default_allocator());
+        cross_thread_free_benchmark(r, "pool", daily::pool_allocator<void>());
+        deep_chain_benchmark(r, "std", []
+        {
+            daily::future_default_allocator alloc;
+            return std::make_pair(daily::promise<int>(std::allocator_arg, alloc), alloc);
+        });
+        deep_chain_benchmark(r, "arena", []
+        {
+            return daily::make_arena_promise<int>();
+        });
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bench::runner r(argc, argv);
+    promise_benchmarks(r);
+    continuation_benchmarks(r);
+    chain_benchmarks(r);
+    handoff_benchmark(r);
+    allocator_benchmarks(r);
+    return 0;
+}
@@ -0,0 +1,154 @@
+// ****************************************************************************
+// daily/future/bench/histogram.hpp
+//
+// Log-linear latency histogram in the style of HdrHistogram. Values below
+// 2^sub_bucket_bits are recorded exactly, above that each power of two range
+// is split into 2^(sub_bucket_bits - 1) linear buckets, so the relative
+// error is bounded by 2^-(sub_bucket_bits - 1) over the whole 64 bit range
+// with a fixed, small number of counters.
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#pragma once
+#ifndef DAILY_FUTURE_BENCH_HISTOGRAM_HPP_
+#define DAILY_FUTURE_BENCH_HISTOGRAM_HPP_
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+//
+namespace bench
+{
+    class histogram
+    {
+    public:
+
+        // 7 bits gives at most 1.6% error in under 4k counters.
+        explicit histogram(unsigned sub_bucket_bits = 7)
+            : sub_bucket_bits_(sub_bucket_bits)
+            , counts_(bucket_count(sub_bucket_bits), 0)
+        {
+            assert(sub_bucket_bits >= 1 && sub_bucket_bits < 32);
+        }
+
+        void record(std::uint64_t value)
+        {
+            ++counts_[index_of(value)];
+            ++total_;
+            max_ = std::max(max_, value);
+            min_ = std::min(min_, value);
+        }
+
+        void merge(histogram const& other)
+        {
+            assert(sub_bucket_bits_ == other.sub_bucket_bits_);
+            for(std::size_t i = 0; i < counts_.size(); ++i)
+                counts_[i] += other.counts_[i];
+            total_ += other.total_;
+            max_ = std::max(max_, other.max_);
+            min_ = std::min(min_, other.min_);
+        }
+
+        void reset()
+        {
+            std::fill(counts_.begin(), counts_.end(), 0);
+            total_ = 0;
+            max_ = 0;
+            min_ = ~std::uint64_t(0);
+        }
+
+        std::uint64_t count() const
+        {
+            return total_;
+        }
+
+        std::uint64_t max() const
+        {
+            return max_;
+        }
+
+        std::uint64_t min() const
+        {
+            return total_ ? min_ : 0;
+        }
+
+        // Highest value equivalent to the bucket holding the given
+        // percentile, in [0, 100].
+        std::uint64_t percentile(double p) const
+        {
+            if(total_ == 0)
+                return 0;
+
+            std::uint64_t rank = static_cast<std::uint64_t>(p / 100.0 * total_ + 0.5);
+            rank = std::max<std::uint64_t>(1, std::min(rank, total_));
+
+            std::uint64_t seen = 0;
+            for(std::size_t i = 0; i < counts_.size(); ++i)
+            {
+                seen += counts_[i];
+                if(seen >= rank)
+                    return std::min(highest_equivalent(i), max_);
+            }
+
+            return max_;
+        }
+
+    private:
+
+        static std::size_t bucket_count(unsigned sub_bucket_bits)
+        {
+            std::size_t const full = std::size_t(1) << sub_bucket_bits;
+            std::size_t const half = full / 2;
+            return full + (64 - sub_bucket_bits) * half;
+        }
+
+        static unsigned highest_bit(std::uint64_t value)
+        {
+            unsigned bit = 0;
+            while(value >>= 1)
+                ++bit;
+            return bit;
+        }
+
+        std::size_t index_of(std::uint64_t value) const
+        {
+            std::uint64_t const full = std::uint64_t(1) << sub_bucket_bits_;
+            std::uint64_t const half = full / 2;
+            if(value < full)
+                return static_cast<std::size_t>(value);
+
+            unsigned shift = highest_bit(value) - (sub_bucket_bits_ - 1);
+            std::uint64_t sub = value >> shift;
+            return static_cast<std::size_t>(full + (shift - 1) * half + (sub - half));
+        }
+
+        std::uint64_t highest_equivalent(std::size_t index) const
+        {
+            std::uint64_t const full = std::uint64_t(1) << sub_bucket_bits_;
+            std::uint64_t const half = full / 2;
+            if(index < full)
+                return index;
+
+            std::uint64_t shift = (index - full) / half + 1;
+            std::uint64_t sub = (index - full) % half + half;
+            return ((sub + 1) << shift) - 1;
+        }
+
+        unsigned sub_bucket_bits_;
+        std::vector<std::uint64_t> counts_;
+        std::uint64_t total_ = 0;
+        std::uint64_t max_ = 0;
+        std::uint64_t min_ = ~std::uint64_t(0);
+    };
+}
+
+#endif // DAILY_FUTURE_BENCH_HISTOGRAM_HPP_
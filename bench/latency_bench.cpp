@@ -0,0 +1,174 @@
+// ****************************************************************************
+// daily/future/bench/latency_bench.cpp
+//
+// Measures the delay from promise::set_value to the first instruction of
+// the attached continuation, per continuation policy, and prints
+// p50/p99/p999/max from a log-linear histogram.
+//
+// The continue_on policies run the continuation inside set_value. The
+// executor policies submit it to a single threaded pool, so their delay
+// includes waking the pool's thread.
+//
+// Options: --scale=F, --csv, --filter=policy.
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#define DAILY_BENCH_NO_ALLOCATION_COUNTING
+#include "bench.hpp"
+#include "histogram.hpp"
+#include "daily/future/future.hpp"
+#include "daily/future/priority_thread_pool.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+
+namespace {
+
+    struct options
+    {
+        double scale = 1.0;
+        bool csv = false;
+        std::string filter;
+    };
+
+    options parse_options(int argc, char** argv)
+    {
+        options o;
+        for(int i = 1; i < argc; ++i)
+        {
+            if(std::strcmp(argv[i], "--csv") == 0)
+                o.csv = true;
+            else if(std::strncmp(argv[i], "--scale=", 8) == 0)
+                o.scale = std::atof(argv[i] + 8);
+            else if(std::strncmp(argv[i], "--filter=", 9) == 0)
+                o.filter = argv[i] + 9;
+        }
+        return o;
+    }
+
+    std::uint64_t elapsed_ns(bench::clock::time_point start, bench::clock::time_point end)
+    {
+        return static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    }
+
+    // -------------------------------------------------------------------------
+    //
+    class report
+    {
+    public:
+
+        explicit report(bool csv)
+            : csv_(csv)
+        {
+            if(csv_)
+                std::printf("policy,count,min_ns,p50_ns,p99_ns,p999_ns,max_ns\n");
+            else
+                std::printf("%-18s %10s %10s %10s %10s %10s %10s\n",
+                    "policy", "count", "min ns", "p50 ns", "p99 ns", "p999 ns", "max ns");
+        }
+
+        void row(char const* policy, bench::histogram const& h)
+        {
+            char const* format = csv_
+                ? "%s,%llu,%llu,%llu,%llu,%llu,%llu\n"
+                : "%-18s %10llu %10llu %10llu %10llu %10llu %10llu\n";
+            std::printf(format, policy,
+                (unsigned long long)h.count(),
+                (unsigned long long)h.min(),
+                (unsigned long long)h.percentile(50),
+                (unsigned long long)h.percentile(99),
+                (unsigned long long)h.percentile(99.9),
+                (unsigned long long)h.max());
+            std::fflush(stdout);
+        }
+
+    private:
+
+        bool csv_;
+    };
+
+    // -------------------------------------------------------------------------
+    // Attach runs f.then(policy..., continuation) and returns the result.
+    // The set stamp is taken immediately before set_value and read by the
+    // continuation, f.get() orders consecutive iterations.
+    template<typename Attach>
+    void measure(options const& o, report& out, char const* policy, Attach attach)
+    {
+        if(!o.filter.empty() && std::string(policy).find(o.filter) == std::string::npos)
+            return;
+
+        std::size_t iterations = static_cast<std::size_t>(100000 * o.scale);
+        if(iterations == 0)
+            iterations = 1;
+
+        bench::histogram h;
+        bench::clock::time_point set_stamp;
+        auto continuation = [&h, &set_stamp](int v)
+        {
+            h.record(elapsed_ns(set_stamp, bench::clock::now()));
+            return v;
+        };
+
+        for(std::size_t i = 0; i < iterations / 10 + iterations; ++i)
+        {
+            // Skip the warm up iterations.
+            if(i == iterations / 10)
+                h.reset();
+
+            daily::promise<int> p;
+            daily::future<int> f = attach(p.get_future(), continuation);
+            set_stamp = bench::clock::now();
+            p.set_value(static_cast<int>(i));
+            bench::do_not_optimize(f.get());
+        }
+
+        out.row(policy, h);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    options o = parse_options(argc, argv);
+    report out(o.csv);
+
+    measure(o, out, "continue_on::any", [](daily::future<int> f, auto c)
+    {
+        return f.then(daily::continue_on::any, std::move(c));
+    });
+
+    measure(o, out, "continue_on::set", [](daily::future<int> f, auto c)
+    {
+        return f.then(daily::continue_on::set, std::move(c));
+    });
+
+    daily::priority_thread_pool pool(1);
+    auto ex = pool.get_executor();
+
+    measure(o, out, "execute::dispatch", [ex](daily::future<int> f, auto c)
+    {
+        return f.then(daily::execute::dispatch, ex, std::move(c));
+    });
+
+    measure(o, out, "execute::post", [ex](daily::future<int> f, auto c)
+    {
+        return f.then(daily::execute::post, ex, std::move(c));
+    });
+
+    measure(o, out, "execute::defer", [ex](daily::future<int> f, auto c)
+    {
+        return f.then(daily::execute::defer, ex, std::move(c));
+    });
+
+    return 0;
+}
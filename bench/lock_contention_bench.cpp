@@ -0,0 +1,169 @@
+// ****************************************************************************
+// daily/future/bench/lock_contention_bench.cpp
+//
+// Profiles the mutex shared by a chain's futures. The main thread keeps
+// appending then() links while earlier links are already running, posted
+// round robin to one single threaded pool per thread, so attaching and
+// fulfilling contend for the one lock. Built with
+// DAILY_FUTURE_ENABLE_LOCK_PROFILING and prints, per thread count and call
+// site, the acquisitions, how many were contended, and the mean wait and
+// hold time.
+//
+// Options: --threads=N (default hardware_concurrency), --scale=F, --csv.
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#define DAILY_FUTURE_ENABLE_LOCK_PROFILING
+#define DAILY_BENCH_NO_ALLOCATION_COUNTING
+#include "bench.hpp"
+#include "daily/future/future.hpp"
+#include "daily/future/priority_thread_pool.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    struct options
+    {
+        std::size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+        double scale = 1.0;
+        bool csv = false;
+    };
+
+    options parse_options(int argc, char** argv)
+    {
+        options o;
+        for(int i = 1; i < argc; ++i)
+        {
+            if(std::strcmp(argv[i], "--csv") == 0)
+                o.csv = true;
+            else if(std::strncmp(argv[i], "--scale=", 8) == 0)
+                o.scale = std::atof(argv[i] + 8);
+            else if(std::strncmp(argv[i], "--threads=", 10) == 0)
+                o.max_threads = std::max(1, std::atoi(argv[i] + 10));
+        }
+        return o;
+    }
+
+    std::size_t scaled(options const& o, std::size_t n)
+    {
+        std::size_t s = static_cast<std::size_t>(n * o.scale);
+        return s ? s : 1;
+    }
+
+    // 1, 2, 4, ... and max_threads itself.
+    std::vector<std::size_t> thread_counts(options const& o)
+    {
+        std::vector<std::size_t> counts;
+        for(std::size_t t = 1; t < o.max_threads; t *= 2)
+            counts.push_back(t);
+        counts.push_back(o.max_threads);
+        return counts;
+    }
+
+    // -------------------------------------------------------------------------
+    //
+    class report
+    {
+    public:
+
+        explicit report(bool csv)
+            : csv_(csv)
+        {
+            if(csv_)
+                std::printf("threads,site,acquisitions,contended,contended_pct,mean_wait_ns,mean_hold_ns\n");
+            else
+                std::printf("%8s %-14s %12s %12s %10s %14s %14s\n",
+                    "threads", "site", "acquisitions", "contended", "contended%",
+                    "mean wait ns", "mean hold ns");
+        }
+
+        void rows(std::size_t threads, daily::lock_profile const& profile)
+        {
+            for(std::size_t i = 0; i < static_cast<std::size_t>(daily::lock_site::count); ++i)
+            {
+                daily::lock_site site = static_cast<daily::lock_site>(i);
+                row(threads, daily::lock_site_name(site), profile[site]);
+            }
+
+            row(threads, "total", profile.total());
+            std::fflush(stdout);
+        }
+
+    private:
+
+        void row(std::size_t threads, char const* site, daily::lock_site_profile const& p)
+        {
+            if(p.acquisitions == 0)
+                return;
+
+            double contended_pct = 100.0 * p.contended_acquisitions / p.acquisitions;
+            double mean_wait = p.contended_acquisitions
+                ? static_cast<double>(p.wait_ns) / p.contended_acquisitions
+                : 0.0;
+            double mean_hold = static_cast<double>(p.hold_ns) / p.acquisitions;
+            char const* format = csv_
+                ? "%zu,%s,%lld,%lld,%.2f,%.0f,%.0f\n"
+                : "%8zu %-14s %12lld %12lld %10.2f %14.0f %14.0f\n";
+            std::printf(format,
+                threads, site,
+                static_cast<long long>(p.acquisitions),
+                static_cast<long long>(p.contended_acquisitions),
+                contended_pct, mean_wait, mean_hold);
+        }
+
+        bool csv_;
+    };
+
+    // -------------------------------------------------------------------------
+    //
+    void chain(options const& o, report& out, std::size_t num_threads)
+    {
+        std::size_t const links = scaled(o, 20000);
+
+        std::vector<std::unique_ptr<daily::priority_thread_pool>> pools;
+        for(std::size_t t = 0; t < num_threads; ++t)
+            pools.push_back(std::make_unique<daily::priority_thread_pool>(1));
+
+        // Satisfied up front so links start running as soon as they're
+        // attached, racing the main thread's next then().
+        daily::promise<int> p;
+        daily::future<int> f = p.get_future();
+        p.set_value(0);
+        for(std::size_t i = 1; i <= links; ++i)
+        {
+            f = f.then(
+                daily::execute::post,
+                pools[i % num_threads]->get_executor(),
+                [](int v) { return v + 1; }
+            );
+        }
+
+        bench::do_not_optimize(f.get());
+        out.rows(num_threads, p.chain_lock_profile());
+
+        f = daily::future<int>();
+        for(auto&& pool : pools)
+            pool->join();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    options o = parse_options(argc, argv);
+    report out(o.csv);
+    for(std::size_t t : thread_counts(o))
+        chain(o, out, t);
+    return 0;
+}
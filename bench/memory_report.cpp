@@ -0,0 +1,367 @@
+// ****************************************************************************
+// daily/future/bench/memory_report.cpp
+//
+// Prints sizeof and the bytes actually allocated, through a counting
+// allocator passed to the Allocator parameters, for each shared state type
+// and for whole promise + future + N continuation chains, for T in
+// {void, int, int&, 1KB struct}.
+//
+// Every row is checked against a budget. Budgets are set for 64 bit
+// libstdc++ and exist to catch layout regressions, the program exits
+// non-zero if any are exceeded. When a change legitimately grows a state,
+// update the budget alongside it.
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#define DAILY_BENCH_NO_ALLOCATION_COUNTING
+#include "bench.hpp"
+#include "daily/future/future.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace {
+
+    // -------------------------------------------------------------------------
+    //
+    struct allocation_counter
+    {
+        static std::size_t& allocations()
+        {
+            static std::size_t count = 0;
+            return count;
+        }
+
+        static std::size_t& bytes()
+        {
+            static std::size_t count = 0;
+            return count;
+        }
+
+        static void reset()
+        {
+            allocations() = 0;
+            bytes() = 0;
+        }
+    };
+
+    template<typename T>
+    struct counting_allocator
+    {
+        typedef T value_type;
+
+        counting_allocator()
+        {}
+
+        template<typename U>
+        counting_allocator(counting_allocator<U> const&)
+        {}
+
+        T* allocate(std::size_t n)
+        {
+            ++allocation_counter::allocations();
+            allocation_counter::bytes() += n * sizeof(T);
+            return std::allocator<T>().allocate(n);
+        }
+
+        void deallocate(T* p, std::size_t n)
+        {
+            std::allocator<T>().deallocate(p, n);
+        }
+
+        template<typename U>
+        bool operator==(counting_allocator<U> const&) const
+        {
+            return true;
+        }
+
+        template<typename U>
+        bool operator!=(counting_allocator<U> const&) const
+        {
+            return false;
+        }
+    };
+
+    typedef counting_allocator<char> allocator;
+
+    // -------------------------------------------------------------------------
+    // Result types under test, and a continuation that passes them through.
+    struct kilobyte
+    {
+        char data[1024];
+    };
+
+    template<typename T>
+    struct traits
+    {
+        static T value()
+        {
+            return T();
+        }
+
+        template<typename P>
+        static void set(P& p)
+        {
+            p.set_value(value());
+        }
+    };
+
+    template<>
+    struct traits<void>
+    {
+        template<typename P>
+        static void set(P& p)
+        {
+            p.set_value();
+        }
+    };
+
+    template<>
+    struct traits<int&>
+    {
+        template<typename P>
+        static void set(P& p)
+        {
+            static int i = 0;
+            p.set_value(i);
+        }
+    };
+
+    template<typename T>
+    struct pass
+    {
+        typedef T result_type;
+
+        T operator()(T v) const
+        {
+            return v;
+        }
+    };
+
+    template<>
+    struct pass<void>
+    {
+        typedef void result_type;
+
+        void operator()() const
+        {}
+    };
+
+    // Continuations can't return references, so int& decays to int after
+    // the first link. Executor continuations pass a copy of the parent's
+    // result, hence the const&.
+    template<>
+    struct pass<int&>
+    {
+        typedef int result_type;
+
+        int operator()(int const& v) const
+        {
+            return v;
+        }
+    };
+
+    // -------------------------------------------------------------------------
+    //
+    class report
+    {
+    public:
+
+        explicit report(bool csv)
+            : csv_(csv)
+        {
+            if(csv_)
+                std::printf("state,result,sizeof,allocations,allocated_bytes,budget,status\n");
+            else
+                std::printf("%-34s %-9s %8s %8s %10s %8s %s\n",
+                    "state", "result", "sizeof", "allocs", "bytes", "budget", "status");
+        }
+
+        // Checks the larger of sizeof and the allocated bytes against the
+        // budget.
+        void row(
+            char const* state,
+            char const* result,
+            std::size_t size,
+            std::size_t allocations,
+            std::size_t bytes,
+            std::size_t budget)
+        {
+            bool ok = std::max(size, bytes) <= budget;
+            if(!ok)
+                over_budget_ = true;
+
+            char const* format = csv_
+                ? "%s,%s,%zu,%zu,%zu,%zu,%s\n"
+                : "%-34s %-9s %8zu %8zu %10zu %8zu %s\n";
+            std::printf(format, state, result, size, allocations, bytes, budget,
+                ok ? "ok" : "OVER BUDGET");
+        }
+
+        bool over_budget() const
+        {
+            return over_budget_;
+        }
+
+    private:
+
+        bool csv_;
+        bool over_budget_ = false;
+    };
+
+    // -------------------------------------------------------------------------
+    // Budgets for the states excluding the result storage, the size of T
+    // (rounded up to a pointer) is added per state.
+    struct budget
+    {
+        static constexpr std::size_t promise_state = 128;
+        static constexpr std::size_t continue_on_state = 104;
+        static constexpr std::size_t executor_state = 128;
+
+        // Per allocation overhead of allocate_shared's control block.
+        static constexpr std::size_t control_block = 16;
+    };
+
+    template<typename T>
+    constexpr std::size_t result_size()
+    {
+        return (sizeof(T) + 7) & ~std::size_t(7);
+    }
+
+    template<>
+    constexpr std::size_t result_size<void>()
+    {
+        return 0;
+    }
+
+    template<>
+    constexpr std::size_t result_size<int&>()
+    {
+        return sizeof(int*);
+    }
+
+    template<typename T>
+    std::size_t measure_promise(report& out, char const* name)
+    {
+        typedef daily::detail::promise_future_shared_state<T> state;
+
+        allocation_counter::reset();
+        {
+            daily::promise<T> p(std::allocator_arg, allocator());
+        }
+
+        std::size_t bytes = allocation_counter::bytes();
+        out.row("promise_future_shared_state", name,
+            sizeof(state), allocation_counter::allocations(), bytes,
+            budget::promise_state + result_size<T>() + budget::control_block);
+        return bytes;
+    }
+
+    template<typename T, typename State, typename Attach>
+    void measure_continuation(
+        report& out,
+        char const* state_name,
+        char const* name,
+        std::size_t state_budget,
+        Attach attach)
+    {
+        typedef typename pass<T>::result_type result;
+
+        daily::promise<T> p(std::allocator_arg, allocator());
+        daily::future<T> f = p.get_future();
+
+        allocation_counter::reset();
+        daily::future<result> c = attach(std::move(f));
+        out.row(state_name, name,
+            sizeof(State), allocation_counter::allocations(), allocation_counter::bytes(),
+            state_budget + result_size<result>() + budget::control_block);
+
+        traits<T>::set(p);
+        c.get();
+    }
+
+    template<typename T>
+    void measure_chain(report& out, char const* name, std::size_t length, std::size_t promise_bytes)
+    {
+        typedef typename pass<T>::result_type result;
+
+        allocation_counter::reset();
+        {
+            daily::promise<T> p(std::allocator_arg, allocator());
+            daily::future<result> f =
+                p.get_future().then(daily::continue_on::any, pass<T>(), allocator());
+            for(std::size_t i = 1; i < length; ++i)
+                f = f.then(daily::continue_on::any, pass<result>(), allocator());
+            traits<T>::set(p);
+            f.get();
+        }
+
+        std::string state = "chain/continue_on::any/" + std::to_string(length);
+        std::size_t per_link = budget::continue_on_state + result_size<result>() + budget::control_block;
+        out.row(state.c_str(), name,
+            0, allocation_counter::allocations(), allocation_counter::bytes(),
+            promise_bytes + length * per_link);
+    }
+
+    template<typename T>
+    void measure_all(report& out, char const* name)
+    {
+        using namespace daily::detail;
+        typedef pass<T> function;
+        typedef typename function::result_type result;
+        typedef bench::inline_executor executor;
+
+        std::size_t promise_bytes = measure_promise<T>(out, name);
+
+        measure_continuation<T, continue_on_any_shared_state<T, result, function>>(
+            out, "continue_on_any_shared_state", name, budget::continue_on_state,
+            [](daily::future<T> f)
+            {
+                return f.then(daily::continue_on::any, function(), allocator());
+            });
+
+        measure_continuation<T, continue_on_get_shared_state<T, result, function>>(
+            out, "continue_on_get_shared_state", name, budget::continue_on_state,
+            [](daily::future<T> f)
+            {
+                return f.then(daily::continue_on::get, function(), allocator());
+            });
+
+        measure_continuation<T, continue_on_set_shared_state<T, result, function>>(
+            out, "continue_on_set_shared_state", name, budget::continue_on_state,
+            [](daily::future<T> f)
+            {
+                return f.then(daily::continue_on::set, function(), allocator());
+            });
+
+        measure_continuation<T, executor_continuation_shared_state<
+                submit_post, executor, T, result, function, allocator>>(
+            out, "executor_continuation_shared_state", name, budget::executor_state,
+            [](daily::future<T> f)
+            {
+                return f.then(daily::execute::post, executor(), function(), allocator());
+            });
+
+        measure_chain<T>(out, name, 1, promise_bytes);
+        measure_chain<T>(out, name, 8, promise_bytes);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool csv = argc > 1 && std::strcmp(argv[1], "--csv") == 0;
+    report out(csv);
+    measure_all<void>(out, "void");
+    measure_all<int>(out, "int");
+    measure_all<int&>(out, "int&");
+    measure_all<kilobyte>(out, "1KB");
+    return out.over_budget() ? 1 : 0;
+}
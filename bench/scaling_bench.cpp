@@ -0,0 +1,234 @@
+// ****************************************************************************
+// daily/future/bench/scaling_bench.cpp
+//
+// Sweeps 1..N threads over two workloads and reports throughput and per op
+// latency percentiles:
+//
+//   independent  Every thread creates, satisfies and reads its own
+//                promise/future pairs. Nothing is shared but the allocator.
+//
+//   chain        A single then() chain whose links are posted round robin
+//                to one single threaded pool per thread, so consecutive
+//                links are set from different threads and the chain's
+//                shared mutex moves between them. A chain is serial by
+//                nature, so this measures the per hop cost as the thread
+//                count grows rather than parallel throughput.
+//
+// Options: --threads=N (default hardware_concurrency), --scale=F, --csv.
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#define DAILY_BENCH_NO_ALLOCATION_COUNTING
+#include "bench.hpp"
+#include "daily/future/future.hpp"
+#include "daily/future/priority_thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    struct options
+    {
+        std::size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+        double scale = 1.0;
+        bool csv = false;
+    };
+
+    options parse_options(int argc, char** argv)
+    {
+        options o;
+        for(int i = 1; i < argc; ++i)
+        {
+            if(std::strcmp(argv[i], "--csv") == 0)
+                o.csv = true;
+            else if(std::strncmp(argv[i], "--scale=", 8) == 0)
+                o.scale = std::atof(argv[i] + 8);
+            else if(std::strncmp(argv[i], "--threads=", 10) == 0)
+                o.max_threads = std::max(1, std::atoi(argv[i] + 10));
+        }
+        return o;
+    }
+
+    std::size_t scaled(options const& o, std::size_t n)
+    {
+        std::size_t s = static_cast<std::size_t>(n * o.scale);
+        return s ? s : 1;
+    }
+
+    // 1, 2, 4, ... and max_threads itself.
+    std::vector<std::size_t> thread_counts(options const& o)
+    {
+        std::vector<std::size_t> counts;
+        for(std::size_t t = 1; t < o.max_threads; t *= 2)
+            counts.push_back(t);
+        counts.push_back(o.max_threads);
+        return counts;
+    }
+
+    typedef std::vector<std::uint64_t> samples;
+
+    std::uint64_t elapsed_ns(bench::clock::time_point start, bench::clock::time_point end)
+    {
+        return static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    }
+
+    // -------------------------------------------------------------------------
+    //
+    class report
+    {
+    public:
+
+        explicit report(bool csv)
+            : csv_(csv)
+        {
+            if(csv_)
+                std::printf("workload,threads,ops,ops_per_sec,p50_ns,p90_ns,p99_ns,p999_ns,max_ns\n");
+            else
+                std::printf("%-12s %8s %10s %14s %10s %10s %10s %10s %10s\n",
+                    "workload", "threads", "ops", "ops/sec",
+                    "p50 ns", "p90 ns", "p99 ns", "p999 ns", "max ns");
+        }
+
+        void row(char const* workload, std::size_t threads, bench::clock::duration wall, samples& s)
+        {
+            std::sort(s.begin(), s.end());
+            double seconds = std::chrono::duration<double>(wall).count();
+            double ops_per_sec = seconds > 0 ? s.size() / seconds : 0;
+            char const* format = csv_
+                ? "%s,%zu,%zu,%.0f,%llu,%llu,%llu,%llu,%llu\n"
+                : "%-12s %8zu %10zu %14.0f %10llu %10llu %10llu %10llu %10llu\n";
+            std::printf(format,
+                workload, threads, s.size(), ops_per_sec,
+                percentile(s, 0.5), percentile(s, 0.9), percentile(s, 0.99),
+                percentile(s, 0.999), s.empty() ? 0ull : (unsigned long long)s.back());
+            std::fflush(stdout);
+        }
+
+    private:
+
+        static unsigned long long percentile(samples const& sorted, double p)
+        {
+            if(sorted.empty())
+                return 0;
+
+            std::size_t index = static_cast<std::size_t>(p * (sorted.size() - 1));
+            return sorted[index];
+        }
+
+        bool csv_;
+    };
+
+    // -------------------------------------------------------------------------
+    //
+    void independent(options const& o, report& out, std::size_t num_threads)
+    {
+        std::size_t const ops_per_thread = scaled(o, 200000);
+        std::vector<samples> per_thread(num_threads, samples(ops_per_thread));
+        std::atomic<std::size_t> ready(0);
+        std::atomic<bool> go(false);
+
+        std::vector<std::thread> threads;
+        for(std::size_t t = 0; t < num_threads; ++t)
+        {
+            threads.emplace_back([&, t]
+            {
+                samples& s = per_thread[t];
+                ready.fetch_add(1);
+                while(!go.load(std::memory_order_acquire))
+                    std::this_thread::yield();
+
+                for(std::size_t i = 0; i < ops_per_thread; ++i)
+                {
+                    bench::clock::time_point start = bench::clock::now();
+                    daily::promise<int> p;
+                    daily::future<int> f = p.get_future();
+                    p.set_value(static_cast<int>(i));
+                    bench::do_not_optimize(f.get());
+                    s[i] = elapsed_ns(start, bench::clock::now());
+                }
+            });
+        }
+
+        while(ready.load() != num_threads)
+            std::this_thread::yield();
+
+        bench::clock::time_point start = bench::clock::now();
+        go.store(true, std::memory_order_release);
+        for(auto&& t : threads)
+            t.join();
+        bench::clock::time_point end = bench::clock::now();
+
+        samples all;
+        all.reserve(num_threads * ops_per_thread);
+        for(auto&& s : per_thread)
+            all.insert(all.end(), s.begin(), s.end());
+        out.row("independent", num_threads, end - start, all);
+    }
+
+    // -------------------------------------------------------------------------
+    //
+    void chain(options const& o, report& out, std::size_t num_threads)
+    {
+        std::size_t const links = scaled(o, 20000);
+
+        // One single threaded pool per thread so the link to thread mapping
+        // is deterministic.
+        std::vector<std::unique_ptr<daily::priority_thread_pool>> pools;
+        for(std::size_t t = 0; t < num_threads; ++t)
+            pools.push_back(std::make_unique<daily::priority_thread_pool>(1));
+
+        std::vector<bench::clock::time_point> stamps(links + 1);
+        daily::promise<int> p;
+        daily::future<int> f = p.get_future();
+        for(std::size_t i = 1; i <= links; ++i)
+        {
+            f = f.then(
+                daily::execute::post,
+                pools[i % num_threads]->get_executor(),
+                [&stamps, i](int v)
+                {
+                    stamps[i] = bench::clock::now();
+                    return v + 1;
+                }
+            );
+        }
+
+        stamps[0] = bench::clock::now();
+        p.set_value(0);
+        bench::do_not_optimize(f.get());
+
+        samples hops(links);
+        for(std::size_t i = 1; i <= links; ++i)
+            hops[i - 1] = elapsed_ns(stamps[i - 1], stamps[i]);
+        out.row("chain", num_threads, stamps[links] - stamps[0], hops);
+
+        f = daily::future<int>();
+        for(auto&& pool : pools)
+            pool->join();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    options o = parse_options(argc, argv);
+    report out(o.csv);
+    for(std::size_t t : thread_counts(o))
+        independent(o, out, t);
+    for(std::size_t t : thread_counts(o))
+        chain(o, out, t);
+    return 0;
+}
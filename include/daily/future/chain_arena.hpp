@@ -0,0 +1,262 @@
+// ****************************************************************************
+// daily/future/chain_arena.hpp
+//
+// A bump allocator for a whole chain. The arena counts the allocations
+// still live in it and is released in one step when the last of them, in
+// whatever order the chain's states are destroyed, is freed. Individual
+// deallocations don't return memory, ie;
+//
+//   auto pa = daily::make_arena_promise<int>();
+//   daily::future<int> f = pa.first.get_future()
+//       .then(daily::continue_on::any, g, pa.second)
+//       .then(daily::execute::post, pool, h, pa.second);
+//
+// Executor continuations given the allocator also take their queued ops
+// from the arena. Only use the allocator with the chain it was made for,
+// and don't hold anything allocated from it beyond the chain's lifetime.
+//
+// Allocation takes a per arena mutex because continuations can be
+// attached on one thread while another is scheduling the chain's ops.
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#pragma once
+#ifndef DAILY_FUTURE_CHAINARENA_HPP_
+#define DAILY_FUTURE_CHAINARENA_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include "daily/future/future.hpp"
+
+// -----------------------------------------------------------------------------
+//
+namespace daily
+{
+    // -------------------------------------------------------------------------
+    //
+    namespace detail
+    {
+        class chain_arena
+        {
+        public:
+
+            // The arena lives at the front of its own first block.
+            static chain_arena* create(std::size_t block_bytes)
+            {
+                std::size_t const header = header_size();
+                block_bytes = std::max(block_bytes, 2 * header);
+                char* memory = static_cast<char*>(::operator new(block_bytes));
+                chain_arena* arena = new(memory + align_up(sizeof(block))) chain_arena(
+                    reinterpret_cast<block*>(memory), block_bytes);
+                return arena;
+            }
+
+            // If the first allocation fails there will never be a
+            // deallocation to release the arena, so it goes now.
+            void* allocate(std::size_t bytes, std::size_t alignment)
+            {
+                std::unique_lock<std::mutex> lk(mutex_);
+                alignment = std::max(alignment, alignof(std::max_align_t));
+                char* p = align_up(cursor_, alignment);
+                if(p + bytes > end_)
+                {
+                    BOOST_TRY
+                    {
+                        grow(bytes + alignment);
+                    }
+                    BOOST_CATCH(...)
+                    {
+                        if(live_.load(std::memory_order_relaxed) == 0)
+                        {
+                            lk.unlock();
+                            release();
+                        }
+                        BOOST_RETHROW;
+                    }
+                    BOOST_CATCH_END
+                    p = align_up(cursor_, alignment);
+                }
+
+                cursor_ = p + bytes;
+                bytes_allocated_ += bytes;
+                live_.fetch_add(1, std::memory_order_relaxed);
+                return p;
+            }
+
+            // Memory is only really freed along with the last allocation.
+            void deallocate(void*) noexcept
+            {
+                if(live_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    release();
+            }
+
+            std::size_t bytes_allocated() const
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                return bytes_allocated_;
+            }
+
+            std::size_t bytes_reserved() const
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                return bytes_reserved_;
+            }
+
+        private:
+
+            struct block
+            {
+                block* next;
+            };
+
+            chain_arena(block* first, std::size_t size)
+                : cursor_(reinterpret_cast<char*>(first) + header_size())
+                , end_(reinterpret_cast<char*>(first) + size)
+                , blocks_(first)
+                , next_block_size_(size * 2)
+                , bytes_reserved_(size)
+            {
+                first->next = nullptr;
+            }
+
+            static std::size_t align_up(std::size_t n)
+            {
+                std::size_t const a = alignof(std::max_align_t);
+                return (n + a - 1) & ~(a - 1);
+            }
+
+            static char* align_up(char* p, std::size_t alignment)
+            {
+                std::uintptr_t i = reinterpret_cast<std::uintptr_t>(p);
+                return p + (((i + alignment - 1) & ~(alignment - 1)) - i);
+            }
+
+            static std::size_t header_size()
+            {
+                return align_up(sizeof(block)) + align_up(sizeof(chain_arena));
+            }
+
+            void grow(std::size_t at_least)
+            {
+                std::size_t size = std::max(next_block_size_, at_least + align_up(sizeof(block)));
+                block* b = static_cast<block*>(::operator new(size));
+                b->next = blocks_;
+                blocks_ = b;
+                cursor_ = reinterpret_cast<char*>(b) + align_up(sizeof(block));
+                end_ = reinterpret_cast<char*>(b) + size;
+                next_block_size_ = size * 2;
+                bytes_reserved_ += size;
+            }
+
+            // The first block, which holds this arena, is last in the list.
+            void release() noexcept
+            {
+                block* b = blocks_;
+                this->~chain_arena();
+                while(b)
+                {
+                    block* next = b->next;
+                    ::operator delete(b);
+                    b = next;
+                }
+            }
+
+            mutable std::mutex mutex_;
+            char* cursor_;
+            char* end_;
+            block* blocks_;
+            std::atomic<std::size_t> live_{0};
+            std::size_t next_block_size_;
+            std::size_t bytes_allocated_ = 0;
+            std::size_t bytes_reserved_;
+        };
+    }
+
+    // -------------------------------------------------------------------------
+    //
+    template<typename T>
+    class chain_arena_allocator
+    {
+    public:
+
+        typedef T value_type;
+
+        explicit chain_arena_allocator(detail::chain_arena* arena) noexcept
+            : arena_(arena)
+        {}
+
+        template<typename U>
+        chain_arena_allocator(chain_arena_allocator<U> const& other) noexcept
+            : arena_(other.arena_)
+        {}
+
+        T* allocate(std::size_t n)
+        {
+            return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T* p, std::size_t) noexcept
+        {
+            arena_->deallocate(p);
+        }
+
+        // Bytes handed out so far, and reserved from the system.
+        std::size_t bytes_allocated() const
+        {
+            return arena_->bytes_allocated();
+        }
+
+        std::size_t bytes_reserved() const
+        {
+            return arena_->bytes_reserved();
+        }
+
+    private:
+
+        template<typename>
+        friend class chain_arena_allocator;
+
+        template<typename U, typename V>
+        friend bool operator==(
+            chain_arena_allocator<U> const&, chain_arena_allocator<V> const&) noexcept;
+
+        detail::chain_arena* arena_;
+    };
+
+    template<typename T, typename U>
+    bool operator==(chain_arena_allocator<T> const& a, chain_arena_allocator<U> const& b) noexcept
+    {
+        return a.arena_ == b.arena_;
+    }
+
+    template<typename T, typename U>
+    bool operator!=(chain_arena_allocator<T> const& a, chain_arena_allocator<U> const& b) noexcept
+    {
+        return !(a == b);
+    }
+
+    // -------------------------------------------------------------------------
+    // Makes a new arena with a first block of block_bytes, and the promise
+    // that owns it. Pass the allocator to every then() of the chain.
+    template<typename Result>
+    std::pair<promise<Result>, chain_arena_allocator<void>>
+        make_arena_promise(std::size_t block_bytes = 2048)
+    {
+        chain_arena_allocator<void> alloc(detail::chain_arena::create(block_bytes));
+        promise<Result> p(std::allocator_arg, alloc);
+        return { std::move(p), alloc };
+    }
+}
+
+#endif // DAILY_FUTURE_CHAINARENA_HPP_
@@ -2,7 +2,8 @@
 // daily/future/default_allocator.hpp
 //
 // Provides a typedef for a default allocator because std::allocator<void>
-// doesn't work on all compilers.
+// doesn't work on all compilers. With DAILY_FUTURE_USE_MEMORY_RESOURCE it's
+// a resource_allocator instead, see memory_resource.hpp.
 // 
 // Copyright Chris Glover 2016
 //
@@ -15,8 +16,15 @@
 #ifndef DAILY_FUTURE_DEFAULTALLOCATOR_HPP_
 #define DAILY_FUTURE_DEFAULTALLOCATOR_HPP_
 
+#if defined(DAILY_FUTURE_USE_MEMORY_RESOURCE)
+#  include "daily/future/memory_resource.hpp"
+#endif
+
 namespace daily { 
-#if __GNUC__ == 6 && __GNUC_MINOR__ == 1
+#if defined(DAILY_FUTURE_USE_MEMORY_RESOURCE)
+    // Allocates from the calling thread's future memory resource.
+    typedef resource_allocator<char> future_default_allocator;
+#elif __GNUC__ == 6 && __GNUC_MINOR__ == 1
     // libstdc++ is broken with allocator void on 6.1
     typedef std::allocator<char> future_default_allocator;
 #else
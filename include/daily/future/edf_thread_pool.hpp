@@ -0,0 +1,507 @@
+// ****************************************************************************
+// daily/future/edf_thread_pool.hpp
+//
+// An earliest-deadline-first thread pool. Each closure carries an absolute
+// deadline, either set on the executor explicitly or inherited from the
+// deadline of the closure that submitted it, ie; a continuation attached with
+//
+//   f.then(daily::execute::post, pool.get_executor(), g);
+//
+// runs under the deadline of the work that satisfied f's promise. Each
+// worker keeps its own pairing heap and idle workers steal the earliest
+// deadline from their peers.
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#pragma once
+#ifndef DAILY_FUTURE_EDFTHREADPOOL_HPP_
+#define DAILY_FUTURE_EDFTHREADPOOL_HPP_
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "daily/future/default_allocator.hpp"
+#include "daily/future/executor_op.hpp"
+
+// -----------------------------------------------------------------------------
+//
+namespace daily
+{
+    typedef std::chrono::steady_clock deadline_clock;
+
+    // -------------------------------------------------------------------------
+    // What to do with work that's dequeued after its deadline has passed.
+    // Dropped closures are destroyed without running, which breaks any
+    // promise they own, so the future they would have satisfied throws
+    // future_error(broken_promise) from get().
+    enum class expired_work
+    {
+        run,
+        drop,
+    };
+
+    // -------------------------------------------------------------------------
+    //
+    namespace detail
+    {
+        inline deadline_clock::time_point& current_deadline()
+        {
+            static thread_local deadline_clock::time_point deadline_ =
+                deadline_clock::time_point::max();
+            return deadline_;
+        }
+
+        class edf_op : public executor_op
+        {
+        public:
+
+            edf_op(complete_fn f, deadline_clock::time_point deadline)
+                : executor_op(f)
+                , deadline_(deadline)
+            {}
+
+            deadline_clock::time_point deadline() const
+            {
+                return deadline_;
+            }
+
+        private:
+
+            friend class edf_heap;
+
+            deadline_clock::time_point deadline_;
+            edf_op* child_ = nullptr;
+            edf_op* sibling_ = nullptr;
+        };
+
+        // ---------------------------------------------------------------------
+        // Intrusive min pairing heap keyed on deadline, externally
+        // synchronised.
+        class edf_heap
+        {
+        public:
+
+            ~edf_heap()
+            {
+                while(!empty())
+                    pop()->destroy();
+            }
+
+            bool empty() const
+            {
+                return root_ == nullptr;
+            }
+
+            edf_op* top() const
+            {
+                return root_;
+            }
+
+            void push(edf_op* op)
+            {
+                op->child_ = nullptr;
+                op->sibling_ = nullptr;
+                root_ = meld(root_, op);
+            }
+
+            edf_op* pop()
+            {
+                edf_op* op = root_;
+                root_ = merge_pairs(op->child_);
+                op->child_ = nullptr;
+                return op;
+            }
+
+        private:
+
+            static edf_op* meld(edf_op* a, edf_op* b)
+            {
+                if(!a)
+                    return b;
+                if(!b)
+                    return a;
+                if(b->deadline_ < a->deadline_)
+                    std::swap(a, b);
+
+                b->sibling_ = a->child_;
+                a->child_ = b;
+                return a;
+            }
+
+            // Standard two pass merge, done iteratively so deep heaps
+            // can't overflow the stack.
+            static edf_op* merge_pairs(edf_op* first)
+            {
+                edf_op* pairs = nullptr;
+                while(first)
+                {
+                    edf_op* a = first;
+                    edf_op* b = a->sibling_;
+                    if(!b)
+                    {
+                        a->sibling_ = pairs;
+                        pairs = a;
+                        break;
+                    }
+
+                    first = b->sibling_;
+                    a->sibling_ = nullptr;
+                    b->sibling_ = nullptr;
+                    edf_op* m = meld(a, b);
+                    m->sibling_ = pairs;
+                    pairs = m;
+                }
+
+                edf_op* result = nullptr;
+                while(pairs)
+                {
+                    edf_op* next = pairs->sibling_;
+                    pairs->sibling_ = nullptr;
+                    result = meld(result, pairs);
+                    pairs = next;
+                }
+
+                return result;
+            }
+
+            edf_op* root_ = nullptr;
+        };
+    }
+
+    // -------------------------------------------------------------------------
+    // Sets the deadline inherited by work submitted from this thread, for
+    // example at the point a request enters the system.
+    class deadline_scope
+    {
+    public:
+
+        explicit deadline_scope(deadline_clock::time_point deadline)
+            : previous_(detail::current_deadline())
+        {
+            detail::current_deadline() = deadline;
+        }
+
+        ~deadline_scope()
+        {
+            detail::current_deadline() = previous_;
+        }
+
+        // time_point::max() if there is no deadline.
+        static deadline_clock::time_point current() noexcept
+        {
+            return detail::current_deadline();
+        }
+
+        deadline_scope(deadline_scope const&) = delete;
+        deadline_scope& operator=(deadline_scope const&) = delete;
+
+    private:
+
+        deadline_clock::time_point previous_;
+    };
+
+    // -------------------------------------------------------------------------
+    //
+    class edf_thread_pool
+    {
+    public:
+
+        typedef deadline_clock::time_point time_point;
+
+        class executor_type
+        {
+        public:
+
+            // Allows an executor to be passed directly to future::then.
+            executor_type get_executor() const noexcept
+            {
+                return *this;
+            }
+
+            executor_type with_deadline(time_point deadline) const noexcept
+            {
+                return executor_type(pool_, deadline, true);
+            }
+
+            template<typename Rep, typename Period>
+            executor_type with_timeout(std::chrono::duration<Rep, Period> const& rel_time) const
+            {
+                return with_deadline(deadline_clock::now() + rel_time);
+            }
+
+            // The deadline closures will be submitted with.
+            time_point deadline() const noexcept
+            {
+                return has_deadline_ ? deadline_ : detail::current_deadline();
+            }
+
+            edf_thread_pool& context() const noexcept
+            {
+                return *pool_;
+            }
+
+            void on_work_started() const noexcept
+            {}
+
+            void on_work_finished() const noexcept
+            {}
+
+            template<typename Function, typename Allocator = future_default_allocator>
+            void dispatch(Function&& f, Allocator const& alloc = Allocator()) const
+            {
+                if(pool_->running_in_this_thread())
+                {
+                    deadline_scope scope(deadline());
+                    typename std::decay<Function>::type func(std::forward<Function>(f));
+                    func();
+                    return;
+                }
+
+                pool_->push(deadline(), std::forward<Function>(f), alloc);
+            }
+
+            template<typename Function, typename Allocator = future_default_allocator>
+            void post(Function&& f, Allocator const& alloc = Allocator()) const
+            {
+                pool_->push(deadline(), std::forward<Function>(f), alloc);
+            }
+
+            template<typename Function, typename Allocator = future_default_allocator>
+            void defer(Function&& f, Allocator const& alloc = Allocator()) const
+            {
+                pool_->push(deadline(), std::forward<Function>(f), alloc);
+            }
+
+            // Executors with different deadlines schedule differently, so
+            // they only compare equal if they'd submit with the same one.
+            friend bool operator==(executor_type const& lhs, executor_type const& rhs) noexcept
+            {
+                return lhs.pool_ == rhs.pool_ &&
+                       lhs.has_deadline_ == rhs.has_deadline_ &&
+                       (!lhs.has_deadline_ || lhs.deadline_ == rhs.deadline_);
+            }
+
+            friend bool operator!=(executor_type const& lhs, executor_type const& rhs) noexcept
+            {
+                return !(lhs == rhs);
+            }
+
+        private:
+
+            friend class edf_thread_pool;
+
+            executor_type(edf_thread_pool* pool, time_point deadline, bool has_deadline)
+                : pool_(pool)
+                , deadline_(deadline)
+                , has_deadline_(has_deadline)
+            {}
+
+            edf_thread_pool* pool_;
+            time_point deadline_;
+            bool has_deadline_;
+        };
+
+        explicit edf_thread_pool(
+            std::size_t num_threads = std::thread::hardware_concurrency(),
+            expired_work expired = expired_work::run)
+            : expired_(expired)
+        {
+            if(num_threads == 0)
+                num_threads = 1;
+
+            workers_.reserve(num_threads);
+            for(std::size_t i = 0; i < num_threads; ++i)
+                workers_.emplace_back(new worker);
+
+            for(std::size_t i = 0; i < num_threads; ++i)
+                workers_[i]->thread_ = std::thread([this, i] { run(i); });
+        }
+
+        ~edf_thread_pool()
+        {
+            join();
+        }
+
+        edf_thread_pool(edf_thread_pool const&) = delete;
+        edf_thread_pool& operator=(edf_thread_pool const&) = delete;
+
+        // Executor that inherits the submitting thread's deadline.
+        executor_type get_executor() noexcept
+        {
+            return executor_type(this, time_point::max(), false);
+        }
+
+        // Number of closures dropped because their deadline had passed.
+        std::size_t num_expired() const noexcept
+        {
+            return num_expired_.load(std::memory_order_relaxed);
+        }
+
+        // Runs, or with expired_work::drop discards, everything still queued
+        // then stops the threads. Calling it from a closure the pool is
+        // running, or destroying the pool there, is a precondition violation.
+        void join()
+        {
+            assert(!running_in_this_thread() && "join() called from a worker thread");
+            {
+                std::unique_lock<std::mutex> lk(sleep_mutex_);
+                stop_ = true;
+            }
+            ready_.notify_all();
+            for(auto&& w : workers_)
+            {
+                if(w->thread_.joinable())
+                    w->thread_.join();
+            }
+        }
+
+    private:
+
+        struct worker
+        {
+            std::mutex mutex_;
+            detail::edf_heap heap_;
+            std::thread thread_;
+        };
+
+        template<typename Function, typename Allocator>
+        void push(time_point deadline, Function&& f, Allocator const& alloc)
+        {
+            detail::edf_op* op = detail::make_executor_op<detail::edf_op>(
+                std::forward<Function>(f), alloc, deadline);
+
+            // Work submitted from a worker stays local, everything else is
+            // spread round robin.
+            std::size_t index = running_in_this_thread() ? current_index() : no_worker;
+            if(index == no_worker)
+                index = next_worker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+
+            worker& w = *workers_[index];
+            {
+                std::unique_lock<std::mutex> lk(w.mutex_);
+                w.heap_.push(op);
+                pending_.fetch_add(1, std::memory_order_release);
+            }
+
+            {
+                std::unique_lock<std::mutex> lk(sleep_mutex_);
+            }
+            ready_.notify_one();
+        }
+
+        detail::edf_op* pop_from(worker& w)
+        {
+            std::unique_lock<std::mutex> lk(w.mutex_);
+            if(w.heap_.empty())
+                return nullptr;
+
+            pending_.fetch_sub(1, std::memory_order_relaxed);
+            return w.heap_.pop();
+        }
+
+        // Takes from our own heap first, otherwise steals whichever peer has
+        // the earliest deadline.
+        detail::edf_op* take(std::size_t index)
+        {
+            if(detail::edf_op* op = pop_from(*workers_[index]))
+                return op;
+
+            while(pending_.load(std::memory_order_acquire) != 0)
+            {
+                std::size_t victim = no_worker;
+                time_point earliest = time_point::max();
+                for(std::size_t i = 0; i < workers_.size(); ++i)
+                {
+                    worker& w = *workers_[i];
+                    std::unique_lock<std::mutex> lk(w.mutex_);
+                    if(!w.heap_.empty() &&
+                        (victim == no_worker || w.heap_.top()->deadline() < earliest))
+                    {
+                        victim = i;
+                        earliest = w.heap_.top()->deadline();
+                    }
+                }
+
+                if(victim == no_worker)
+                    return nullptr;
+
+                if(detail::edf_op* op = pop_from(*workers_[victim]))
+                    return op;
+            }
+
+            return nullptr;
+        }
+
+        void run(std::size_t index)
+        {
+            current_index() = index;
+            current_pool() = this;
+            while(true)
+            {
+                detail::edf_op* op = take(index);
+                if(!op)
+                {
+                    std::unique_lock<std::mutex> lk(sleep_mutex_);
+                    while(pending_.load(std::memory_order_acquire) == 0 && !stop_)
+                        ready_.wait(lk);
+
+                    if(pending_.load(std::memory_order_acquire) == 0)
+                        return;
+
+                    continue;
+                }
+
+                if(expired_ == expired_work::drop && op->deadline() < deadline_clock::now())
+                {
+                    num_expired_.fetch_add(1, std::memory_order_relaxed);
+                    op->destroy();
+                    continue;
+                }
+
+                deadline_scope scope(op->deadline());
+                op->complete();
+            }
+        }
+
+        bool running_in_this_thread() const
+        {
+            return current_pool() == this;
+        }
+
+        static constexpr std::size_t no_worker = ~std::size_t(0);
+
+        static std::size_t& current_index()
+        {
+            static thread_local std::size_t index_ = no_worker;
+            return index_;
+        }
+
+        static edf_thread_pool const*& current_pool()
+        {
+            static thread_local edf_thread_pool const* current_ = nullptr;
+            return current_;
+        }
+
+        std::vector<std::unique_ptr<worker>> workers_;
+        std::atomic<std::size_t> pending_{0};
+        std::atomic<std::size_t> next_worker_{0};
+        std::atomic<std::size_t> num_expired_{0};
+        std::mutex sleep_mutex_;
+        std::condition_variable ready_;
+        expired_work expired_;
+        bool stop_ = false;
+    };
+}
+
+#endif // DAILY_FUTURE_EDFTHREADPOOL_HPP_
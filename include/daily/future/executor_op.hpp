@@ -0,0 +1,173 @@
+// ****************************************************************************
+// daily/future/executor_op.hpp
+//
+// Type erased, allocator aware closure used by the executors in this
+// library to queue work intrusively.
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#pragma once
+#ifndef DAILY_FUTURE_EXECUTOROP_HPP_
+#define DAILY_FUTURE_EXECUTOROP_HPP_
+
+#include <boost/core/no_exceptions_support.hpp>
+#include <atomic>
+#include <memory>
+#include <utility>
+
+// -----------------------------------------------------------------------------
+//
+namespace daily { namespace detail
+{
+    // -------------------------------------------------------------------------
+    // Base of all queued closures. Derived bases can add scheduling data
+    // (priority, deadline) and are used as the Base of executor_op_impl.
+    class executor_op
+    {
+    public:
+
+        typedef void (*complete_fn)(executor_op*, bool);
+
+        // Runs the closure and frees the op.
+        void complete()
+        {
+            complete_(this, true);
+        }
+
+        // Frees the op without running the closure.
+        void destroy()
+        {
+            complete_(this, false);
+        }
+
+        // Intrusive link for whichever queue currently owns the op.
+        std::atomic<executor_op*> next_;
+
+    protected:
+
+        executor_op(complete_fn f)
+            : next_(nullptr)
+            , complete_(f)
+        {}
+
+        ~executor_op()
+        {}
+
+    private:
+
+        complete_fn complete_;
+    };
+
+    // -------------------------------------------------------------------------
+    //
+    template<typename Base, typename Function, typename Allocator>
+    class executor_op_impl : public Base
+    {
+    public:
+
+        typedef typename std::allocator_traits<
+            Allocator
+        >::template rebind_alloc<executor_op_impl> allocator_type;
+
+        template<typename... BaseArgs>
+        static Base* create(Function&& f, Allocator const& alloc, BaseArgs&&... args)
+        {
+            allocator_type a(alloc);
+            executor_op_impl* op = std::allocator_traits<allocator_type>::allocate(a, 1);
+            BOOST_TRY
+            {
+                new(op) executor_op_impl(std::move(f), a, std::forward<BaseArgs>(args)...);
+            }
+            BOOST_CATCH(...)
+            {
+                std::allocator_traits<allocator_type>::deallocate(a, op, 1);
+                BOOST_RETHROW;
+            }
+            BOOST_CATCH_END
+            return op;
+        }
+
+    private:
+
+        template<typename... BaseArgs>
+        executor_op_impl(Function&& f, allocator_type const& a, BaseArgs&&... args)
+            : Base(&do_complete, std::forward<BaseArgs>(args)...)
+            , function_(std::move(f))
+            , allocator_(a)
+        {}
+
+        static void do_complete(executor_op* base, bool invoke)
+        {
+            // Free the memory before the upcall so closures that submit
+            // more work can reuse it.
+            executor_op_impl* op = static_cast<executor_op_impl*>(base);
+            allocator_type a(std::move(op->allocator_));
+            Function f(std::move(op->function_));
+            op->~executor_op_impl();
+            std::allocator_traits<allocator_type>::deallocate(a, op, 1);
+            if(invoke)
+                f();
+        }
+
+        Function function_;
+        allocator_type allocator_;
+    };
+
+    template<typename Base, typename Function, typename Allocator, typename... BaseArgs>
+    Base* make_executor_op(Function&& f, Allocator const& alloc, BaseArgs&&... args)
+    {
+        typedef typename std::decay<Function>::type function_type;
+        function_type func(std::forward<Function>(f));
+        return executor_op_impl<Base, function_type, Allocator>::create(
+            std::move(func), alloc, std::forward<BaseArgs>(args)...);
+    }
+
+    // -------------------------------------------------------------------------
+    // Simple intrusive FIFO, externally synchronised.
+    template<typename Op>
+    class executor_op_queue
+    {
+    public:
+
+        bool empty() const
+        {
+            return head_ == nullptr;
+        }
+
+        Op* front() const
+        {
+            return head_;
+        }
+
+        void push(Op* op)
+        {
+            op->next_.store(nullptr, std::memory_order_relaxed);
+            if(tail_)
+                tail_->next_.store(op, std::memory_order_relaxed);
+            else
+                head_ = op;
+            tail_ = op;
+        }
+
+        Op* pop()
+        {
+            Op* op = head_;
+            head_ = static_cast<Op*>(op->next_.load(std::memory_order_relaxed));
+            if(!head_)
+                tail_ = nullptr;
+            return op;
+        }
+
+    private:
+
+        Op* head_ = nullptr;
+        Op* tail_ = nullptr;
+    };
+}} // namespace daily { namespace detail
+
+#endif // DAILY_FUTURE_EXECUTOROP_HPP_
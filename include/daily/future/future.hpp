@@ -18,10 +18,27 @@
 #include <boost/optional.hpp>
 #include <boost/throw_exception.hpp>
 #include <boost/core/no_exceptions_support.hpp>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <memory>
 #include <mutex>
+#include <new>
+#include <type_traits>
 #include "daily/future/default_allocator.hpp"
+#include "daily/future/introspection.hpp"
+#include "daily/future/lock_profile.hpp"
+#include "daily/future/probes.hpp"
+#include "daily/future/state_layout.hpp"
+#include "daily/future/statistics.hpp"
+#include "daily/future/trace.hpp"
+
+// Callables up to this size, that can be moved without throwing, are
+// stored inside a packaged_task rather than allocated.
+#if !defined(DAILY_FUTURE_PACKAGED_TASK_INLINE_SIZE)
+#  define DAILY_FUTURE_PACKAGED_TASK_INLINE_SIZE (4 * sizeof(void*))
+#endif
 
 // -----------------------------------------------------------------------------
 //
@@ -35,6 +52,9 @@ namespace daily
     template<typename Result>
     class promise;
 
+    template<typename Signature>
+    class packaged_task;
+
     // -------------------------------------------------------------------------
     //
     enum class future_status
@@ -58,6 +78,25 @@ namespace daily
         struct set_t {} constexpr set;
     };
 
+    namespace detail
+    {
+        template<typename T>
+        struct is_continue_on : std::false_type
+        {};
+
+        template<>
+        struct is_continue_on<continue_on::any_t> : std::true_type
+        {};
+
+        template<>
+        struct is_continue_on<continue_on::get_t> : std::true_type
+        {};
+
+        template<>
+        struct is_continue_on<continue_on::set_t> : std::true_type
+        {};
+    }
+
     namespace execute
     {
         struct dispatch_t {} constexpr dispatch;
@@ -90,11 +129,11 @@ namespace daily
     {
         class reverse_lock
         {
-            std::unique_lock<std::mutex>& lock_;
+            std::unique_lock<chain_mutex>& lock_;
 
         public:
 
-            reverse_lock(std::unique_lock<std::mutex>& lk)
+            reverse_lock(std::unique_lock<chain_mutex>& lk)
                 : lock_(lk)
             {
                 lock_.unlock();
@@ -123,6 +162,9 @@ namespace daily
         // -------------------------------------------------------------------------
         // Base shared state used by all derived shared states.
         class future_shared_state_base
+            : public shared_state_statistics
+            , public shared_state_trace
+            , public shared_state_registration
         {
         public:
             // No copying or moving, pointer semantic only.
@@ -135,13 +177,14 @@ namespace daily
             {}
 
             future_shared_state_base()
-                : finished_(false)
-                , is_valid_(true)
             {}  
 
-            void set_finished(std::unique_lock<std::mutex>& lock)
+            void set_finished(std::unique_lock<chain_mutex>& lock)
             {
-                finished_ = true;
+                DAILY_FUTURE_PROBE1(set_finished, this);
+                count_statistic(statistic::futures_satisfied);
+                pending_finished();
+                flags_.set(state_flags::finished);
                 ready_wait_.notify_all();
                 if(continuation_)
                 {
@@ -151,90 +194,157 @@ namespace daily
 
             void set_finished_with_exception(
                 std::exception_ptr p, 
-                std::unique_lock<std::mutex>& lock)
+                std::unique_lock<chain_mutex>& lock)
             {
+                DAILY_FUTURE_PROBE1(set_finished_with_exception, this);
+                count_statistic(statistic::futures_satisfied);
+                count_statistic(statistic::exceptions_set);
+                pending_finished();
                 exception_ = std::move(p);
                 // Don't call set finished because we don't want to run the continuations.
-                finished_ = true;
+                flags_.set(state_flags::finished | state_flags::exception);
                 ready_wait_.notify_all();
             }
             
-            bool is_finished(std::unique_lock<std::mutex>&)
+            bool is_finished(std::unique_lock<chain_mutex>&)
             {
-                return finished_;
+                return is_finished();
             }
 
-            bool has_exception(std::unique_lock<std::mutex>&) const
+            bool has_exception(std::unique_lock<chain_mutex>&) const
             {
-                return exception_ ? true : false;
+                return has_exception();
             }
 
-            void set_invalid(std::unique_lock<std::mutex>&)
+            bool has_value(std::unique_lock<chain_mutex>&) const
             {
-                is_valid_ = false;
+                return has_value();
             }
 
-            bool is_valid(std::unique_lock<std::mutex>&) const
+            void set_invalid(std::unique_lock<chain_mutex>&)
             {
-                return is_valid_;
+                flags_.set(state_flags::invalid);
+            }
+
+            bool is_valid(std::unique_lock<chain_mutex>&) const
+            {
+                return is_valid();
+            }
+
+            // The overloads without a lock are acquire loads of the flags,
+            // for the observers and polling. A result or exception is
+            // visible once is_finished() has returned true.
+            bool is_finished() const
+            {
+                return flags_.test(state_flags::finished);
+            }
+
+            bool has_exception() const
+            {
+                return flags_.test(state_flags::exception);
+            }
+
+            bool has_value() const
+            {
+                return (flags_.load() & (state_flags::finished | state_flags::exception)) ==
+                    state_flags::finished;
+            }
+
+            bool is_valid() const
+            {
+                return !flags_.test(state_flags::invalid);
+            }
+
+            unsigned generation() const
+            {
+                return flags_.generation();
+            }
+
+            // Clears the state for another round. Only for a promise's state
+            // that nothing else refers to anymore, so it doesn't lock.
+            void recycle()
+            {
+                exception_ = nullptr;
+                continuation_.reset();
+                flags_.next_generation();
             }
 
             void set_continuation(
                 std::shared_ptr<future_shared_state_base> continuation, 
-                std::unique_lock<std::mutex>& lock)
+                std::unique_lock<chain_mutex>& lock)
             {
+                DAILY_FUTURE_PROBE2(set_continuation, this, continuation.get());
                 continuation_ = std::move(continuation);
-                if(finished_)
+                if(is_finished())
                 {
                     continuation_->continuation_result_ready(lock);
                 }
             }
 
-            void do_wait_result(std::unique_lock<std::mutex>& lock)
+            void do_wait_result(std::unique_lock<chain_mutex>& lock)
             {
-                if(!finished_)
+                if(!is_finished())
                     continuation_result_requested(lock);
 
                 do_wait(lock);
             }
 
-            void check_exception(std::unique_lock<std::mutex>& lock)
+            void check_exception(std::unique_lock<chain_mutex>& lock)
             {
                 if(exception_)
                     std::rethrow_exception(exception_);
             }
             
-            void do_wait(std::unique_lock<std::mutex>& lock)
+            void do_wait(std::unique_lock<chain_mutex>& lock)
             {
-                while(!finished_)
+                if(is_finished())
+                    return;
+
+                blocked_wait_timer timer;
+                trace_scope trace("wait", "future", trace_id());
+                DAILY_FUTURE_PROBE1(wait_begin, this);
+                pending_wait_begin();
+                while(!is_finished())
                     ready_wait_.wait(lock);
+                pending_wait_end();
+                DAILY_FUTURE_PROBE1(wait_end, this);
             }
 
             template <typename Rep, typename Period>
             future_status do_wait_for(
                 std::chrono::duration<Rep, Period> const& rel_time,
-                std::unique_lock<std::mutex>& lock)
+                std::unique_lock<chain_mutex>& lock)
             {
+                blocked_wait_timer timer;
+                DAILY_FUTURE_PROBE1(wait_begin, this);
+                pending_wait_begin();
                 ready_wait_.wait_for(rel_time, lock);
-                return finished_ ? future_status::ready : future_status::timeout;
+                pending_wait_end();
+                DAILY_FUTURE_PROBE1(wait_end, this);
+                return is_finished() ? future_status::ready : future_status::timeout;
             }
 
             template <typename Clock, typename Duration>
             future_status do_wait_until(
                 std::chrono::time_point<Clock, Duration> const& abs_time,
-                std::unique_lock<std::mutex>& lock)
+                std::unique_lock<chain_mutex>& lock)
             {
+                blocked_wait_timer timer;
+                DAILY_FUTURE_PROBE1(wait_begin, this);
+                pending_wait_begin();
                 ready_wait_.wait_until(abs_time, lock);
-                return finished_ ? future_status::ready : future_status::timeout;
+                pending_wait_end();
+                DAILY_FUTURE_PROBE1(wait_end, this);
+                return is_finished() ? future_status::ready : future_status::timeout;
             }
 
             // Only implemented by continuation derived shared_state types
-            void continuation_result_ready(std::unique_lock<std::mutex>& lock)
+            void continuation_result_ready(std::unique_lock<chain_mutex>& lock)
             {
                 handle_continuation_result_ready(lock);
             }
 
-            void continuation_result_requested(std::unique_lock<std::mutex>& lock)
+            void continuation_result_requested(std::unique_lock<chain_mutex>& lock)
             {
                 handle_continuation_result_requested(lock);
             }
@@ -242,20 +352,29 @@ namespace daily
         private:
 
             // Only implemented by continuation derived shared_state types
-            virtual void handle_continuation_result_ready(std::unique_lock<std::mutex>&)
+            virtual void handle_continuation_result_ready(std::unique_lock<chain_mutex>&)
             {}
 
-            virtual void handle_continuation_result_requested(std::unique_lock<std::mutex>& lock)
+            virtual void handle_continuation_result_requested(std::unique_lock<chain_mutex>& lock)
             {
-                while(!finished_)
-                    ready_wait_.wait(lock);
+                do_wait(lock);
             }
 
+            // Compact keeps the flags next to the derived state's result.
+            // Separated puts everything a waiting thread touches first, and
+            // what the producer writes a full cache line later.
+#if defined(DAILY_FUTURE_ENABLE_CACHE_LINE_SEPARATION)
+            state_flags flags_;
+            chain_condition_variable ready_wait_;
+            std::shared_ptr<future_shared_state_base> continuation_;
+            char producer_line_padding_[cache_line_size];
+            std::exception_ptr exception_;
+#else
             std::exception_ptr exception_;
-            std::condition_variable ready_wait_;
+            chain_condition_variable ready_wait_;
             std::shared_ptr<future_shared_state_base> continuation_;
-            bool finished_;
-            bool is_valid_;
+            state_flags flags_;
+#endif
         };
 
         // -------------------------------------------------------------------------
@@ -267,22 +386,23 @@ namespace daily
 
             typedef boost::optional<Result> storage_type;
 
-            void set_finished_with_result(Result r, std::unique_lock<std::mutex>& lock)
+            void set_finished_with_result(Result r, std::unique_lock<chain_mutex>& lock)
             {
                 result_ = std::move(r);
                 set_finished(lock);
             }
 
-            Result get(std::unique_lock<std::mutex>& lock)
+            Result get(std::unique_lock<chain_mutex>& lock)
             {
                 set_invalid(lock);
                 this->check_exception(lock);
                 return *std::move(result_);
             }
 
-            bool has_value(std::unique_lock<std::mutex>&) const
+            void recycle()
             {
-                return result_;
+                result_ = boost::none;
+                future_shared_state_base::recycle();
             }
 
         private:
@@ -300,12 +420,12 @@ namespace daily
 
             typedef void storage_tyoe;
 
-            void set_finished_with_result(std::unique_lock<std::mutex>& lock)
+            void set_finished_with_result(std::unique_lock<chain_mutex>& lock)
             {
                 set_finished(lock);
             }
 
-            void get(std::unique_lock<std::mutex>& lock)
+            void get(std::unique_lock<chain_mutex>& lock)
             {
                 set_invalid(lock);
                 this->check_exception(lock);
@@ -326,24 +446,56 @@ namespace daily
                 : result_(nullptr)
             {}
 
-            void set_finished_with_result(Result& r, std::unique_lock<std::mutex>& lock)
+            void set_finished_with_result(Result& r, std::unique_lock<chain_mutex>& lock)
             {
                 result_ = &r;
                 set_finished(lock);
             }
 
-            Result& get(std::unique_lock<std::mutex>& lock)
+            Result& get(std::unique_lock<chain_mutex>& lock)
             {
                 set_invalid(lock);
                 this->check_exception(lock);
                 return *result_;
             }
 
+            void recycle()
+            {
+                result_ = nullptr;
+                future_shared_state_base::recycle();
+            }
+
         private:
 
             storage_type result_;
         };
 
+        // ---------------------------------------------------------------------
+        // What future::try_get returns, void has nothing to hold so it says
+        // whether the state was ready instead.
+        template<typename Result>
+        struct try_get_result
+        {
+            typedef boost::optional<Result> type;
+
+            static type get(future_shared_state<Result>& state, std::unique_lock<chain_mutex>& lock)
+            {
+                return type(state.get(lock));
+            }
+        };
+
+        template<>
+        struct try_get_result<void>
+        {
+            typedef bool type;
+
+            static type get(future_shared_state<void>& state, std::unique_lock<chain_mutex>& lock)
+            {
+                state.get(lock);
+                return true;
+            }
+        };
+
         // ---------------------------------------------------------------------
         // Shared state initially created by the promise. Contains the mutex
         // used to lock the system.
@@ -352,17 +504,17 @@ namespace daily
         {
         public:
 
-            std::unique_lock<std::mutex> lock() const
+            std::unique_lock<chain_mutex> lock() const
             {
-                return std::unique_lock<std::mutex>(mutex_);
+                return std::unique_lock<chain_mutex>(mutex_);
             }
 
         private:
 
             template<typename>
-            friend class promise;
+            friend class daily::promise;
 
-            mutable std::mutex mutex_;
+            mutable chain_mutex mutex_;
         };
 
         template<typename Param, typename Return>
@@ -374,7 +526,7 @@ namespace daily
             template<typename Caller>
             static void call(
                 Caller* caller,
-                std::unique_lock<std::mutex>& lock)
+                std::unique_lock<chain_mutex>& lock)
             {
                 // Don't call user code with the lock still obtained.
                 lock.unlock();
@@ -393,7 +545,7 @@ namespace daily
             template<typename Caller>
             static void call(
                 Caller* caller,
-                std::unique_lock<std::mutex>& lock)
+                std::unique_lock<chain_mutex>& lock)
             {
                 // Don't call user code with the lock still obtained.
                 lock.unlock();
@@ -410,7 +562,7 @@ namespace daily
             template<typename Caller>
             static void call(
                 Caller* caller,
-                std::unique_lock<std::mutex>& lock)
+                std::unique_lock<chain_mutex>& lock)
             {
                 // Don't call user code with the lock still obtained.
                 lock.unlock();
@@ -427,7 +579,7 @@ namespace daily
             template<typename Caller>
             static void call(
                 Caller* caller,
-                std::unique_lock<std::mutex>& lock)
+                std::unique_lock<chain_mutex>& lock)
             {
                 // Don't call user code with the lock still obtained.
                 lock.unlock();
@@ -457,8 +609,9 @@ namespace daily
             template<typename Param, typename Return>
             friend struct continue_on_continuation_helper;
 
-            void do_continue(std::unique_lock<std::mutex>& lock)
+            void do_continue(std::unique_lock<chain_mutex>& lock)
             {
+                lock_site_scope site(lock_site::continuation);
                 BOOST_TRY
                 {
                     continue_on_continuation_helper<ParentResult, Result>::call(this, lock);
@@ -495,15 +648,28 @@ namespace daily
 
         private:
 
-            void handle_continuation_result_ready(std::unique_lock<std::mutex>& lock) override
+            void handle_continuation_result_ready(std::unique_lock<chain_mutex>& lock) override
             {
+                count_statistic(statistic::continuations_any);
+                trace_scope trace("continuation", "continue_on::any", this->trace_id());
+                DAILY_FUTURE_PROBE2(continuation_run, this, "continue_on::any");
                 this->do_continue(lock);
                 this->check_exception(lock);
             }
 
-            void handle_continuation_result_requested(std::unique_lock<std::mutex>& lock) override
+            void handle_continuation_result_requested(std::unique_lock<chain_mutex>& lock) override
             {
-                this->do_continue(lock);
+                // A parent that finishes with a value has already run us,
+                // possibly on another thread, so only an exception needs
+                // forwarding from here.
+                this->parent_->continuation_result_requested(lock);
+                if(!this->is_finished(lock) && this->parent_->has_exception(lock))
+                {
+                    count_statistic(statistic::continuations_any);
+                    trace_scope trace("continuation", "continue_on::any", this->trace_id());
+                    DAILY_FUTURE_PROBE2(continuation_run, this, "continue_on::any");
+                    this->do_continue(lock);
+                }
             }
         };
 
@@ -521,13 +687,16 @@ namespace daily
 
         private:
 
-            void handle_continuation_result_ready(std::unique_lock<std::mutex>& lock) override
+            void handle_continuation_result_ready(std::unique_lock<chain_mutex>& lock) override
             {
+                count_statistic(statistic::continuations_set);
+                trace_scope trace("continuation", "continue_on::set", this->trace_id());
+                DAILY_FUTURE_PROBE2(continuation_run, this, "continue_on::set");
                 this->do_continue(lock);
                 this->check_exception(lock);
             }
 
-            void handle_continuation_result_requested(std::unique_lock<std::mutex>& lock)
+            void handle_continuation_result_requested(std::unique_lock<chain_mutex>& lock)
             {
                 this->parent_->continuation_result_requested(lock);
             }
@@ -547,9 +716,12 @@ namespace daily
 
         private:
 
-            void handle_continuation_result_requested(std::unique_lock<std::mutex>& lock) override
+            void handle_continuation_result_requested(std::unique_lock<chain_mutex>& lock) override
             {
                 this->parent_->continuation_result_requested(lock);
+                count_statistic(statistic::continuations_get);
+                trace_scope trace("continuation", "continue_on::get", this->trace_id());
+                DAILY_FUTURE_PROBE2(continuation_run, this, "continue_on::get");
                 this->do_continue(lock);
             }
         };
@@ -568,9 +740,13 @@ namespace daily
             Function&& func,
             Allocator const& alloc)
         {
-            return std::allocate_shared<
+            auto state = std::allocate_shared<
                 continue_on_any_shared_state<ParentResult, Result, Function>
             >(alloc, parent, std::forward<Function>(func));
+            state->track_shared_state(sizeof(*state));
+            state->inherit_trace(*parent);
+            state->register_pending("continue_on::any", parent);
+            return state;
         }
 
         template<
@@ -585,9 +761,13 @@ namespace daily
             Function&& func,
             Allocator const& alloc)
         {
-            return std::allocate_shared<
+            auto state = std::allocate_shared<
                 continue_on_get_shared_state<ParentResult, Result, Function>
             >(alloc, parent, std::forward<Function>(func));
+            state->track_shared_state(sizeof(*state));
+            state->inherit_trace(*parent);
+            state->register_pending("continue_on::get", parent);
+            return state;
         }
 
         template<
@@ -602,15 +782,26 @@ namespace daily
             Function&& func,
             Allocator const& alloc)
         {
-            return std::allocate_shared<
+            auto state = std::allocate_shared<
                 continue_on_set_shared_state<ParentResult, Result, Function>
             >(alloc, parent, std::forward<Function>(func));
+            state->track_shared_state(sizeof(*state));
+            state->inherit_trace(*parent);
+            state->register_pending("continue_on::set", parent);
+            return state;
         }
 
         // ---------------------------------------------------------------------
         // Executor Continuations.
         struct submit_dispatch
         {
+            static constexpr statistic continuation_statistic = statistic::continuations_dispatch;
+
+            static char const* policy_name()
+            {
+                return "execute::dispatch";
+            }
+
             template<typename Executor, typename Closure, typename Allocator>
             static void submit(Executor ex, Closure&& c, Allocator const& alloc)
             {
@@ -620,6 +811,13 @@ namespace daily
 
         struct submit_post
         {
+            static constexpr statistic continuation_statistic = statistic::continuations_post;
+
+            static char const* policy_name()
+            {
+                return "execute::post";
+            }
+
             template<typename Executor, typename Closure, typename Allocator>
             static void submit(Executor ex, Closure&& c, Allocator const& alloc)
             {
@@ -629,6 +827,13 @@ namespace daily
 
         struct submit_defer
         {
+            static constexpr statistic continuation_statistic = statistic::continuations_defer;
+
+            static char const* policy_name()
+            {
+                return "execute::defer";
+            }
+
             template<typename Executor, typename Closure, typename Allocator>
             static void submit(Executor ex, Closure&& c, Allocator const& alloc)
             {
@@ -636,6 +841,102 @@ namespace daily
             }
         };
 
+        // ---------------------------------------------------------------------
+        // Owns the right to satisfy an executor continuation. An executor
+        // that destroys the closure without running it, such as one that
+        // drops expired work, breaks the promise just as destroying a
+        // daily::promise would, rather than leaving the future unready.
+        template<typename Caller>
+        class executor_continuation_handle
+        {
+        public:
+
+            executor_continuation_handle(
+                Caller* caller,
+                std::shared_ptr<chain_mutex> const& promise_mutex)
+                : caller_(caller)
+                , promise_mutex_(promise_mutex)
+            {}
+
+            executor_continuation_handle(executor_continuation_handle&& other) noexcept
+                : caller_(other.caller_)
+                , promise_mutex_(std::move(other.promise_mutex_))
+            {}
+
+            ~executor_continuation_handle()
+            {
+                if(promise_mutex_)
+                    break_promise();
+            }
+
+            executor_continuation_handle(executor_continuation_handle const&) = delete;
+            executor_continuation_handle& operator=(executor_continuation_handle const&) = delete;
+            executor_continuation_handle& operator=(executor_continuation_handle&&) = delete;
+
+            Caller* get() const
+            {
+                return caller_;
+            }
+
+            Caller* operator->() const
+            {
+                return caller_;
+            }
+
+            // The handle gives up the chain only once the result is set, so
+            // a throw from here can still be reported.
+            template<typename... Result>
+            void set_finished_with_result(Result&&... result)
+            {
+                {
+                    lock_site_scope site(lock_site::continuation);
+                    std::unique_lock<chain_mutex> lock(*promise_mutex_);
+                    caller_->set_finished_with_result(std::forward<Result>(result)..., lock);
+                }
+
+                promise_mutex_.reset();
+            }
+
+            void set_finished_with_exception(std::exception_ptr p)
+            {
+                {
+                    lock_site_scope site(lock_site::continuation);
+                    std::unique_lock<chain_mutex> lock(*promise_mutex_);
+                    if(!caller_->is_finished(lock))
+                        caller_->set_finished_with_exception(std::move(p), lock);
+                }
+
+                promise_mutex_.reset();
+            }
+
+        private:
+
+            void break_promise() noexcept
+            {
+                BOOST_TRY
+                {
+                    BOOST_THROW_EXCEPTION(
+                        future_error(future_errc::broken_promise)
+                    );
+                }
+                BOOST_CATCH(...)
+                {
+                    BOOST_TRY
+                    {
+                        set_finished_with_exception(std::current_exception());
+                    }
+                    // Don't let exceptions escape from the dtor.
+                    BOOST_CATCH(...)
+                    {}
+                    BOOST_CATCH_END
+                }
+                BOOST_CATCH_END
+            }
+
+            Caller* caller_;
+            std::shared_ptr<chain_mutex> promise_mutex_;
+        };
+
         template<typename Submiter, typename Param, typename Return>
         struct executor_continuation_helper;
 
@@ -645,17 +946,30 @@ namespace daily
             template<typename Caller, typename Allocator>
             static void call(
                 Caller* caller,
-                std::unique_lock<std::mutex>& lock,
-                std::shared_ptr<std::mutex>& promise_mutex,
+                std::unique_lock<chain_mutex>& lock,
+                std::shared_ptr<chain_mutex>& promise_mutex,
                 Allocator const& alloc)
             {
-                auto closure = [caller, p = caller->parent_->get(lock), promise_mutex]
+                auto closure = [p = caller->parent_->get(lock), caller = executor_continuation_handle<Caller>(caller, promise_mutex)]() mutable
                 {
-                    auto result = caller->continuation_(std::move(p));
-                    std::unique_lock<std::mutex> lock(*promise_mutex);
-                    caller->set_finished_with_result(std::move(result), lock);
+                    count_statistic(Submiter::continuation_statistic);
+                    trace_scope trace("continuation", Submiter::policy_name(), caller->trace_id());
+                    DAILY_FUTURE_PROBE2(continuation_run, caller.get(), Submiter::policy_name());
+                    BOOST_TRY
+                    {
+                        auto result = caller->continuation_(std::move(p));
+                        caller.set_finished_with_result(std::move(result));
+                    }
+                    BOOST_CATCH(...)
+                    {
+                        caller.set_finished_with_exception(std::current_exception());
+                    }
+                    BOOST_CATCH_END
                 };
                 
+                trace_instant("schedule", Submiter::policy_name(), caller->trace_id());
+                DAILY_FUTURE_PROBE2(executor_submit, caller, Submiter::policy_name());
+
                 // Don't call user code with the lock still obtained.
                 lock.unlock();
                 Submiter::submit(caller->executor_, std::move(closure), alloc);
@@ -669,17 +983,30 @@ namespace daily
             template<typename Caller, typename Allocator>
             static void call(
                 Caller* caller,
-                std::unique_lock<std::mutex>& lock,
-                std::shared_ptr<std::mutex>& promise_mutex,
+                std::unique_lock<chain_mutex>& lock,
+                std::shared_ptr<chain_mutex>& promise_mutex,
                 Allocator const& alloc)
             {
-                auto closure = [caller, promise_mutex]
+                auto closure = [caller = executor_continuation_handle<Caller>(caller, promise_mutex)]() mutable
                 {
-                    auto result = caller->continuation_();
-                    std::unique_lock<std::mutex> lock(*promise_mutex);
-                    caller->set_finished_with_result(std::move(result), lock);
+                    count_statistic(Submiter::continuation_statistic);
+                    trace_scope trace("continuation", Submiter::policy_name(), caller->trace_id());
+                    DAILY_FUTURE_PROBE2(continuation_run, caller.get(), Submiter::policy_name());
+                    BOOST_TRY
+                    {
+                        auto result = caller->continuation_();
+                        caller.set_finished_with_result(std::move(result));
+                    }
+                    BOOST_CATCH(...)
+                    {
+                        caller.set_finished_with_exception(std::current_exception());
+                    }
+                    BOOST_CATCH_END
                 };
                 
+                trace_instant("schedule", Submiter::policy_name(), caller->trace_id());
+                DAILY_FUTURE_PROBE2(executor_submit, caller, Submiter::policy_name());
+
                 // Don't call user code with the lock still obtained.
                 lock.unlock();
                 Submiter::submit(caller->executor_, std::move(closure), alloc);
@@ -693,17 +1020,30 @@ namespace daily
             template<typename Caller, typename Allocator>
             static void call(
                 Caller* caller,
-                std::unique_lock<std::mutex>& lock,
-                std::shared_ptr<std::mutex>& promise_mutex,
+                std::unique_lock<chain_mutex>& lock,
+                std::shared_ptr<chain_mutex>& promise_mutex,
                 Allocator const& alloc)
             {
-                auto closure = [caller, p = caller->parent_->get(lock), promise_mutex]
+                auto closure = [p = caller->parent_->get(lock), caller = executor_continuation_handle<Caller>(caller, promise_mutex)]() mutable
                 {
-                    caller->continuation_(std::move(p));
-                    std::unique_lock<std::mutex> lock(*promise_mutex);
-                    caller->set_finished_with_result(lock);
+                    count_statistic(Submiter::continuation_statistic);
+                    trace_scope trace("continuation", Submiter::policy_name(), caller->trace_id());
+                    DAILY_FUTURE_PROBE2(continuation_run, caller.get(), Submiter::policy_name());
+                    BOOST_TRY
+                    {
+                        caller->continuation_(std::move(p));
+                        caller.set_finished_with_result();
+                    }
+                    BOOST_CATCH(...)
+                    {
+                        caller.set_finished_with_exception(std::current_exception());
+                    }
+                    BOOST_CATCH_END
                 };
                 
+                trace_instant("schedule", Submiter::policy_name(), caller->trace_id());
+                DAILY_FUTURE_PROBE2(executor_submit, caller, Submiter::policy_name());
+
                 // Don't call user code with the lock still obtained.
                 lock.unlock();
                 Submiter::submit(caller->executor_, std::move(closure), alloc);
@@ -717,20 +1057,33 @@ namespace daily
             template<typename Caller, typename Allocator>
             static void call(
                 Caller* caller,
-                std::unique_lock<std::mutex>& lock,
-                std::shared_ptr<std::mutex>& promise_mutex,
+                std::unique_lock<chain_mutex>& lock,
+                std::shared_ptr<chain_mutex>& promise_mutex,
                 Allocator const& alloc)
             {
-                auto closure = [caller, promise_mutex]
+                auto closure = [caller = executor_continuation_handle<Caller>(caller, promise_mutex)]() mutable
                 {
-                    caller->continuation_();
-                    std::unique_lock<std::mutex> lock(*promise_mutex);
-                    caller->set_finished_with_result(lock);
+                    count_statistic(Submiter::continuation_statistic);
+                    trace_scope trace("continuation", Submiter::policy_name(), caller->trace_id());
+                    DAILY_FUTURE_PROBE2(continuation_run, caller.get(), Submiter::policy_name());
+                    BOOST_TRY
+                    {
+                        caller->continuation_();
+                        caller.set_finished_with_result();
+                    }
+                    BOOST_CATCH(...)
+                    {
+                        caller.set_finished_with_exception(std::current_exception());
+                    }
+                    BOOST_CATCH_END
                 };
                 
+                trace_instant("schedule", Submiter::policy_name(), caller->trace_id());
+                DAILY_FUTURE_PROBE2(executor_submit, caller, Submiter::policy_name());
+
                 // Don't call user code with the lock still obtained.
                 lock.unlock();
-                Submiter::submit(caller->executor_, closure, alloc);
+                Submiter::submit(caller->executor_, std::move(closure), alloc);
                 lock.lock();
             }
         };
@@ -752,7 +1105,7 @@ namespace daily
                 Executor ex,
                 future_shared_state<ParentResult>* parent,
                 Function&& f,
-                std::shared_ptr<std::mutex> mutex,
+                std::shared_ptr<chain_mutex> mutex,
                 Allocator alloc)
                 : parent_(std::move(parent))
                 , executor_(ex)
@@ -766,16 +1119,18 @@ namespace daily
             template<typename, typename, typename>
             friend struct executor_continuation_helper;
 
-            void handle_continuation_result_ready(std::unique_lock<std::mutex>& lock) override
+            void handle_continuation_result_ready(std::unique_lock<chain_mutex>& lock) override
             {
-                assert(lock.mutex() == promise_mutex_.get());
+                // Whoever is satisfying the parent holds the chain, so this
+                // can't fail. The closure's copy then keeps the whole chain
+                // alive until it has run, without this state owning its own
+                // promise, which would be a cycle.
+                std::shared_ptr<chain_mutex> promise_mutex = promise_mutex_.lock();
+                assert(lock.mutex() == promise_mutex.get());
 
-                // We don't need to store a shared ptr to this state here
-                // because the shared_ptr to the promise mutex will keep the
-                // whole chain alive.
                 executor_continuation_helper<
                     Submitter, ParentResult, Result
-                >::call(this, lock, promise_mutex_, allocator_);
+                >::call(this, lock, promise_mutex, allocator_);
             }
             
             // Don't store a shared_ptr here because as long as we're alive the parent
@@ -783,7 +1138,7 @@ namespace daily
             future_shared_state<ParentResult>* parent_;
             Executor executor_;
             Function continuation_;
-            std::shared_ptr<std::mutex> promise_mutex_;
+            std::weak_ptr<chain_mutex> promise_mutex_;
             Allocator allocator_;
         };
 
@@ -801,7 +1156,7 @@ namespace daily
             Executor ex,
             future_shared_state<ParentResult>* parent, 
             Function&& func,
-            std::shared_ptr<std::mutex> mutex,
+            std::shared_ptr<chain_mutex> mutex,
             Allocator const& alloc)
         {
             typedef executor_continuation_shared_state<
@@ -813,13 +1168,17 @@ namespace daily
                   , Allocator
                 > shared_state;
 
-            return std::allocate_shared<shared_state>(
+            auto state = std::allocate_shared<shared_state>(
                 alloc,
                 std::move(ex), 
                 parent, 
                 std::forward<Function>(func), 
                 std::move(mutex),
                 alloc);
+            state->track_shared_state(sizeof(*state));
+            state->inherit_trace(*parent);
+            state->register_pending(submit_dispatch::policy_name(), parent);
+            return state;
         }
 
         template<
@@ -834,7 +1193,7 @@ namespace daily
             Executor ex,
             future_shared_state<ParentResult>* parent, 
             Function&& func,
-            std::shared_ptr<std::mutex> mutex,
+            std::shared_ptr<chain_mutex> mutex,
             Allocator const& alloc)
         {
             typedef executor_continuation_shared_state<
@@ -846,13 +1205,17 @@ namespace daily
                   , Allocator
                 > shared_state;
                 
-            return std::allocate_shared<shared_state>(
+            auto state = std::allocate_shared<shared_state>(
                 alloc,
                 std::move(ex), 
                 parent, 
                 std::forward<Function>(func), 
                 std::move(mutex),
                 alloc);
+            state->track_shared_state(sizeof(*state));
+            state->inherit_trace(*parent);
+            state->register_pending(submit_post::policy_name(), parent);
+            return state;
         }
 
         template<
@@ -867,7 +1230,7 @@ namespace daily
             Executor ex,
             future_shared_state<ParentResult>* parent, 
             Function&& func,
-            std::shared_ptr<std::mutex> mutex,
+            std::shared_ptr<chain_mutex> mutex,
             Allocator const& alloc)
         {
             typedef executor_continuation_shared_state<
@@ -879,13 +1242,17 @@ namespace daily
                   , Allocator
                 > shared_state;
                 
-            return std::allocate_shared<shared_state>(
+            auto state = std::allocate_shared<shared_state>(
                 alloc,
                 std::move(ex), 
                 parent, 
                 std::forward<Function>(func), 
                 std::move(mutex),
                 alloc);
+            state->track_shared_state(sizeof(*state));
+            state->inherit_trace(*parent);
+            state->register_pending(submit_defer::policy_name(), parent);
+            return state;
         }
     }
 
@@ -900,13 +1267,18 @@ namespace daily
 
     public:
         promise()
-            : state_(std::make_shared<shared_state>())
+            : promise(std::allocator_arg, future_default_allocator())
         {}
 
         template<typename Allocator>
         promise(std::allocator_arg_t, Allocator const& alloc)
             : state_(std::allocate_shared<shared_state>(alloc))
-        {}
+        {
+            detail::count_statistic(statistic::promises_created);
+            state_->track_shared_state(sizeof(shared_state));
+            state_->start_trace();
+            state_->register_pending("promise");
+        }
 
         ~promise()
         {
@@ -940,12 +1312,13 @@ namespace daily
         // move support
         promise(promise&& other) noexcept
         {
-            std::swap(state_, other.state_);
+            swap(other);
         }
 
+        // Breaks the promise being replaced, as destroying it would.
         promise& operator=(promise&& other) noexcept
         {
-            state_ = std::move(other.state_);
+            promise(std::move(other)).swap(*this);
             return *this;
         }
 
@@ -956,6 +1329,7 @@ namespace daily
         void swap(promise& other) noexcept
         {
             std::swap(state_, other.state_);
+            std::swap(future_obtained_, other.future_obtained_);
         }
         
         future<Result> get_future()
@@ -981,6 +1355,8 @@ namespace daily
         {
             static_assert(sizeof...(value) < 2, "set_value must be called with exactly 0 or 1 argument");
 
+            detail::trace_scope trace("set_value", "promise", state_->trace_id());
+            detail::lock_site_scope site(lock_site::set_value);
             auto lk = state_->lock();
             if(state_->is_finished(lk))
             {
@@ -1002,8 +1378,48 @@ namespace daily
             assert(false && "cglover-todo");
         }
 
+        // Readies the promise for another round, reusing its state rather
+        // than allocating a new one, ie;
+        //
+        //   if(!p.recycle())
+        //       p = daily::promise<int>();
+        //   consumer.push(p.get_future());
+        //
+        // It only succeeds once the future, and any continuations attached
+        // to it, from the last round have been released. While anything
+        // still refers to the state it returns false and leaves the
+        // promise alone. An unsatisfied round is dropped without breaking
+        // the promise, since no future is left to see it.
+        bool recycle()
+        {
+            if(!state_ || state_.use_count() != 1)
+                return false;
+
+            // Pairs with the release of the last reference by another
+            // thread, so everything it did to the state is visible.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            state_->recycle();
+            state_->start_trace();
+            state_->register_pending("promise");
+            future_obtained_ = false;
+            return true;
+        }
+
+        // How many times the state has been recycled. Only for diagnostics;
+        // recycle() refuses while a future still shares the state, so no
+        // future can outlive its round and see a later one.
+        unsigned generation() const
+        {
+            if(!state_)
+                return 0;
+
+            return state_->generation();
+        }
+
         void set_exception(std::exception_ptr p)
         {
+            detail::trace_scope trace("set_exception", "promise", state_->trace_id());
+            detail::lock_site_scope site(lock_site::set_exception);
             auto lk = state_->lock();
             if(state_->is_finished(lk))
             {
@@ -1013,6 +1429,14 @@ namespace daily
             state_->set_finished_with_exception(std::move(p), lk);
         }
 
+        lock_profile chain_lock_profile() const
+        {
+            if(!state_)
+                return lock_profile();
+
+            return detail::chain_lock_profile(state_->mutex_);
+        }
+
         void set_exception_at_thread_exit(std::exception_ptr p)
         {
             auto lk = state_->lock();
@@ -1026,6 +1450,13 @@ namespace daily
 
     private:
 
+        template<typename>
+        friend class packaged_task;
+
+        // No state, for a default constructed packaged_task.
+        explicit promise(std::nullptr_t) noexcept
+        {}
+
         std::shared_ptr<shared_state> state_;
         bool future_obtained_ = false;
     };
@@ -1075,6 +1506,7 @@ namespace daily
         Result get()
         {
             assert(valid());
+            detail::lock_site_scope site(lock_site::get);
             auto lk = lock();
             state_->do_wait_result(lk);
             return state_->get(lk);
@@ -1082,43 +1514,61 @@ namespace daily
 
         bool valid() const noexcept
         {
-            if(state_)
-            {
-                auto lk = lock();
-                return state_->is_valid(lk);
-            }
-
-            return false;
+            return state_ && state_->is_valid();
         }
 
         void wait() const
         {
+            detail::lock_site_scope site(lock_site::wait);
             auto lk = lock();
             assert(state_->is_valid(lk));
             state_->do_wait(lk);
         }
 
+        // The observers don't lock the chain, so they're cheap to poll.
         bool is_ready() const
         {
-            auto lk = lock();
-            return state_->is_finished(lk);
+            return state_->is_finished();
         }
 
         bool has_exception() const
         {
-            auto lk = lock();
-            return state_->has_exception(lk);
+            return state_->has_exception();
         }
 
         bool has_value() const
         {
+            return state_->has_value();
+        }
+
+        // Returns the result if it's ready, taking it as get() does, or
+        // nothing without locking. An exception is rethrown. The void
+        // version returns whether it was ready.
+        typename detail::try_get_result<Result>::type try_get()
+        {
+            assert(valid());
+            if(!state_->is_finished())
+                return typename detail::try_get_result<Result>::type();
+
+            detail::lock_site_scope site(lock_site::get);
             auto lk = lock();
-            return state_->has_value(lk);
+            return detail::try_get_result<Result>::get(*state_, lk);
+        }
+
+        // Contention on this chain's mutex so far. Empty unless
+        // DAILY_FUTURE_ENABLE_LOCK_PROFILING is defined.
+        lock_profile chain_lock_profile() const
+        {
+            if(!mutex_)
+                return lock_profile();
+
+            return detail::chain_lock_profile(*mutex_);
         }
 
         template <typename Rep, typename Period>
         future_status wait_for(std::chrono::duration<Rep, Period> const& rel_time) const
         {
+            detail::lock_site_scope site(lock_site::wait);
             auto lk = lock();
             assert(state_->is_valid(lk));
             return state_->do_wait_for(rel_time, lk);
@@ -1127,12 +1577,19 @@ namespace daily
         template <typename Clock, typename Duration>
         future_status wait_until(std::chrono::time_point<Clock, Duration> const& abs_time) const
         {
+            detail::lock_site_scope site(lock_site::wait);
             auto lk = lock();
             assert(state_->is_valid(lk));
             return state_->do_wait_until(abs_time, lk);
         }
 
-        template<typename F, typename Allocator = future_default_allocator>
+        // Disabled for the policy tags so then(continue_on::get, f) isn't
+        // ambiguous with then(f, alloc).
+        template<
+            typename F, typename Allocator = future_default_allocator,
+            typename = typename std::enable_if<
+                !detail::is_continue_on<typename std::decay<F>::type>::value
+            >::type>
         auto then(F&& f, Allocator const& alloc = Allocator())
         {
             assert(valid());
@@ -1223,6 +1680,7 @@ namespace daily
                     ContinuationResult>(
                         s, current_state.get(), std::forward<F>(f), alloc);
 
+            detail::lock_site_scope site(lock_site::then);
             auto lk = lock();
             current_state->set_continuation(continuation_state, lk);
             return future<ContinuationResult>(continuation_state, mutex_);
@@ -1242,14 +1700,15 @@ namespace daily
                         s, ex.get_executor(), current_state.get(), 
                         std::forward<F>(f), mutex_, alloc);
 
+            detail::lock_site_scope site(lock_site::then);
             auto lk = lock();
             current_state->set_continuation(continuation_state, lk);
             return future<ContinuationResult>(continuation_state, mutex_);
         }
 
-        std::unique_lock<std::mutex> lock() const
+        std::unique_lock<detail::chain_mutex> lock() const
         {
-            return std::unique_lock<std::mutex>(*mutex_);
+            return std::unique_lock<detail::chain_mutex>(*mutex_);
         }
 
         template<typename>
@@ -1263,36 +1722,330 @@ namespace daily
 
         explicit future(
             std::shared_ptr<shared_state> ss, 
-            std::shared_ptr<std::mutex> promise_mutex)
+            std::shared_ptr<detail::chain_mutex> promise_mutex)
             : state_(std::move(ss))
             , mutex_(promise_mutex)
         {}
 
         std::shared_ptr<shared_state> state_;
-        std::shared_ptr<std::mutex> mutex_;
+        std::shared_ptr<detail::chain_mutex> mutex_;
     };
 
     // -------------------------------------------------------------------------
     //
-    template<typename> class packaged_task; // undefined 
+    namespace detail
+    {
+        // ---------------------------------------------------------------------
+        // Sets a promise from what a call returns, void included, or from
+        // what it throws. Only the call itself is guarded; setting the value
+        // runs continue_on::set continuations, which report their own
+        // exceptions, so those mustn't land back on the satisfied promise.
+        template<typename Result>
+        struct set_from_call
+        {
+            template<typename Call>
+            static void set(promise<Result>& p, Call&& call)
+            {
+                boost::optional<Result> result;
+                BOOST_TRY
+                {
+                    result.emplace(call());
+                }
+                BOOST_CATCH(...)
+                {
+                    p.set_exception(std::current_exception());
+                    return;
+                }
+                BOOST_CATCH_END
+
+                p.set_value(std::forward<Result>(*result));
+            }
+        };
+
+        template<>
+        struct set_from_call<void>
+        {
+            template<typename Call>
+            static void set(promise<void>& p, Call&& call)
+            {
+                BOOST_TRY
+                {
+                    call();
+                }
+                BOOST_CATCH(...)
+                {
+                    p.set_exception(std::current_exception());
+                    return;
+                }
+                BOOST_CATCH_END
+
+                p.set_value();
+            }
+        };
+
+        // ---------------------------------------------------------------------
+        // The move only, type erased callable in a packaged_task. It keeps
+        // the task's allocator alongside, to allocate the callable if it
+        // doesn't fit inline and to make a new promise on reset().
+        template<typename Signature>
+        class task_callable;
+
+        template<typename Result, typename... Args>
+        class task_callable<Result(Args...)>
+        {
+        public:
+
+            task_callable() noexcept
+                : ops_(nullptr)
+            {}
+
+            template<typename F, typename Allocator>
+            task_callable(F&& f, Allocator const& alloc)
+            {
+                typedef holder<typename std::decay<F>::type, Allocator> holder_type;
+                construct<holder_type>(std::forward<F>(f), alloc, is_inline<holder_type>());
+            }
+
+            ~task_callable()
+            {
+                if(ops_)
+                    ops_->destroy(&storage_);
+            }
+
+            task_callable(task_callable&& other) noexcept
+                : ops_(other.ops_)
+            {
+                if(ops_)
+                {
+                    ops_->move(&other.storage_, &storage_);
+                    other.ops_ = nullptr;
+                }
+            }
+
+            task_callable& operator=(task_callable&& other) noexcept
+            {
+                if(&other != this)
+                {
+                    this->~task_callable();
+                    new (this) task_callable(std::move(other));
+                }
+                return *this;
+            }
+
+            task_callable(task_callable const&) = delete;
+            task_callable& operator=(task_callable const&) = delete;
+
+            explicit operator bool() const noexcept
+            {
+                return ops_ != nullptr;
+            }
+
+            Result operator()(Args... args)
+            {
+                return ops_->invoke(&storage_, std::forward<Args>(args)...);
+            }
+
+            promise<Result> make_promise() const
+            {
+                return ops_->make_promise(&storage_);
+            }
+
+        private:
+
+            template<typename F, typename Allocator>
+            struct holder
+            {
+                template<typename Fn>
+                holder(Fn&& f, Allocator const& a)
+                    : function(std::forward<Fn>(f))
+                    , allocator(a)
+                {}
+
+                F function;
+                Allocator allocator;
+            };
+
+            typedef typename std::aligned_storage<
+                DAILY_FUTURE_PACKAGED_TASK_INLINE_SIZE, alignof(std::max_align_t)
+            >::type storage_type;
+
+            template<typename Holder>
+            using is_inline = std::integral_constant<bool,
+                sizeof(Holder) <= sizeof(storage_type) &&
+                alignof(std::max_align_t) % alignof(Holder) == 0 &&
+                std::is_nothrow_move_constructible<Holder>::value
+            >;
+
+            struct ops
+            {
+                Result (*invoke)(void* storage, Args&&... args);
+                void (*move)(void* from, void* to) noexcept;
+                void (*destroy)(void* storage) noexcept;
+                promise<Result> (*make_promise)(void const* storage);
+            };
+
+            // Inline, the holder lives in the storage.
+            template<typename Holder>
+            struct inline_ops
+            {
+                static Holder* get(void* storage)
+                {
+                    return static_cast<Holder*>(storage);
+                }
+
+                static Result invoke(void* storage, Args&&... args)
+                {
+                    return get(storage)->function(std::forward<Args>(args)...);
+                }
+
+                static void move(void* from, void* to) noexcept
+                {
+                    new (to) Holder(std::move(*get(from)));
+                    get(from)->~Holder();
+                }
+
+                static void destroy(void* storage) noexcept
+                {
+                    get(storage)->~Holder();
+                }
+
+                static promise<Result> make_promise(void const* storage)
+                {
+                    return promise<Result>(
+                        std::allocator_arg,
+                        static_cast<Holder const*>(storage)->allocator);
+                }
+
+                static constexpr ops table = { &invoke, &move, &destroy, &make_promise };
+            };
+
+            // Otherwise the storage holds a pointer to the holder, which
+            // was allocated with its own allocator.
+            template<typename Holder>
+            struct allocated_ops
+            {
+                typedef typename std::allocator_traits<
+                    decltype(std::declval<Holder&>().allocator)
+                >::template rebind_alloc<Holder> allocator_type;
+
+                static Holder*& get(void* storage)
+                {
+                    return *static_cast<Holder**>(storage);
+                }
+
+                static Result invoke(void* storage, Args&&... args)
+                {
+                    return get(storage)->function(std::forward<Args>(args)...);
+                }
+
+                static void move(void* from, void* to) noexcept
+                {
+                    new (to) Holder*(get(from));
+                }
+
+                static void destroy(void* storage) noexcept
+                {
+                    Holder* h = get(storage);
+                    allocator_type alloc(h->allocator);
+                    std::allocator_traits<allocator_type>::destroy(alloc, h);
+                    std::allocator_traits<allocator_type>::deallocate(alloc, h, 1);
+                }
+
+                static promise<Result> make_promise(void const* storage)
+                {
+                    return promise<Result>(
+                        std::allocator_arg,
+                        (*static_cast<Holder* const*>(storage))->allocator);
+                }
+
+                static constexpr ops table = { &invoke, &move, &destroy, &make_promise };
+            };
+
+            template<typename Holder, typename F, typename Allocator>
+            void construct(F&& f, Allocator const& alloc, std::true_type)
+            {
+                new (&storage_) Holder(std::forward<F>(f), alloc);
+                ops_ = &inline_ops<Holder>::table;
+            }
 
+            template<typename Holder, typename F, typename Allocator>
+            void construct(F&& f, Allocator const& alloc, std::false_type)
+            {
+                typedef typename allocated_ops<Holder>::allocator_type allocator_type;
+                allocator_type holder_alloc(alloc);
+                Holder* h = std::allocator_traits<allocator_type>::allocate(holder_alloc, 1);
+                BOOST_TRY
+                {
+                    std::allocator_traits<allocator_type>::construct(
+                        holder_alloc, h, std::forward<F>(f), alloc);
+                }
+                BOOST_CATCH(...)
+                {
+                    std::allocator_traits<allocator_type>::deallocate(holder_alloc, h, 1);
+                    BOOST_RETHROW
+                }
+                BOOST_CATCH_END
+                new (&storage_) Holder*(h);
+                ops_ = &allocated_ops<Holder>::table;
+            }
+
+            ops const* ops_;
+            mutable storage_type storage_;
+        };
+
+        template<typename Result, typename... Args>
+        template<typename Holder>
+        constexpr typename task_callable<Result(Args...)>::ops
+            task_callable<Result(Args...)>::inline_ops<Holder>::table;
+
+        template<typename Result, typename... Args>
+        template<typename Holder>
+        constexpr typename task_callable<Result(Args...)>::ops
+            task_callable<Result(Args...)>::allocated_ops<Holder>::table;
+    }
+
+    // -------------------------------------------------------------------------
+    // A move only packaged_task. Callables that fit in
+    // DAILY_FUTURE_PACKAGED_TASK_INLINE_SIZE are stored inline, larger ones
+    // are allocated with the task's allocator, as is the state.
+    //
+    // reset() reuses the state once the last future has been released, so
+    // a task run over and over, ie;
+    //
+    //   for(;;)
+    //   {
+    //       {
+    //           daily::future<int> f = task.get_future();
+    //           pool.submit(std::ref(task));
+    //           consume(f.get());
+    //       }
+    //       task.reset();
+    //   }
+    //
+    // doesn't allocate after the first round. A future still held at
+    // reset() keeps the old state, so a new one is allocated.
     template<class Result, typename... Args>
     class packaged_task<Result(Args...)>
     {
      public:
 
         packaged_task() noexcept
+            : promise_(nullptr)
         {}
 
-        template <class F>
+        template<
+            class F,
+            typename = typename std::enable_if<
+                !std::is_same<typename std::decay<F>::type, packaged_task>::value
+            >::type>
         explicit packaged_task(F&& f)
-            : func_(std::forward<F>(f))
+            : packaged_task(std::allocator_arg, future_default_allocator(), std::forward<F>(f))
         {}
 
         template <class F, class Allocator>
         packaged_task(std::allocator_arg_t, Allocator const& a, F&& f)
             : promise_(std::allocator_arg, a)
-            , func_(std::allocator_arg, a, std::forward<F>(f))
+            , func_(std::forward<F>(f), a)
         {}
      
         // no copy
@@ -1300,26 +2053,17 @@ namespace daily
         packaged_task& operator=(packaged_task const&) = delete;
      
         // move support
-        packaged_task(packaged_task&& other) noexcept
-            : promise_(std::move(other.promise_))
-            , func_(std::move(other.func_))
-        {}
-
-        packaged_task& operator=(packaged_task&& rhs) noexcept
-        {
-            promise_ = std::move(rhs.promise_);
-            func_ = std::move(rhs.func_);
-        }
+        packaged_task(packaged_task&& other) noexcept = default;
+        packaged_task& operator=(packaged_task&& rhs) noexcept = default;
      
         void swap(packaged_task& other) noexcept
         {
-            swap(promise_, other.promise_);
-            std::swap(func_, other.func_);
+            std::swap(*this, other);
         }
 
         bool valid() const noexcept
         {
-            return promise_.valid();
+            return static_cast<bool>(func_);
         }
      
         // result retrieval
@@ -1331,24 +2075,40 @@ namespace daily
         // execution
         void operator()(Args... args)
         {
-            promise_.set_value(func_(std::forward<Args>(args)...));
-        }
+            if(!valid())
+            {
+                BOOST_THROW_EXCEPTION(future_error(future_errc::no_state));
+            }
 
-        void make_ready_at_thread_exit(Args... args)
-        {
-            promise_.set_value_at_thread_exit(func_(std::forward<Args>(args)...));
+            // Checked first so that only what the callable throws is caught.
+            if(promise_.state_->is_finished())
+            {
+                BOOST_THROW_EXCEPTION(future_error(future_errc::promise_already_satisfied));
+            }
+
+            detail::set_from_call<Result>::set(promise_, [&]
+            {
+                return func_(std::forward<Args>(args)...);
+            });
         }
-     
+
+        // Readies the task to run again with a new future, keeping the
+        // callable. An unsatisfied future that's still held is broken.
         void reset()
         {
-            promise_.reset();
-            func_.clear();
+            if(!valid())
+            {
+                BOOST_THROW_EXCEPTION(future_error(future_errc::no_state));
+            }
+
+            if(!promise_.recycle())
+                promise_ = func_.make_promise();
         }
 
     private:
 
         promise<Result> promise_;
-        std::function<Result(Args...)> func_;
+        detail::task_callable<Result(Args...)> func_;
     };
 
     template<typename Result, typename... Args>
@@ -0,0 +1,379 @@
+// ****************************************************************************
+// daily/future/introspection.hpp
+//
+// Optional registry of live shared states for finding chains that never
+// complete. Define DAILY_FUTURE_ENABLE_INTROSPECTION (consistently, in every
+// translation unit) to turn it on. When off the hooks compile to nothing
+// and the queries return nothing.
+//
+// Every promise and continuation state claims a slot in a fixed table of
+// DAILY_FUTURE_INTROSPECTION_SLOTS when it's created and frees it when it's
+// destroyed, both without locks. A slot records the state's address, its
+// parent's, the continuation policy, when it was created, how many threads
+// are blocked waiting on it and whether it has been satisfied. States made
+// while a creation_site_scope is active are labelled with its name, ie;
+//
+//   daily::creation_site_scope site("fetch_user");
+//   auto f = fetch(id).then(daily::execute::post, pool, parse);
+//   ...
+//   daily::dump_pending_futures(std::cerr, 20);
+//
+// A state is pending until it's satisfied. A pending state whose parent
+// is also listed is waiting on that parent, so the oldest entry of a
+// stalled chain is usually the promise nobody set.
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#pragma once
+#ifndef DAILY_FUTURE_INTROSPECTION_HPP_
+#define DAILY_FUTURE_INTROSPECTION_HPP_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <vector>
+
+#if defined(DAILY_FUTURE_ENABLE_INTROSPECTION)
+#  include <algorithm>
+#  include <atomic>
+#  include <memory>
+#endif
+
+#if !defined(DAILY_FUTURE_INTROSPECTION_SLOTS)
+#  define DAILY_FUTURE_INTROSPECTION_SLOTS 16384
+#endif
+
+// -----------------------------------------------------------------------------
+//
+namespace daily
+{
+#if defined(DAILY_FUTURE_ENABLE_INTROSPECTION)
+    constexpr bool introspection_enabled = true;
+#else
+    constexpr bool introspection_enabled = false;
+#endif
+
+    // -------------------------------------------------------------------------
+    //
+    struct pending_future_info
+    {
+        std::uintptr_t state;
+        std::uintptr_t parent;
+        char const* site;
+        char const* policy;
+        std::chrono::nanoseconds age;
+        int blocked_waiters;
+    };
+
+    // -------------------------------------------------------------------------
+    //
+    namespace detail
+    {
+#if defined(DAILY_FUTURE_ENABLE_INTROSPECTION)
+
+        inline char const*& current_creation_site()
+        {
+            static thread_local char const* site = nullptr;
+            return site;
+        }
+
+        inline std::int64_t introspection_now_ns()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        // Every field is atomic so that a dump racing a state's destruction
+        // reads stale data rather than freed memory. state is 0 when the
+        // slot is free and 1 while it's being filled in.
+        struct pending_slot
+        {
+            std::atomic<std::uintptr_t> state{0};
+            std::atomic<std::uintptr_t> parent{0};
+            std::atomic<char const*> site{nullptr};
+            std::atomic<char const*> policy{nullptr};
+            std::atomic<std::int64_t> created_ns{0};
+            std::atomic<int> blocked_waiters{0};
+            std::atomic<bool> finished{false};
+        };
+
+        class pending_registry
+        {
+        public:
+
+            static constexpr std::uintptr_t free_slot = 0;
+            static constexpr std::uintptr_t filling_slot = 1;
+
+            static pending_registry& instance()
+            {
+                static pending_registry registry;
+                return registry;
+            }
+
+            // Returns null if the table is full. A slot is reserved before
+            // searching, so a full table costs one atomic rather than a
+            // scan, and a reservation always finds a slot.
+            pending_slot* acquire(
+                std::uintptr_t state,
+                std::uintptr_t parent,
+                char const* policy)
+            {
+                if(live_.fetch_add(1, std::memory_order_relaxed) >= num_slots)
+                {
+                    live_.fetch_sub(1, std::memory_order_relaxed);
+                    overflows_.fetch_add(1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+
+                std::size_t start = next_.fetch_add(1, std::memory_order_relaxed);
+                for(std::size_t i = 0;; ++i)
+                {
+                    pending_slot& slot = slots_[(start + i) % num_slots];
+                    std::uintptr_t expected = free_slot;
+                    if(slot.state.load(std::memory_order_relaxed) != free_slot
+                    || !slot.state.compare_exchange_strong(
+                        expected, filling_slot, std::memory_order_acquire))
+                    {
+                        continue;
+                    }
+
+                    slot.parent.store(parent, std::memory_order_relaxed);
+                    slot.site.store(current_creation_site(), std::memory_order_relaxed);
+                    slot.policy.store(policy, std::memory_order_relaxed);
+                    slot.created_ns.store(introspection_now_ns(), std::memory_order_relaxed);
+                    slot.blocked_waiters.store(0, std::memory_order_relaxed);
+                    slot.finished.store(false, std::memory_order_relaxed);
+                    slot.state.store(state, std::memory_order_release);
+                    return &slot;
+                }
+            }
+
+            void release(pending_slot& slot)
+            {
+                slot.state.store(free_slot, std::memory_order_release);
+                live_.fetch_sub(1, std::memory_order_release);
+            }
+
+            std::vector<pending_future_info> pending() const
+            {
+                std::vector<pending_future_info> result;
+                std::int64_t now = introspection_now_ns();
+                for(std::size_t i = 0; i < num_slots; ++i)
+                {
+                    pending_slot const& slot = slots_[i];
+                    std::uintptr_t state = slot.state.load(std::memory_order_acquire);
+                    if(state == free_slot || state == filling_slot)
+                        continue;
+
+                    pending_future_info info;
+                    info.state = state;
+                    info.parent = slot.parent.load(std::memory_order_relaxed);
+                    info.site = slot.site.load(std::memory_order_relaxed);
+                    info.policy = slot.policy.load(std::memory_order_relaxed);
+                    info.age = std::chrono::nanoseconds(
+                        now - slot.created_ns.load(std::memory_order_relaxed));
+                    info.blocked_waiters = slot.blocked_waiters.load(std::memory_order_relaxed);
+                    bool finished = slot.finished.load(std::memory_order_relaxed);
+
+                    // Drop anything reused while we were reading it.
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if(finished || slot.state.load(std::memory_order_relaxed) != state)
+                        continue;
+
+                    result.push_back(info);
+                }
+
+                return result;
+            }
+
+            std::size_t overflows() const
+            {
+                return overflows_.load(std::memory_order_relaxed);
+            }
+
+        private:
+
+            static constexpr std::size_t num_slots = DAILY_FUTURE_INTROSPECTION_SLOTS;
+
+            pending_registry()
+                : slots_(new pending_slot[num_slots])
+            {}
+
+            std::unique_ptr<pending_slot[]> slots_;
+            std::atomic<std::size_t> next_{0};
+            std::atomic<std::size_t> live_{0};
+            std::atomic<std::size_t> overflows_{0};
+        };
+
+        // Base of the shared states, owns the state's slot.
+        class shared_state_registration
+        {
+        public:
+
+            // A recycled state registers again, giving up its old slot.
+            void register_pending(
+                char const* policy,
+                shared_state_registration const* parent = nullptr)
+            {
+                if(slot_)
+                    pending_registry::instance().release(*slot_);
+
+                slot_ = pending_registry::instance().acquire(
+                    reinterpret_cast<std::uintptr_t>(this),
+                    reinterpret_cast<std::uintptr_t>(parent),
+                    policy);
+            }
+
+            void pending_finished()
+            {
+                if(slot_)
+                    slot_->finished.store(true, std::memory_order_relaxed);
+            }
+
+            void pending_wait_begin()
+            {
+                if(slot_)
+                    slot_->blocked_waiters.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            void pending_wait_end()
+            {
+                if(slot_)
+                    slot_->blocked_waiters.fetch_sub(1, std::memory_order_relaxed);
+            }
+
+        protected:
+
+            shared_state_registration() = default;
+            shared_state_registration(shared_state_registration const&) = delete;
+            shared_state_registration& operator=(shared_state_registration const&) = delete;
+
+            ~shared_state_registration()
+            {
+                if(slot_)
+                    pending_registry::instance().release(*slot_);
+            }
+
+        private:
+
+            pending_slot* slot_ = nullptr;
+        };
+
+#else
+
+        class shared_state_registration
+        {
+        public:
+
+            void register_pending(char const*, shared_state_registration const* = nullptr)
+            {}
+
+            void pending_finished()
+            {}
+
+            void pending_wait_begin()
+            {}
+
+            void pending_wait_end()
+            {}
+        };
+
+#endif
+    }
+
+    // -------------------------------------------------------------------------
+    // Labels the states this thread creates until it goes out of scope. The
+    // name must outlive the states, a string literal is best.
+    class creation_site_scope
+    {
+    public:
+
+#if defined(DAILY_FUTURE_ENABLE_INTROSPECTION)
+        explicit creation_site_scope(char const* site)
+            : previous_(detail::current_creation_site())
+        {
+            detail::current_creation_site() = site;
+        }
+
+        ~creation_site_scope()
+        {
+            detail::current_creation_site() = previous_;
+        }
+#else
+        explicit creation_site_scope(char const*)
+        {}
+#endif
+
+        creation_site_scope(creation_site_scope const&) = delete;
+        creation_site_scope& operator=(creation_site_scope const&) = delete;
+
+#if defined(DAILY_FUTURE_ENABLE_INTROSPECTION)
+    private:
+
+        char const* previous_;
+#endif
+    };
+
+    // -------------------------------------------------------------------------
+    // The oldest_n longest pending states, oldest first.
+    inline std::vector<pending_future_info> get_pending_futures(
+        std::size_t oldest_n = std::numeric_limits<std::size_t>::max())
+    {
+#if defined(DAILY_FUTURE_ENABLE_INTROSPECTION)
+        std::vector<pending_future_info> pending =
+            detail::pending_registry::instance().pending();
+        auto older = [](pending_future_info const& a, pending_future_info const& b)
+        {
+            return a.age > b.age;
+        };
+
+        if(oldest_n < pending.size())
+        {
+            std::partial_sort(pending.begin(), pending.begin() + oldest_n, pending.end(), older);
+            pending.resize(oldest_n);
+        }
+        else
+        {
+            std::sort(pending.begin(), pending.end(), older);
+        }
+
+        return pending;
+#else
+        (void)oldest_n;
+        return std::vector<pending_future_info>();
+#endif
+    }
+
+    // -------------------------------------------------------------------------
+    // Writes the oldest_n longest pending states, one per line.
+    inline void dump_pending_futures(std::ostream& out, std::size_t oldest_n = 20)
+    {
+        std::vector<pending_future_info> pending = get_pending_futures(oldest_n);
+        out << "pending futures (oldest " << pending.size() << "):\n";
+        for(auto&& p : pending)
+        {
+            out << "  state=0x" << std::hex << p.state
+                << " parent=0x" << p.parent << std::dec
+                << " age_us=" << std::chrono::duration_cast<std::chrono::microseconds>(p.age).count()
+                << " policy=" << (p.policy ? p.policy : "?")
+                << " site=" << (p.site ? p.site : "?")
+                << " blocked_waiters=" << p.blocked_waiters
+                << "\n";
+        }
+
+#if defined(DAILY_FUTURE_ENABLE_INTROSPECTION)
+        std::size_t overflows = detail::pending_registry::instance().overflows();
+        if(overflows)
+            out << "  (" << overflows << " states not tracked, registry full)\n";
+#endif
+    }
+}
+
+#endif // DAILY_FUTURE_INTROSPECTION_HPP_
@@ -0,0 +1,356 @@
+// ****************************************************************************
+// daily/future/lock_profile.hpp
+//
+// Optional contention profiling of the mutex shared by every future of a
+// chain. Define DAILY_FUTURE_ENABLE_LOCK_PROFILING (consistently, in every
+// translation unit) to turn it on. When off the chain keeps a plain
+// std::mutex and the hooks compile to nothing.
+//
+// When on, each chain's mutex records, per call site, how many times it
+// was acquired, how many of those had to wait, and the total time spent
+// waiting for and holding it. Call sites are get, wait, then, set_value,
+// set_exception and continuation for the relocks made while running a
+// continuation, ie;
+//
+//   auto p = f.chain_lock_profile();
+//   p[daily::lock_site::continuation].contended_acquisitions;
+//
+// The observers, valid(), is_ready() and so on, don't lock, so they have
+// no site of their own.
+//
+// daily::get_lock_profile() returns the sum over every chain destroyed so
+// far, which is usually what a benchmark wants to print at exit.
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#pragma once
+#ifndef DAILY_FUTURE_LOCKPROFILE_HPP_
+#define DAILY_FUTURE_LOCKPROFILE_HPP_
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#if defined(DAILY_FUTURE_ENABLE_LOCK_PROFILING)
+#  include <atomic>
+#  include <chrono>
+#endif
+
+// -----------------------------------------------------------------------------
+//
+namespace daily
+{
+    // -------------------------------------------------------------------------
+    // Where a chain's mutex was taken from.
+    enum class lock_site : std::size_t
+    {
+        other,
+        get,
+        wait,
+        then,
+        set_value,
+        set_exception,
+        continuation,
+        count
+    };
+
+    inline char const* lock_site_name(lock_site s)
+    {
+        static char const* const names[] =
+        {
+            "other",
+            "get",
+            "wait",
+            "then",
+            "set_value",
+            "set_exception",
+            "continuation",
+        };
+
+        static_assert(
+            sizeof(names) / sizeof(names[0]) == static_cast<std::size_t>(lock_site::count),
+            "Every lock_site needs a name."
+        );
+
+        return names[static_cast<std::size_t>(s)];
+    }
+
+#if defined(DAILY_FUTURE_ENABLE_LOCK_PROFILING)
+    constexpr bool lock_profiling_enabled = true;
+#else
+    constexpr bool lock_profiling_enabled = false;
+#endif
+
+    // -------------------------------------------------------------------------
+    //
+    struct lock_site_profile
+    {
+        std::int64_t acquisitions = 0;
+        std::int64_t contended_acquisitions = 0;
+        std::int64_t wait_ns = 0;
+        std::int64_t hold_ns = 0;
+
+        lock_site_profile& operator+=(lock_site_profile const& rhs)
+        {
+            acquisitions += rhs.acquisitions;
+            contended_acquisitions += rhs.contended_acquisitions;
+            wait_ns += rhs.wait_ns;
+            hold_ns += rhs.hold_ns;
+            return *this;
+        }
+    };
+
+    class lock_profile
+    {
+    public:
+
+        lock_site_profile const& operator[](lock_site s) const
+        {
+            return sites_[static_cast<std::size_t>(s)];
+        }
+
+        lock_site_profile& operator[](lock_site s)
+        {
+            return sites_[static_cast<std::size_t>(s)];
+        }
+
+        lock_site_profile total() const
+        {
+            lock_site_profile sum;
+            for(auto&& s : sites_)
+                sum += s;
+            return sum;
+        }
+
+        lock_profile& operator+=(lock_profile const& rhs)
+        {
+            for(std::size_t i = 0; i < sites_.size(); ++i)
+                sites_[i] += rhs.sites_[i];
+            return *this;
+        }
+
+    private:
+
+        std::array<lock_site_profile, static_cast<std::size_t>(lock_site::count)> sites_;
+    };
+
+    // -------------------------------------------------------------------------
+    //
+    namespace detail
+    {
+#if defined(DAILY_FUTURE_ENABLE_LOCK_PROFILING)
+
+        inline lock_site& current_lock_site()
+        {
+            static thread_local lock_site site = lock_site::other;
+            return site;
+        }
+
+        // Attributes acquisitions made by this thread to a call site until
+        // it goes out of scope.
+        class lock_site_scope
+        {
+        public:
+
+            explicit lock_site_scope(lock_site s)
+                : previous_(current_lock_site())
+            {
+                current_lock_site() = s;
+            }
+
+            ~lock_site_scope()
+            {
+                current_lock_site() = previous_;
+            }
+
+            lock_site_scope(lock_site_scope const&) = delete;
+            lock_site_scope& operator=(lock_site_scope const&) = delete;
+
+        private:
+
+            lock_site previous_;
+        };
+
+        // Chains folded in as their mutex is destroyed.
+        class lock_profile_registry
+        {
+        public:
+
+            static lock_profile_registry& instance()
+            {
+                static lock_profile_registry registry;
+                return registry;
+            }
+
+            void add(lock_profile const& p)
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                total_ += p;
+            }
+
+            lock_profile total()
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                return total_;
+            }
+
+        private:
+
+            std::mutex mutex_;
+            lock_profile total_;
+        };
+
+        // Counters are only written with the mutex held, so they're atomic
+        // only so that a profile can be read without taking it.
+        class profiled_mutex
+        {
+        public:
+
+            profiled_mutex() = default;
+
+            ~profiled_mutex()
+            {
+                lock_profile_registry::instance().add(profile());
+            }
+
+            profiled_mutex(profiled_mutex const&) = delete;
+            profiled_mutex& operator=(profiled_mutex const&) = delete;
+
+            void lock()
+            {
+                lock_site site = current_lock_site();
+                if(mutex_.try_lock())
+                {
+                    acquired(site);
+                    return;
+                }
+
+                auto start = std::chrono::steady_clock::now();
+                mutex_.lock();
+                acquired(site);
+                counters& c = sites_[static_cast<std::size_t>(site)];
+                add(c.contended_acquisitions, 1);
+                add(c.wait_ns, nanoseconds_since(start, acquired_at_));
+            }
+
+            bool try_lock()
+            {
+                if(!mutex_.try_lock())
+                    return false;
+
+                acquired(current_lock_site());
+                return true;
+            }
+
+            void unlock()
+            {
+                add(sites_[static_cast<std::size_t>(held_site_)].hold_ns,
+                    nanoseconds_since(acquired_at_, std::chrono::steady_clock::now()));
+                mutex_.unlock();
+            }
+
+            lock_profile profile() const
+            {
+                lock_profile p;
+                for(std::size_t i = 0; i < sites_.size(); ++i)
+                {
+                    lock_site_profile& s = p[static_cast<lock_site>(i)];
+                    s.acquisitions = sites_[i].acquisitions.load(std::memory_order_relaxed);
+                    s.contended_acquisitions =
+                        sites_[i].contended_acquisitions.load(std::memory_order_relaxed);
+                    s.wait_ns = sites_[i].wait_ns.load(std::memory_order_relaxed);
+                    s.hold_ns = sites_[i].hold_ns.load(std::memory_order_relaxed);
+                }
+
+                return p;
+            }
+
+        private:
+
+            struct counters
+            {
+                std::atomic<std::int64_t> acquisitions{0};
+                std::atomic<std::int64_t> contended_acquisitions{0};
+                std::atomic<std::int64_t> wait_ns{0};
+                std::atomic<std::int64_t> hold_ns{0};
+            };
+
+            static void add(std::atomic<std::int64_t>& counter, std::int64_t n)
+            {
+                counter.store(
+                    counter.load(std::memory_order_relaxed) + n,
+                    std::memory_order_relaxed);
+            }
+
+            static std::int64_t nanoseconds_since(
+                std::chrono::steady_clock::time_point from,
+                std::chrono::steady_clock::time_point to)
+            {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+            }
+
+            void acquired(lock_site site)
+            {
+                held_site_ = site;
+                acquired_at_ = std::chrono::steady_clock::now();
+                add(sites_[static_cast<std::size_t>(site)].acquisitions, 1);
+            }
+
+            std::mutex mutex_;
+            lock_site held_site_ = lock_site::other;
+            std::chrono::steady_clock::time_point acquired_at_;
+            std::array<counters, static_cast<std::size_t>(lock_site::count)> sites_;
+        };
+
+        typedef profiled_mutex chain_mutex;
+        typedef std::condition_variable_any chain_condition_variable;
+
+        inline lock_profile chain_lock_profile(chain_mutex const& m)
+        {
+            return m.profile();
+        }
+
+#else
+
+        class lock_site_scope
+        {
+        public:
+
+            explicit lock_site_scope(lock_site)
+            {}
+
+            lock_site_scope(lock_site_scope const&) = delete;
+            lock_site_scope& operator=(lock_site_scope const&) = delete;
+        };
+
+        typedef std::mutex chain_mutex;
+        typedef std::condition_variable chain_condition_variable;
+
+        inline lock_profile chain_lock_profile(chain_mutex const&)
+        {
+            return lock_profile();
+        }
+
+#endif
+    }
+
+    // -------------------------------------------------------------------------
+    // Sum of every chain destroyed so far.
+    inline lock_profile get_lock_profile()
+    {
+#if defined(DAILY_FUTURE_ENABLE_LOCK_PROFILING)
+        return detail::lock_profile_registry::instance().total();
+#else
+        return lock_profile();
+#endif
+    }
+}
+
+#endif // DAILY_FUTURE_LOCKPROFILE_HPP_
@@ -0,0 +1,134 @@
+// ****************************************************************************
+// daily/future/memory_resource.hpp
+//
+// std::pmr support. resource_allocator is a polymorphic_allocator whose
+// default constructor picks up the calling thread's future memory resource
+// rather than the process wide default, so a handler can install an arena
+// for the duration of a request, ie;
+//
+//   std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer));
+//   daily::future_memory_resource_scope scope(&arena);
+//   daily::resource_allocator<void> alloc;
+//   daily::promise<int> p(std::allocator_arg, alloc);
+//
+// Defining DAILY_FUTURE_USE_MEMORY_RESOURCE (consistently, in every
+// translation unit) makes resource_allocator the future_default_allocator,
+// so promise(), then() and use_future without an explicit allocator all
+// allocate from the thread's resource and the allocator no longer needs to
+// be threaded through interfaces.
+//
+// A state is freed through the resource it was allocated from, whichever
+// thread releases it, so every future created under a scope must be gone
+// before the resource is destroyed.
+//
+// Requires C++17 <memory_resource>.
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#pragma once
+#ifndef DAILY_FUTURE_MEMORYRESOURCE_HPP_
+#define DAILY_FUTURE_MEMORYRESOURCE_HPP_
+
+#if defined(__has_include)
+#  if __has_include(<memory_resource>) && __cplusplus >= 201703L
+#    define DAILY_FUTURE_HAS_MEMORY_RESOURCE 1
+#  endif
+#endif
+
+#if !defined(DAILY_FUTURE_HAS_MEMORY_RESOURCE)
+#  define DAILY_FUTURE_HAS_MEMORY_RESOURCE 0
+#endif
+
+#if DAILY_FUTURE_HAS_MEMORY_RESOURCE
+
+#include <memory_resource>
+
+// -----------------------------------------------------------------------------
+//
+namespace daily
+{
+    namespace detail
+    {
+        inline std::pmr::memory_resource*& this_thread_future_resource() noexcept
+        {
+            static thread_local std::pmr::memory_resource* resource = nullptr;
+            return resource;
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    // The calling thread's resource, std::pmr::get_default_resource() if
+    // none has been set.
+    inline std::pmr::memory_resource* get_future_memory_resource() noexcept
+    {
+        std::pmr::memory_resource* r = detail::this_thread_future_resource();
+        return r ? r : std::pmr::get_default_resource();
+    }
+
+    // Sets the calling thread's resource, null to go back to the process
+    // default. Returns the previous setting.
+    inline std::pmr::memory_resource* set_future_memory_resource(
+        std::pmr::memory_resource* r) noexcept
+    {
+        std::pmr::memory_resource* previous = detail::this_thread_future_resource();
+        detail::this_thread_future_resource() = r;
+        return previous;
+    }
+
+    // -------------------------------------------------------------------------
+    // Installs a resource on this thread until it goes out of scope.
+    class future_memory_resource_scope
+    {
+    public:
+
+        explicit future_memory_resource_scope(std::pmr::memory_resource* r) noexcept
+            : previous_(set_future_memory_resource(r))
+        {}
+
+        ~future_memory_resource_scope()
+        {
+            set_future_memory_resource(previous_);
+        }
+
+        future_memory_resource_scope(future_memory_resource_scope const&) = delete;
+        future_memory_resource_scope& operator=(future_memory_resource_scope const&) = delete;
+
+    private:
+
+        std::pmr::memory_resource* previous_;
+    };
+
+    // -------------------------------------------------------------------------
+    //
+    template<typename T>
+    class resource_allocator : public std::pmr::polymorphic_allocator<T>
+    {
+    public:
+
+        resource_allocator() noexcept
+            : std::pmr::polymorphic_allocator<T>(get_future_memory_resource())
+        {}
+
+        resource_allocator(std::pmr::memory_resource* r) noexcept
+            : std::pmr::polymorphic_allocator<T>(r)
+        {}
+
+        resource_allocator(resource_allocator const&) = default;
+
+        template<typename U>
+        resource_allocator(resource_allocator<U> const& other) noexcept
+            : std::pmr::polymorphic_allocator<T>(other.resource())
+        {}
+    };
+}
+
+#elif defined(DAILY_FUTURE_USE_MEMORY_RESOURCE)
+#  error "DAILY_FUTURE_USE_MEMORY_RESOURCE requires C++17 <memory_resource>."
+#endif
+
+#endif // DAILY_FUTURE_MEMORYRESOURCE_HPP_
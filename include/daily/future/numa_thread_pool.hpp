@@ -0,0 +1,683 @@
+// ****************************************************************************
+// daily/future/numa_thread_pool.hpp
+//
+// A thread pool that groups its workers by NUMA node and an allocator that
+// places shared states in memory local to a node. Allocating a chain's
+// states on the node of the executor that consumes them keeps the state's
+// cache lines on one socket, ie;
+//
+//   auto ex = pool.get_executor(node);
+//   daily::promise<int> p(std::allocator_arg, ex.get_allocator());
+//   p.get_future().then(daily::execute::post, ex, f, ex.get_allocator());
+//
+// Topology is read from /sys so there is no dependency on libnuma. On other
+// platforms, or if the topology can't be read, everything is one node.
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#pragma once
+#ifndef DAILY_FUTURE_NUMATHREADPOOL_HPP_
+#define DAILY_FUTURE_NUMATHREADPOOL_HPP_
+
+#include <boost/throw_exception.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "daily/future/default_allocator.hpp"
+#include "daily/future/executor_op.hpp"
+
+#if defined(__linux__)
+#  include <pthread.h>
+#  include <sched.h>
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
+// -----------------------------------------------------------------------------
+//
+namespace daily
+{
+    // -------------------------------------------------------------------------
+    //
+    class numa_topology
+    {
+    public:
+
+        // One entry per node listing the cpus on it, and the node distance
+        // matrix (10 is local, as reported by the kernel).
+        numa_topology(
+            std::vector<std::vector<unsigned>> node_cpus,
+            std::vector<std::vector<unsigned>> distances = {})
+            : node_cpus_(std::move(node_cpus))
+            , distances_(std::move(distances))
+        {
+            assert(!node_cpus_.empty());
+            if(distances_.size() != node_cpus_.size())
+            {
+                distances_.assign(node_cpus_.size(), std::vector<unsigned>(node_cpus_.size(), 20));
+                for(std::size_t i = 0; i < node_cpus_.size(); ++i)
+                    distances_[i][i] = 10;
+            }
+        }
+
+        static numa_topology const& system()
+        {
+            static numa_topology const topology = read_system();
+            return topology;
+        }
+
+        std::size_t num_nodes() const noexcept
+        {
+            return node_cpus_.size();
+        }
+
+        std::vector<unsigned> const& cpus(std::size_t node) const
+        {
+            return node_cpus_[node];
+        }
+
+        unsigned distance(std::size_t from, std::size_t to) const
+        {
+            return distances_[from][to];
+        }
+
+        // Other nodes ordered nearest first.
+        std::vector<std::size_t> steal_order(std::size_t node) const
+        {
+            std::vector<std::size_t> order;
+            for(std::size_t i = 0; i < num_nodes(); ++i)
+            {
+                if(i != node)
+                    order.push_back(i);
+            }
+
+            std::stable_sort(order.begin(), order.end(),
+                [this, node](std::size_t a, std::size_t b)
+                {
+                    return distance(node, a) < distance(node, b);
+                }
+            );
+
+            return order;
+        }
+
+    private:
+
+        // Parses the kernel's cpulist format, ie; "0-3,8-11".
+        static std::vector<unsigned> parse_cpu_list(std::string const& list)
+        {
+            std::vector<unsigned> cpus;
+            std::stringstream ss(list);
+            std::string range;
+            while(std::getline(ss, range, ','))
+            {
+                if(range.empty() || range == "\n")
+                    continue;
+
+                std::size_t dash = range.find('-');
+                unsigned first = std::stoul(range.substr(0, dash));
+                unsigned last = dash == std::string::npos
+                    ? first
+                    : std::stoul(range.substr(dash + 1));
+                for(unsigned cpu = first; cpu <= last; ++cpu)
+                    cpus.push_back(cpu);
+            }
+
+            return cpus;
+        }
+
+        static numa_topology single_node()
+        {
+            std::vector<unsigned> cpus;
+            unsigned count = std::max(1u, std::thread::hardware_concurrency());
+            for(unsigned i = 0; i < count; ++i)
+                cpus.push_back(i);
+            return numa_topology(std::vector<std::vector<unsigned>>(1, std::move(cpus)));
+        }
+
+        static numa_topology read_system()
+        {
+#if defined(__linux__)
+            std::vector<std::vector<unsigned>> node_cpus;
+            std::vector<std::vector<unsigned>> distances;
+            for(std::size_t node = 0; ; ++node)
+            {
+                std::string base = "/sys/devices/system/node/node" + std::to_string(node);
+                std::ifstream cpulist(base + "/cpulist");
+                if(!cpulist)
+                    break;
+
+                std::string list;
+                std::getline(cpulist, list);
+                node_cpus.push_back(parse_cpu_list(list));
+
+                std::ifstream distance(base + "/distance");
+                std::vector<unsigned> row;
+                unsigned d;
+                while(distance >> d)
+                    row.push_back(d);
+                distances.push_back(std::move(row));
+            }
+
+            // Nodes without cpus can't run workers.
+            for(std::size_t i = 0; i < node_cpus.size(); ++i)
+            {
+                if(node_cpus[i].empty() || distances[i].size() != node_cpus.size())
+                    return single_node();
+            }
+
+            if(!node_cpus.empty())
+                return numa_topology(std::move(node_cpus), std::move(distances));
+#endif
+            return single_node();
+        }
+
+        std::vector<std::vector<unsigned>> node_cpus_;
+        std::vector<std::vector<unsigned>> distances_;
+    };
+
+    // -------------------------------------------------------------------------
+    //
+    namespace detail
+    {
+        // ---------------------------------------------------------------------
+        // Size classed free lists carved from chunks bound to one node.
+        // Shared states are small, so anything over max_small goes straight
+        // to the global heap.
+        class numa_arena
+        {
+        public:
+
+            static constexpr std::size_t granularity = 16;
+            static constexpr std::size_t max_small = 1024;
+            static constexpr std::size_t chunk_size = 256 * 1024;
+
+            explicit numa_arena(std::size_t node)
+                : node_(node)
+                , free_(max_small / granularity + 1, nullptr)
+            {}
+
+            ~numa_arena()
+            {
+                for(void* chunk : chunks_)
+                    free_chunk(chunk);
+            }
+
+            numa_arena(numa_arena const&) = delete;
+            numa_arena& operator=(numa_arena const&) = delete;
+
+            std::size_t node() const noexcept
+            {
+                return node_;
+            }
+
+            void* allocate(std::size_t bytes)
+            {
+                if(bytes > max_small)
+                    return ::operator new(bytes);
+
+                std::size_t size_class = (bytes + granularity - 1) / granularity;
+                std::unique_lock<std::mutex> lk(mutex_);
+                if(free_block* block = free_[size_class])
+                {
+                    free_[size_class] = block->next_;
+                    return block;
+                }
+
+                std::size_t size = size_class * granularity;
+                if(remaining_ < size)
+                {
+                    void* chunk = allocate_chunk();
+                    chunks_.push_back(chunk);
+                    head_ = static_cast<char*>(chunk);
+                    remaining_ = chunk_size;
+                }
+
+                void* p = head_;
+                head_ += size;
+                remaining_ -= size;
+                return p;
+            }
+
+            void deallocate(void* p, std::size_t bytes)
+            {
+                if(bytes > max_small)
+                {
+                    ::operator delete(p);
+                    return;
+                }
+
+                std::size_t size_class = (bytes + granularity - 1) / granularity;
+                free_block* block = static_cast<free_block*>(p);
+                std::unique_lock<std::mutex> lk(mutex_);
+                block->next_ = free_[size_class];
+                free_[size_class] = block;
+            }
+
+        private:
+
+            struct free_block
+            {
+                free_block* next_;
+            };
+
+            // Bound with MPOL_PREFERRED so the allocation still succeeds if
+            // the node is out of memory, or this isn't a NUMA system.
+            void* allocate_chunk()
+            {
+#if defined(__linux__)
+                void* chunk = ::mmap(
+                    nullptr, chunk_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if(chunk == MAP_FAILED)
+                    BOOST_THROW_EXCEPTION(std::bad_alloc());
+
+#  if defined(SYS_mbind)
+                unsigned long const mpol_preferred = 1;
+                unsigned long const bits = sizeof(unsigned long) * 8;
+                std::vector<unsigned long> mask(node_ / bits + 1, 0);
+                mask[node_ / bits] = 1ul << (node_ % bits);
+                ::syscall(
+                    SYS_mbind, chunk, chunk_size, mpol_preferred,
+                    mask.data(), mask.size() * bits + 1, 0);
+#  endif
+                return chunk;
+#else
+                return ::operator new(chunk_size);
+#endif
+            }
+
+            static void free_chunk(void* chunk)
+            {
+#if defined(__linux__)
+                ::munmap(chunk, chunk_size);
+#else
+                ::operator delete(chunk);
+#endif
+            }
+
+            std::size_t node_;
+            std::mutex mutex_;
+            std::vector<free_block*> free_;
+            std::vector<void*> chunks_;
+            char* head_ = nullptr;
+            std::size_t remaining_ = 0;
+        };
+
+        class numa_op : public executor_op
+        {
+        public:
+
+            numa_op(complete_fn f)
+                : executor_op(f)
+            {}
+        };
+    }
+
+    // -------------------------------------------------------------------------
+    // Allocates from memory bound to one node. Copies share the arena, which
+    // lives as long as any allocator referring to it.
+    template<typename T>
+    class numa_allocator
+    {
+    public:
+
+        typedef T value_type;
+
+        explicit numa_allocator(std::shared_ptr<detail::numa_arena> arena) noexcept
+            : arena_(std::move(arena))
+        {}
+
+        template<typename U>
+        numa_allocator(numa_allocator<U> const& other) noexcept
+            : arena_(other.arena_)
+        {}
+
+        T* allocate(std::size_t n)
+        {
+            return static_cast<T*>(arena_->allocate(n * sizeof(T)));
+        }
+
+        void deallocate(T* p, std::size_t n) noexcept
+        {
+            arena_->deallocate(p, n * sizeof(T));
+        }
+
+        std::size_t node() const noexcept
+        {
+            return arena_->node();
+        }
+
+        template<typename U>
+        bool operator==(numa_allocator<U> const& other) const noexcept
+        {
+            return arena_ == other.arena_;
+        }
+
+        template<typename U>
+        bool operator!=(numa_allocator<U> const& other) const noexcept
+        {
+            return arena_ != other.arena_;
+        }
+
+    private:
+
+        template<typename>
+        friend class numa_allocator;
+
+        std::shared_ptr<detail::numa_arena> arena_;
+    };
+
+    // -------------------------------------------------------------------------
+    //
+    class numa_thread_pool
+    {
+    public:
+
+        class executor_type
+        {
+        public:
+
+            // Allows an executor to be passed directly to future::then.
+            executor_type get_executor() const noexcept
+            {
+                return *this;
+            }
+
+            std::size_t node() const noexcept
+            {
+                return node_;
+            }
+
+            // Allocator for states consumed by this executor.
+            template<typename T = char>
+            numa_allocator<T> get_allocator() const noexcept
+            {
+                return numa_allocator<T>(pool_->nodes_[node_]->arena_);
+            }
+
+            numa_thread_pool& context() const noexcept
+            {
+                return *pool_;
+            }
+
+            void on_work_started() const noexcept
+            {}
+
+            void on_work_finished() const noexcept
+            {}
+
+            template<typename Function, typename Allocator = future_default_allocator>
+            void dispatch(Function&& f, Allocator const& alloc = Allocator()) const
+            {
+                if(pool_->current_node() == node_)
+                {
+                    typename std::decay<Function>::type func(std::forward<Function>(f));
+                    func();
+                    return;
+                }
+
+                pool_->push(node_, std::forward<Function>(f), alloc);
+            }
+
+            template<typename Function, typename Allocator = future_default_allocator>
+            void post(Function&& f, Allocator const& alloc = Allocator()) const
+            {
+                pool_->push(node_, std::forward<Function>(f), alloc);
+            }
+
+            template<typename Function, typename Allocator = future_default_allocator>
+            void defer(Function&& f, Allocator const& alloc = Allocator()) const
+            {
+                pool_->push(node_, std::forward<Function>(f), alloc);
+            }
+
+            friend bool operator==(executor_type const& lhs, executor_type const& rhs) noexcept
+            {
+                return lhs.pool_ == rhs.pool_ && lhs.node_ == rhs.node_;
+            }
+
+            friend bool operator!=(executor_type const& lhs, executor_type const& rhs) noexcept
+            {
+                return !(lhs == rhs);
+            }
+
+        private:
+
+            friend class numa_thread_pool;
+
+            executor_type(numa_thread_pool* pool, std::size_t node)
+                : pool_(pool)
+                , node_(node)
+            {
+                assert(node < pool->nodes_.size());
+            }
+
+            numa_thread_pool* pool_;
+            std::size_t node_;
+        };
+
+        // Zero threads_per_node starts one worker per cpu on each node.
+        explicit numa_thread_pool(
+            numa_topology const& topology = numa_topology::system(),
+            std::size_t threads_per_node = 0)
+        {
+            for(std::size_t n = 0; n < topology.num_nodes(); ++n)
+            {
+                nodes_.emplace_back(new node_state(n));
+                nodes_.back()->steal_order_ = topology.steal_order(n);
+            }
+
+            for(std::size_t n = 0; n < topology.num_nodes(); ++n)
+            {
+                std::size_t count = threads_per_node
+                    ? threads_per_node
+                    : topology.cpus(n).size();
+                std::vector<unsigned> cpus = topology.cpus(n);
+                while(count--)
+                {
+                    threads_.emplace_back([this, n, cpus]
+                    {
+                        bind_to_cpus(cpus);
+                        run(n);
+                    });
+                }
+            }
+        }
+
+        ~numa_thread_pool()
+        {
+            join();
+            for(auto&& n : nodes_)
+            {
+                while(!n->queue_.empty())
+                    n->queue_.pop()->destroy();
+            }
+        }
+
+        numa_thread_pool(numa_thread_pool const&) = delete;
+        numa_thread_pool& operator=(numa_thread_pool const&) = delete;
+
+        // The calling worker's node, otherwise nodes in turn.
+        executor_type get_executor() noexcept
+        {
+            std::size_t node = current_node();
+            if(node == no_node)
+                node = next_node_.fetch_add(1, std::memory_order_relaxed) % nodes_.size();
+            return executor_type(this, node);
+        }
+
+        executor_type get_executor(std::size_t node) noexcept
+        {
+            return executor_type(this, node);
+        }
+
+        std::size_t num_nodes() const noexcept
+        {
+            return nodes_.size();
+        }
+
+        // Runs the work queued on every node then stops the threads. Only
+        // for threads outside the pool: a worker bound to one of its nodes
+        // can't wait for its own exit.
+        void join()
+        {
+            assert(current_pool() != this && "join() called from a worker thread");
+            {
+                std::unique_lock<std::mutex> lk(sleep_mutex_);
+                stop_ = true;
+            }
+            ready_.notify_all();
+            for(auto&& t : threads_)
+            {
+                if(t.joinable())
+                    t.join();
+            }
+        }
+
+    private:
+
+        struct node_state
+        {
+            explicit node_state(std::size_t node)
+                : arena_(std::make_shared<detail::numa_arena>(node))
+            {}
+
+            std::mutex mutex_;
+            detail::executor_op_queue<detail::numa_op> queue_;
+            std::shared_ptr<detail::numa_arena> arena_;
+            std::vector<std::size_t> steal_order_;
+        };
+
+        static void bind_to_cpus(std::vector<unsigned> const& cpus)
+        {
+#if defined(__linux__) && defined(CPU_SET)
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for(unsigned cpu : cpus)
+            {
+                if(cpu < CPU_SETSIZE)
+                    CPU_SET(cpu, &set);
+            }
+
+            // Best effort, we may be in a restricted cpuset.
+            ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+#else
+            (void)cpus;
+#endif
+        }
+
+        template<typename Function, typename Allocator>
+        void push(std::size_t node, Function&& f, Allocator const& alloc)
+        {
+            detail::numa_op* op = detail::make_executor_op<detail::numa_op>(
+                std::forward<Function>(f), alloc);
+
+            node_state& n = *nodes_[node];
+            {
+                std::unique_lock<std::mutex> lk(n.mutex_);
+                n.queue_.push(op);
+                pending_.fetch_add(1, std::memory_order_release);
+            }
+
+            {
+                std::unique_lock<std::mutex> lk(sleep_mutex_);
+            }
+            ready_.notify_one();
+        }
+
+        detail::numa_op* pop_from(node_state& n)
+        {
+            std::unique_lock<std::mutex> lk(n.mutex_);
+            if(n.queue_.empty())
+                return nullptr;
+
+            pending_.fetch_sub(1, std::memory_order_relaxed);
+            return n.queue_.pop();
+        }
+
+        // Local work first, then the nearest nodes.
+        detail::numa_op* take(std::size_t node)
+        {
+            node_state& local = *nodes_[node];
+            if(detail::numa_op* op = pop_from(local))
+                return op;
+
+            for(std::size_t victim : local.steal_order_)
+            {
+                if(detail::numa_op* op = pop_from(*nodes_[victim]))
+                    return op;
+            }
+
+            return nullptr;
+        }
+
+        void run(std::size_t node)
+        {
+            current_node_ref() = node;
+            current_pool() = this;
+            while(true)
+            {
+                detail::numa_op* op = take(node);
+                if(!op)
+                {
+                    std::unique_lock<std::mutex> lk(sleep_mutex_);
+                    while(pending_.load(std::memory_order_acquire) == 0 && !stop_)
+                        ready_.wait(lk);
+
+                    if(pending_.load(std::memory_order_acquire) == 0)
+                        return;
+
+                    continue;
+                }
+
+                op->complete();
+            }
+        }
+
+        static constexpr std::size_t no_node = ~std::size_t(0);
+
+        std::size_t current_node() const
+        {
+            return current_pool() == this ? current_node_ref() : no_node;
+        }
+
+        static std::size_t& current_node_ref()
+        {
+            static thread_local std::size_t node_ = no_node;
+            return node_;
+        }
+
+        static numa_thread_pool const*& current_pool()
+        {
+            static thread_local numa_thread_pool const* current_ = nullptr;
+            return current_;
+        }
+
+        std::vector<std::unique_ptr<node_state>> nodes_;
+        std::vector<std::thread> threads_;
+        std::atomic<std::size_t> pending_{0};
+        std::atomic<std::size_t> next_node_{0};
+        std::mutex sleep_mutex_;
+        std::condition_variable ready_;
+        bool stop_ = false;
+    };
+}
+
+#endif // DAILY_FUTURE_NUMATHREADPOOL_HPP_
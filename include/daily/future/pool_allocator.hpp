@@ -0,0 +1,437 @@
+// ****************************************************************************
+// daily/future/pool_allocator.hpp
+//
+// A thread caching, size classed pool allocator sized for shared states,
+// for use anywhere the library takes an allocator, ie;
+//
+//   daily::pool_allocator<void> alloc;
+//   daily::promise<int> p(std::allocator_arg, alloc);
+//   auto f = p.get_future().then(daily::continue_on::any, g, alloc);
+//
+// Requests up to pool_max_block_size bytes are rounded up to a multiple of
+// pool_size_class_granularity and served from a per thread free list for
+// that size class. Frees go onto the freeing thread's list, so when a
+// chain is built on one thread and released on another the blocks pile up
+// on the releasing thread. Once a list holds two batches one batch of
+// DAILY_FUTURE_POOL_BATCH_SIZE blocks is returned to a global pool, which
+// threads with an empty list refill from a batch at a time. The global
+// lock is taken once per batch rather than once per block.
+//
+// Memory is carved from slabs that are never returned to the system, so
+// the pool only grows to the high water mark of live states. Larger or
+// over aligned requests go straight to operator new.
+//
+// All pool_allocators compare equal and share one pool.
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#pragma once
+#ifndef DAILY_FUTURE_POOLALLOCATOR_HPP_
+#define DAILY_FUTURE_POOLALLOCATOR_HPP_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#if !defined(DAILY_FUTURE_POOL_BATCH_SIZE)
+#  define DAILY_FUTURE_POOL_BATCH_SIZE 32
+#endif
+
+// -----------------------------------------------------------------------------
+//
+namespace daily
+{
+    constexpr std::size_t pool_size_class_granularity = 32;
+    constexpr std::size_t pool_max_block_size = 512;
+
+    // -------------------------------------------------------------------------
+    //
+    struct pool_allocator_statistics
+    {
+        // Pooled requests, and those that were served from the thread's
+        // own free list.
+        std::uint64_t allocations = 0;
+        std::uint64_t deallocations = 0;
+        std::uint64_t thread_cache_hits = 0;
+
+        // Batches moved between threads and the global pool.
+        std::uint64_t global_refills = 0;
+        std::uint64_t global_returns = 0;
+
+        std::uint64_t slabs = 0;
+        std::uint64_t bytes_reserved = 0;
+
+        // Requests too large or over aligned for the pool.
+        std::uint64_t oversize_allocations = 0;
+    };
+
+    // -------------------------------------------------------------------------
+    //
+    namespace detail
+    {
+        constexpr std::size_t pool_num_size_classes =
+            pool_max_block_size / pool_size_class_granularity;
+        constexpr std::size_t pool_batch_size = DAILY_FUTURE_POOL_BATCH_SIZE;
+
+        inline std::size_t pool_size_class(std::size_t bytes)
+        {
+            return (bytes + pool_size_class_granularity - 1) / pool_size_class_granularity - 1;
+        }
+
+        inline std::size_t pool_block_size(std::size_t size_class)
+        {
+            return (size_class + 1) * pool_size_class_granularity;
+        }
+
+        struct pool_block
+        {
+            pool_block* next;
+
+            // Only used by the first block of a batch held in the global
+            // pool, which links the batches without allocating.
+            pool_block* next_batch;
+            std::size_t batch_count;
+        };
+
+        static_assert(
+            sizeof(pool_block) <= pool_size_class_granularity,
+            "Every block must be able to head a batch.");
+
+        // Owned by one thread, but readable from any for statistics.
+        struct pool_thread_counters
+        {
+            std::atomic<std::uint64_t> allocations{0};
+            std::atomic<std::uint64_t> deallocations{0};
+            std::atomic<std::uint64_t> thread_cache_hits{0};
+
+            static void bump(std::atomic<std::uint64_t>& counter)
+            {
+                counter.store(
+                    counter.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+            }
+        };
+
+        // ---------------------------------------------------------------------
+        // Global free lists, held as whole batches.
+        class pool_central
+        {
+        public:
+
+            // Never destroyed so frees from other static destructors are
+            // still safe.
+            static pool_central& instance()
+            {
+                static pool_central* central = new pool_central;
+                return *central;
+            }
+
+            // Returns a list of at least one block.
+            std::pair<pool_block*, std::size_t> take_batch(std::size_t size_class)
+            {
+                free_list& list = lists_[size_class];
+                {
+                    std::lock_guard<std::mutex> lk(list.mutex);
+                    if(pool_block* batch = list.batches)
+                    {
+                        list.batches = batch->next_batch;
+                        global_refills_.fetch_add(1, std::memory_order_relaxed);
+                        return { batch, batch->batch_count };
+                    }
+                }
+
+                return carve_slab(size_class);
+            }
+
+            // Used from pool_deallocate, so mustn't allocate.
+            void give_batch(std::size_t size_class, pool_block* head, std::size_t count)
+            {
+                free_list& list = lists_[size_class];
+                head->batch_count = count;
+                std::lock_guard<std::mutex> lk(list.mutex);
+                head->next_batch = list.batches;
+                list.batches = head;
+                global_returns_.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            void count_oversize()
+            {
+                oversize_allocations_.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            void register_thread(pool_thread_counters* c)
+            {
+                std::lock_guard<std::mutex> lk(threads_mutex_);
+                threads_.push_back(c);
+            }
+
+            // Folds an exiting thread's counts into the retired totals.
+            void unregister_thread(pool_thread_counters* c)
+            {
+                std::lock_guard<std::mutex> lk(threads_mutex_);
+                threads_.erase(std::find(threads_.begin(), threads_.end(), c));
+                retired_.allocations += c->allocations.load(std::memory_order_relaxed);
+                retired_.deallocations += c->deallocations.load(std::memory_order_relaxed);
+                retired_.thread_cache_hits += c->thread_cache_hits.load(std::memory_order_relaxed);
+            }
+
+            pool_allocator_statistics statistics()
+            {
+                pool_allocator_statistics s;
+                {
+                    std::lock_guard<std::mutex> lk(threads_mutex_);
+                    s = retired_;
+                    for(auto&& c : threads_)
+                    {
+                        s.allocations += c->allocations.load(std::memory_order_relaxed);
+                        s.deallocations += c->deallocations.load(std::memory_order_relaxed);
+                        s.thread_cache_hits += c->thread_cache_hits.load(std::memory_order_relaxed);
+                    }
+                }
+
+                s.global_refills = global_refills_.load(std::memory_order_relaxed);
+                s.global_returns = global_returns_.load(std::memory_order_relaxed);
+                s.slabs = slabs_.load(std::memory_order_relaxed);
+                s.bytes_reserved = bytes_reserved_.load(std::memory_order_relaxed);
+                s.oversize_allocations = oversize_allocations_.load(std::memory_order_relaxed);
+                return s;
+            }
+
+        private:
+
+            pool_central() = default;
+
+            struct free_list
+            {
+                std::mutex mutex;
+                pool_block* batches = nullptr;
+            };
+
+            // A slab is exactly one batch of blocks, linked in address order.
+            std::pair<pool_block*, std::size_t> carve_slab(std::size_t size_class)
+            {
+                std::size_t const block_size = pool_block_size(size_class);
+                char* slab = static_cast<char*>(::operator new(block_size * pool_batch_size));
+                slabs_.fetch_add(1, std::memory_order_relaxed);
+                bytes_reserved_.fetch_add(block_size * pool_batch_size, std::memory_order_relaxed);
+
+                pool_block* head = nullptr;
+                for(std::size_t i = pool_batch_size; i-- > 0;)
+                {
+                    pool_block* b = reinterpret_cast<pool_block*>(slab + i * block_size);
+                    b->next = head;
+                    head = b;
+                }
+
+                return { head, pool_batch_size };
+            }
+
+            std::array<free_list, pool_num_size_classes> lists_;
+
+            std::atomic<std::uint64_t> global_refills_{0};
+            std::atomic<std::uint64_t> global_returns_{0};
+            std::atomic<std::uint64_t> slabs_{0};
+            std::atomic<std::uint64_t> bytes_reserved_{0};
+            std::atomic<std::uint64_t> oversize_allocations_{0};
+
+            std::mutex threads_mutex_;
+            std::vector<pool_thread_counters*> threads_;
+            pool_allocator_statistics retired_;
+        };
+
+        // ---------------------------------------------------------------------
+        //
+        class pool_thread_cache
+        {
+        public:
+
+            explicit pool_thread_cache(bool& destroyed)
+                : destroyed_(destroyed)
+            {
+                pool_central::instance().register_thread(&counters_);
+            }
+
+            ~pool_thread_cache()
+            {
+                for(std::size_t i = 0; i < lists_.size(); ++i)
+                {
+                    if(lists_[i].count)
+                        give_back(i, lists_[i].count);
+                }
+
+                pool_central::instance().unregister_thread(&counters_);
+                destroyed_ = true;
+            }
+
+            pool_thread_cache(pool_thread_cache const&) = delete;
+            pool_thread_cache& operator=(pool_thread_cache const&) = delete;
+
+            void* allocate(std::size_t size_class)
+            {
+                free_list& list = lists_[size_class];
+                pool_thread_counters::bump(counters_.allocations);
+                if(list.head)
+                {
+                    pool_thread_counters::bump(counters_.thread_cache_hits);
+                }
+                else
+                {
+                    auto batch = pool_central::instance().take_batch(size_class);
+                    list.head = batch.first;
+                    list.count = batch.second;
+                }
+
+                pool_block* b = list.head;
+                list.head = b->next;
+                --list.count;
+                return b;
+            }
+
+            void deallocate(void* p, std::size_t size_class)
+            {
+                free_list& list = lists_[size_class];
+                pool_thread_counters::bump(counters_.deallocations);
+                pool_block* b = static_cast<pool_block*>(p);
+                b->next = list.head;
+                list.head = b;
+                if(++list.count >= 2 * pool_batch_size)
+                    give_back(size_class, pool_batch_size);
+            }
+
+        private:
+
+            struct free_list
+            {
+                pool_block* head = nullptr;
+                std::size_t count = 0;
+            };
+
+            void give_back(std::size_t size_class, std::size_t count)
+            {
+                free_list& list = lists_[size_class];
+                pool_block* head = list.head;
+                pool_block* tail = head;
+                for(std::size_t i = 1; i < count; ++i)
+                    tail = tail->next;
+
+                list.head = tail->next;
+                list.count -= count;
+                tail->next = nullptr;
+                pool_central::instance().give_batch(size_class, head, count);
+            }
+
+            std::array<free_list, pool_num_size_classes> lists_;
+            pool_thread_counters counters_;
+            bool& destroyed_;
+        };
+
+        // Null once this thread's cache has been destroyed, for states
+        // released by later thread_local destructors.
+        inline pool_thread_cache* this_thread_pool_cache()
+        {
+            static thread_local bool destroyed = false;
+            if(destroyed)
+                return nullptr;
+
+            static thread_local pool_thread_cache cache(destroyed);
+            return &cache;
+        }
+
+        inline void* pool_allocate(std::size_t bytes, std::size_t alignment)
+        {
+            if(bytes > pool_max_block_size || alignment > alignof(std::max_align_t))
+            {
+                pool_central::instance().count_oversize();
+                return ::operator new(bytes);
+            }
+
+            std::size_t size_class = pool_size_class(bytes);
+            if(pool_thread_cache* cache = this_thread_pool_cache())
+                return cache->allocate(size_class);
+
+            // Thread is exiting, take a block and return the rest.
+            auto batch = pool_central::instance().take_batch(size_class);
+            if(batch.second > 1)
+                pool_central::instance().give_batch(size_class, batch.first->next, batch.second - 1);
+            return batch.first;
+        }
+
+        inline void pool_deallocate(void* p, std::size_t bytes, std::size_t alignment) noexcept
+        {
+            if(bytes > pool_max_block_size || alignment > alignof(std::max_align_t))
+            {
+                ::operator delete(p);
+                return;
+            }
+
+            std::size_t size_class = pool_size_class(bytes);
+            if(pool_thread_cache* cache = this_thread_pool_cache())
+            {
+                cache->deallocate(p, size_class);
+                return;
+            }
+
+            pool_block* b = static_cast<pool_block*>(p);
+            b->next = nullptr;
+            pool_central::instance().give_batch(size_class, b, 1);
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    //
+    template<typename T>
+    class pool_allocator
+    {
+    public:
+
+        typedef T value_type;
+
+        pool_allocator() noexcept = default;
+
+        template<typename U>
+        pool_allocator(pool_allocator<U> const&) noexcept
+        {}
+
+        T* allocate(std::size_t n)
+        {
+            return static_cast<T*>(detail::pool_allocate(n * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T* p, std::size_t n) noexcept
+        {
+            detail::pool_deallocate(p, n * sizeof(T), alignof(T));
+        }
+    };
+
+    template<typename T, typename U>
+    bool operator==(pool_allocator<T> const&, pool_allocator<U> const&) noexcept
+    {
+        return true;
+    }
+
+    template<typename T, typename U>
+    bool operator!=(pool_allocator<T> const&, pool_allocator<U> const&) noexcept
+    {
+        return false;
+    }
+
+    // -------------------------------------------------------------------------
+    // Totals over every thread, including those that have exited.
+    inline pool_allocator_statistics get_pool_allocator_statistics()
+    {
+        return detail::pool_central::instance().statistics();
+    }
+}
+
+#endif // DAILY_FUTURE_POOLALLOCATOR_HPP_
@@ -0,0 +1,314 @@
+// ****************************************************************************
+// daily/future/priority_thread_pool.hpp
+//
+// A thread pool with multiple priority levels. Executors obtained from the
+// pool carry a priority, so continuations can be prioritised at the point
+// they're attached, ie;
+//
+//   f.then(daily::execute::post, pool.get_executor(daily::priority::high), g);
+//
+// Work waiting in a lower level is aged towards the higher levels so bulk
+// work is delayed, not starved.
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#pragma once
+#ifndef DAILY_FUTURE_PRIORITYTHREADPOOL_HPP_
+#define DAILY_FUTURE_PRIORITYTHREADPOOL_HPP_
+
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "daily/future/default_allocator.hpp"
+#include "daily/future/executor_op.hpp"
+
+// -----------------------------------------------------------------------------
+//
+namespace daily
+{
+    // -------------------------------------------------------------------------
+    // Lower values run first. Pools may be created with any number of levels,
+    // these are the conventional ones for the default of three.
+    namespace priority
+    {
+        constexpr std::size_t high = 0;
+        constexpr std::size_t normal = 1;
+        constexpr std::size_t low = 2;
+    };
+
+    // -------------------------------------------------------------------------
+    //
+    namespace detail
+    {
+        class priority_op : public executor_op
+        {
+        public:
+
+            typedef std::chrono::steady_clock clock;
+
+            priority_op(complete_fn f)
+                : executor_op(f)
+                , enqueued_(clock::now())
+            {}
+
+            clock::time_point enqueued() const
+            {
+                return enqueued_;
+            }
+
+        private:
+
+            clock::time_point enqueued_;
+        };
+    }
+
+    // -------------------------------------------------------------------------
+    //
+    class priority_thread_pool
+    {
+    public:
+
+        typedef std::chrono::steady_clock::duration duration;
+
+        class executor_type
+        {
+        public:
+
+            // Allows an executor to be passed directly to future::then.
+            executor_type get_executor() const noexcept
+            {
+                return *this;
+            }
+
+            executor_type with_priority(std::size_t p) const noexcept
+            {
+                return executor_type(pool_, p);
+            }
+
+            std::size_t priority() const noexcept
+            {
+                return priority_;
+            }
+
+            priority_thread_pool& context() const noexcept
+            {
+                return *pool_;
+            }
+
+            void on_work_started() const noexcept
+            {}
+
+            void on_work_finished() const noexcept
+            {}
+
+            template<typename Function, typename Allocator = future_default_allocator>
+            void dispatch(Function&& f, Allocator const& alloc = Allocator()) const
+            {
+                if(pool_->running_in_this_thread())
+                {
+                    typename std::decay<Function>::type func(std::forward<Function>(f));
+                    func();
+                    return;
+                }
+
+                pool_->push(priority_, std::forward<Function>(f), alloc);
+            }
+
+            template<typename Function, typename Allocator = future_default_allocator>
+            void post(Function&& f, Allocator const& alloc = Allocator()) const
+            {
+                pool_->push(priority_, std::forward<Function>(f), alloc);
+            }
+
+            template<typename Function, typename Allocator = future_default_allocator>
+            void defer(Function&& f, Allocator const& alloc = Allocator()) const
+            {
+                pool_->push(priority_, std::forward<Function>(f), alloc);
+            }
+
+            friend bool operator==(executor_type const& lhs, executor_type const& rhs) noexcept
+            {
+                return lhs.pool_ == rhs.pool_ && lhs.priority_ == rhs.priority_;
+            }
+
+            friend bool operator!=(executor_type const& lhs, executor_type const& rhs) noexcept
+            {
+                return !(lhs == rhs);
+            }
+
+        private:
+
+            friend class priority_thread_pool;
+
+            executor_type(priority_thread_pool* pool, std::size_t p)
+                : pool_(pool)
+                , priority_(p)
+            {
+                assert(p < pool->queues_.size());
+            }
+
+            priority_thread_pool* pool_;
+            std::size_t priority_;
+        };
+
+        // Work that has waited for aging_interval is treated as one level
+        // more urgent than it was submitted at.
+        explicit priority_thread_pool(
+            std::size_t num_threads = std::thread::hardware_concurrency(),
+            std::size_t num_priorities = 3,
+            duration aging_interval = std::chrono::milliseconds(10))
+            : queues_(num_priorities)
+            , aging_interval_(aging_interval)
+        {
+            assert(num_priorities > 0);
+            assert(aging_interval_.count() > 0);
+            if(num_threads == 0)
+                num_threads = 1;
+
+            threads_.reserve(num_threads);
+            while(num_threads--)
+                threads_.emplace_back([this] { run(); });
+        }
+
+        ~priority_thread_pool()
+        {
+            join();
+            for(auto&& q : queues_)
+            {
+                while(!q.empty())
+                    q.pop()->destroy();
+            }
+        }
+
+        priority_thread_pool(priority_thread_pool const&) = delete;
+        priority_thread_pool& operator=(priority_thread_pool const&) = delete;
+
+        executor_type get_executor() noexcept
+        {
+            return executor_type(this, queues_.size() / 2);
+        }
+
+        executor_type get_executor(std::size_t p) noexcept
+        {
+            return executor_type(this, p);
+        }
+
+        std::size_t num_priorities() const noexcept
+        {
+            return queues_.size();
+        }
+
+        // Runs all outstanding work then stops the threads. A worker can't
+        // join itself, so call this, and destroy the pool, from outside it.
+        void join()
+        {
+            assert(!running_in_this_thread() && "join() called from a worker thread");
+            {
+                std::unique_lock<std::mutex> lk(mutex_);
+                stop_ = true;
+            }
+            ready_.notify_all();
+            for(auto&& t : threads_)
+            {
+                if(t.joinable())
+                    t.join();
+            }
+        }
+
+    private:
+
+        typedef detail::priority_op::clock clock;
+
+        template<typename Function, typename Allocator>
+        void push(std::size_t p, Function&& f, Allocator const& alloc)
+        {
+            detail::priority_op* op = detail::make_executor_op<detail::priority_op>(
+                std::forward<Function>(f), alloc);
+            {
+                std::unique_lock<std::mutex> lk(mutex_);
+                queues_[p].push(op);
+            }
+            ready_.notify_one();
+        }
+
+        // Picks the level with the most urgent head, a level's effective
+        // priority improves by one for each aging_interval its head has
+        // waited. Ties go to the higher level.
+        detail::priority_op* pop(std::unique_lock<std::mutex>&)
+        {
+            clock::time_point now = clock::now();
+            std::size_t best = queues_.size();
+            std::ptrdiff_t best_effective = 0;
+            for(std::size_t i = 0; i < queues_.size(); ++i)
+            {
+                if(queues_[i].empty())
+                    continue;
+
+                std::ptrdiff_t aged = static_cast<std::ptrdiff_t>(
+                    (now - queues_[i].front()->enqueued()) / aging_interval_);
+                std::ptrdiff_t effective = static_cast<std::ptrdiff_t>(i) - aged;
+                if(best == queues_.size() || effective < best_effective)
+                {
+                    best = i;
+                    best_effective = effective;
+                }
+            }
+
+            if(best == queues_.size())
+                return nullptr;
+
+            return queues_[best].pop();
+        }
+
+        bool running_in_this_thread() const
+        {
+            return current() == this;
+        }
+
+        void run()
+        {
+            current() = this;
+            std::unique_lock<std::mutex> lk(mutex_);
+            while(true)
+            {
+                detail::priority_op* op = pop(lk);
+                if(!op)
+                {
+                    if(stop_)
+                        return;
+
+                    ready_.wait(lk);
+                    continue;
+                }
+
+                lk.unlock();
+                op->complete();
+                lk.lock();
+            }
+        }
+
+        static priority_thread_pool const*& current()
+        {
+            static thread_local priority_thread_pool const* current_ = nullptr;
+            return current_;
+        }
+
+        std::mutex mutex_;
+        std::condition_variable ready_;
+        std::vector<detail::executor_op_queue<detail::priority_op>> queues_;
+        std::vector<std::thread> threads_;
+        duration aging_interval_;
+        bool stop_ = false;
+    };
+}
+
+#endif // DAILY_FUTURE_PRIORITYTHREADPOOL_HPP_
@@ -0,0 +1,97 @@
+// ****************************************************************************
+// daily/future/probes.hpp
+//
+// Linux USDT static tracepoints on the shared state transitions. Define
+// DAILY_FUTURE_ENABLE_USDT to compile them in. Probes are emitted in the
+// same .note.stapsdt format as <sys/sdt.h>, so bpftrace, bcc, perf and
+// SystemTap can attach to them, but without needing that header or any
+// runtime library. An unattached probe is a single nop.
+//
+// All probes are under the daily_future provider and every argument is a
+// 64 bit value, the address of the shared state first, ie;
+//
+//   bpftrace -e 'usdt:./app:daily_future:wait_begin { @s[arg0] = nsecs; }
+//                usdt:./app:daily_future:wait_end /@s[arg0]/ {
+//                    @wait_ns = hist(nsecs - @s[arg0]); delete(@s[arg0]); }'
+//
+//   set_finished(state)
+//   set_finished_with_exception(state)
+//   set_continuation(state, continuation)
+//   wait_begin(state), wait_end(state)
+//   executor_submit(state, policy)      policy is a char const*
+//   continuation_run(state, policy)
+//
+// Only available for ELF targets on x86-64 and AArch64 with GCC or Clang,
+// elsewhere the macro is ignored.
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#pragma once
+#ifndef DAILY_FUTURE_PROBES_HPP_
+#define DAILY_FUTURE_PROBES_HPP_
+
+#include <cstdint>
+
+#if defined(DAILY_FUTURE_ENABLE_USDT)                                          \
+    && defined(__ELF__) && defined(__GNUC__)                                   \
+    && (defined(__x86_64__) || defined(__aarch64__))
+#  define DAILY_FUTURE_USDT_AVAILABLE 1
+#else
+#  define DAILY_FUTURE_USDT_AVAILABLE 0
+#endif
+
+#if DAILY_FUTURE_USDT_AVAILABLE
+
+// The note layout matches <sys/sdt.h>: the probe's address, the address
+// of _.stapsdt.base for prelink adjustment, an unused semaphore, then the
+// provider, name and argument strings. The "?" flags keep the note in the
+// same comdat group as the code so probes in inline functions link.
+#define DAILY_FUTURE_USDT_NOTE(name, args)                                     \
+    "990: nop\n"                                                               \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n"                              \
+    ".balign 4\n"                                                              \
+    ".4byte 992f-991f, 994f-993f, 3\n"                                         \
+    "991: .asciz \"stapsdt\"\n"                                                \
+    "992: .balign 4\n"                                                         \
+    "993: .8byte 990b\n"                                                       \
+    ".8byte _.stapsdt.base\n"                                                  \
+    ".8byte 0\n"                                                               \
+    ".asciz \"daily_future\"\n"                                                \
+    ".asciz \"" #name "\"\n"                                                   \
+    ".asciz \"" args "\"\n"                                                    \
+    "994: .balign 4\n"                                                         \
+    ".popsection\n"                                                            \
+    ".ifndef _.stapsdt.base\n"                                                 \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"    \
+    ".weak _.stapsdt.base\n"                                                   \
+    ".hidden _.stapsdt.base\n"                                                 \
+    "_.stapsdt.base: .space 1\n"                                               \
+    ".size _.stapsdt.base, 1\n"                                                \
+    ".popsection\n"                                                            \
+    ".endif\n"
+
+#define DAILY_FUTURE_USDT_ARG(x) "nor"((std::uint64_t)(x))
+
+#define DAILY_FUTURE_PROBE1(name, x0)                                          \
+    __asm__ __volatile__(                                                      \
+        DAILY_FUTURE_USDT_NOTE(name, "8@%[a0]")                                \
+        :: [a0] DAILY_FUTURE_USDT_ARG(x0))
+
+#define DAILY_FUTURE_PROBE2(name, x0, x1)                                      \
+    __asm__ __volatile__(                                                      \
+        DAILY_FUTURE_USDT_NOTE(name, "8@%[a0] 8@%[a1]")                        \
+        :: [a0] DAILY_FUTURE_USDT_ARG(x0), [a1] DAILY_FUTURE_USDT_ARG(x1))
+
+#else
+
+#define DAILY_FUTURE_PROBE1(name, x0) ((void)0)
+#define DAILY_FUTURE_PROBE2(name, x0, x1) ((void)0)
+
+#endif
+
+#endif // DAILY_FUTURE_PROBES_HPP_
@@ -0,0 +1,108 @@
+// ****************************************************************************
+// daily/future/state_layout.hpp
+//
+// Layout of the fields every shared state carries. The finished, valid and
+// exception flags are packed into one atomic word. It is only written with
+// the chain locked, but it can be read without the lock.
+//
+// By default the layout is compact. The flag word sits right before the
+// result, so a thread polling readiness shares a cache line with the
+// producer writing the result. Defining
+// DAILY_FUTURE_ENABLE_CACHE_LINE_SEPARATION (consistently, in every
+// translation unit) puts the flag word, condition variable and continuation
+// first. A full line of padding then separates them from the exception and
+// result the producer writes. This costs DAILY_FUTURE_CACHE_LINE_SIZE bytes
+// per state, so only enable it when futures are mostly completed on a
+// different thread from the one waiting on them.
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#pragma once
+#ifndef DAILY_FUTURE_STATELAYOUT_HPP_
+#define DAILY_FUTURE_STATELAYOUT_HPP_
+
+#include <atomic>
+#include <cstddef>
+
+#if !defined(DAILY_FUTURE_CACHE_LINE_SIZE)
+#  define DAILY_FUTURE_CACHE_LINE_SIZE 64
+#endif
+
+// -----------------------------------------------------------------------------
+//
+namespace daily
+{
+#if defined(DAILY_FUTURE_ENABLE_CACHE_LINE_SEPARATION)
+    constexpr bool cache_line_separation_enabled = true;
+#else
+    constexpr bool cache_line_separation_enabled = false;
+#endif
+
+    constexpr std::size_t cache_line_size = DAILY_FUTURE_CACHE_LINE_SIZE;
+
+    // -------------------------------------------------------------------------
+    //
+    namespace detail
+    {
+        // ---------------------------------------------------------------------
+        // Writers hold the chain lock, so a set is a load and a release store
+        // rather than a read-modify-write. Readers without the lock use an
+        // acquire load, which also makes the result or exception written
+        // before the finished bit visible. The bits above the flags count
+        // how many times a promise's state has been recycled.
+        class state_flags
+        {
+        public:
+
+            enum : unsigned
+            {
+                finished = 1 << 0,
+                invalid = 1 << 1,
+                exception = 1 << 2,
+                generation_shift = 3,
+            };
+
+            state_flags() noexcept
+                : word_(0)
+            {}
+
+            unsigned load() const noexcept
+            {
+                return word_.load(std::memory_order_acquire);
+            }
+
+            bool test(unsigned bits) const noexcept
+            {
+                return (load() & bits) != 0;
+            }
+
+            void set(unsigned bits) noexcept
+            {
+                word_.store(word_.load(std::memory_order_relaxed) | bits, std::memory_order_release);
+            }
+
+            unsigned generation() const noexcept
+            {
+                return load() >> generation_shift;
+            }
+
+            // Clears the flags and moves on to the next generation.
+            void next_generation() noexcept
+            {
+                unsigned next = (word_.load(std::memory_order_relaxed) >> generation_shift) + 1;
+                word_.store(next << generation_shift, std::memory_order_release);
+            }
+
+        private:
+
+            std::atomic<unsigned> word_;
+        };
+    }
+}
+
+#endif // DAILY_FUTURE_STATELAYOUT_HPP_
@@ -0,0 +1,260 @@
+// ****************************************************************************
+// daily/future/statistics.hpp
+//
+// Optional runtime statistics for promises, futures and continuations.
+// Define DAILY_FUTURE_ENABLE_STATISTICS (consistently, in every translation
+// unit) to turn them on. When off the hooks compile to nothing, shared
+// states keep their size and get_statistics() returns zeros.
+//
+// Counters are sharded by thread onto separate cache lines and summed when
+// read, so a snapshot is not atomic across counters but is cheap enough to
+// export periodically to a metrics system, ie;
+//
+//   auto s = daily::get_statistics();
+//   export("futures.live", s[daily::statistic::shared_states_live]);
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#pragma once
+#ifndef DAILY_FUTURE_STATISTICS_HPP_
+#define DAILY_FUTURE_STATISTICS_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(DAILY_FUTURE_ENABLE_STATISTICS)
+#  include <atomic>
+#  include <chrono>
+#endif
+
+// -----------------------------------------------------------------------------
+//
+namespace daily
+{
+    // -------------------------------------------------------------------------
+    // Counters are monotonic except for the *_live gauges.
+    enum class statistic : std::size_t
+    {
+        promises_created,
+        futures_satisfied,
+        exceptions_set,
+        continuations_any,
+        continuations_get,
+        continuations_set,
+        continuations_dispatch,
+        continuations_post,
+        continuations_defer,
+        shared_states_live,
+        shared_state_bytes_live,
+        blocked_waits,
+        blocked_wait_ns,
+        count
+    };
+
+    inline char const* statistic_name(statistic s)
+    {
+        static char const* const names[] =
+        {
+            "promises_created",
+            "futures_satisfied",
+            "exceptions_set",
+            "continuations_any",
+            "continuations_get",
+            "continuations_set",
+            "continuations_dispatch",
+            "continuations_post",
+            "continuations_defer",
+            "shared_states_live",
+            "shared_state_bytes_live",
+            "blocked_waits",
+            "blocked_wait_ns",
+        };
+
+        static_assert(
+            sizeof(names) / sizeof(names[0]) == static_cast<std::size_t>(statistic::count),
+            "Every statistic needs a name."
+        );
+
+        return names[static_cast<std::size_t>(s)];
+    }
+
+#if defined(DAILY_FUTURE_ENABLE_STATISTICS)
+    constexpr bool statistics_enabled = true;
+#else
+    constexpr bool statistics_enabled = false;
+#endif
+
+    // -------------------------------------------------------------------------
+    //
+    class statistics_snapshot
+    {
+    public:
+
+        statistics_snapshot()
+        {
+            values_.fill(0);
+        }
+
+        std::int64_t operator[](statistic s) const
+        {
+            return values_[static_cast<std::size_t>(s)];
+        }
+
+        std::int64_t& operator[](statistic s)
+        {
+            return values_[static_cast<std::size_t>(s)];
+        }
+
+    private:
+
+        std::array<std::int64_t, static_cast<std::size_t>(statistic::count)> values_;
+    };
+
+    // -------------------------------------------------------------------------
+    //
+    namespace detail
+    {
+#if defined(DAILY_FUTURE_ENABLE_STATISTICS)
+
+        // Threads are assigned shards round robin, more threads than shards
+        // just share.
+        struct statistics_shard
+        {
+            alignas(64) std::array<
+                std::atomic<std::int64_t>,
+                static_cast<std::size_t>(statistic::count)
+            > counters;
+        };
+
+        constexpr std::size_t num_statistics_shards = 64;
+
+        inline std::array<statistics_shard, num_statistics_shards>& statistics_shards()
+        {
+            static std::array<statistics_shard, num_statistics_shards> shards;
+            return shards;
+        }
+
+        inline statistics_shard& this_thread_statistics_shard()
+        {
+            static std::atomic<std::size_t> next_shard(0);
+            static thread_local statistics_shard& shard =
+                statistics_shards()[next_shard.fetch_add(1) % num_statistics_shards];
+            return shard;
+        }
+
+        inline void count_statistic(statistic s, std::int64_t n = 1)
+        {
+            this_thread_statistics_shard().counters[static_cast<std::size_t>(s)].fetch_add(
+                n, std::memory_order_relaxed);
+        }
+
+        // Times a block on the ready condition variable.
+        class blocked_wait_timer
+        {
+        public:
+
+            blocked_wait_timer()
+                : start_(std::chrono::steady_clock::now())
+            {}
+
+            ~blocked_wait_timer()
+            {
+                count_statistic(statistic::blocked_waits);
+                count_statistic(
+                    statistic::blocked_wait_ns,
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start_).count());
+            }
+
+            blocked_wait_timer(blocked_wait_timer const&) = delete;
+            blocked_wait_timer& operator=(blocked_wait_timer const&) = delete;
+
+        private:
+
+            std::chrono::steady_clock::time_point start_;
+        };
+
+        // Base of the shared states, tracks the live count and bytes.
+        class shared_state_statistics
+        {
+        public:
+
+            void track_shared_state(std::size_t bytes)
+            {
+                bytes_ = bytes;
+                count_statistic(statistic::shared_states_live);
+                count_statistic(statistic::shared_state_bytes_live, bytes);
+            }
+
+        protected:
+
+            ~shared_state_statistics()
+            {
+                if(bytes_)
+                {
+                    count_statistic(statistic::shared_states_live, -1);
+                    count_statistic(
+                        statistic::shared_state_bytes_live,
+                        -static_cast<std::int64_t>(bytes_));
+                }
+            }
+
+        private:
+
+            std::size_t bytes_ = 0;
+        };
+
+#else
+
+        inline void count_statistic(statistic, std::int64_t = 1)
+        {}
+
+        class blocked_wait_timer
+        {
+        public:
+
+            // User provided so a disabled timer local doesn't warn as unused.
+            blocked_wait_timer()
+            {}
+
+            blocked_wait_timer(blocked_wait_timer const&) = delete;
+            blocked_wait_timer& operator=(blocked_wait_timer const&) = delete;
+        };
+
+        class shared_state_statistics
+        {
+        public:
+
+            void track_shared_state(std::size_t)
+            {}
+        };
+
+#endif
+    }
+
+    // -------------------------------------------------------------------------
+    // Sums all shards.
+    inline statistics_snapshot get_statistics()
+    {
+        statistics_snapshot snapshot;
+#if defined(DAILY_FUTURE_ENABLE_STATISTICS)
+        for(auto&& shard : detail::statistics_shards())
+        {
+            for(std::size_t i = 0; i < shard.counters.size(); ++i)
+            {
+                snapshot[static_cast<statistic>(i)] +=
+                    shard.counters[i].load(std::memory_order_relaxed);
+            }
+        }
+#endif
+        return snapshot;
+    }
+}
+
+#endif // DAILY_FUTURE_STATISTICS_HPP_
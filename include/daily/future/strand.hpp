@@ -0,0 +1,386 @@
+// ****************************************************************************
+// daily/future/strand.hpp
+//
+// An executor adapter that guarantees closures submitted to it never run
+// concurrently, without taking a lock. Usable anywhere future::then accepts
+// an executor, ie; f.then(daily::execute::post, strand, g).
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#pragma once
+#ifndef DAILY_FUTURE_STRAND_HPP_
+#define DAILY_FUTURE_STRAND_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include "daily/future/default_allocator.hpp"
+#include "daily/future/executor_op.hpp"
+
+// -----------------------------------------------------------------------------
+//
+namespace daily
+{
+    // -------------------------------------------------------------------------
+    //
+    namespace detail
+    {
+        // ---------------------------------------------------------------------
+        // Intrusive multi-producer single-consumer queue (Vyukov). push is
+        // wait free, pop can transiently return null while a push is half
+        // done, callers that know the queue is non-empty retry.
+        class strand_queue
+        {
+        public:
+
+            strand_queue()
+                : head_(&stub_)
+                , tail_(&stub_)
+                , stub_(nullptr)
+            {}
+
+            ~strand_queue()
+            {
+                while(executor_op* op = pop())
+                    op->destroy();
+            }
+
+            void push(executor_op* op)
+            {
+                op->next_.store(nullptr, std::memory_order_relaxed);
+                executor_op* prev = head_.exchange(op, std::memory_order_acq_rel);
+                prev->next_.store(op, std::memory_order_release);
+            }
+
+            executor_op* pop()
+            {
+                executor_op* tail = tail_;
+                executor_op* next = tail->next_.load(std::memory_order_acquire);
+                if(tail == &stub_)
+                {
+                    if(!next)
+                        return nullptr;
+
+                    tail_ = next;
+                    tail = next;
+                    next = next->next_.load(std::memory_order_acquire);
+                }
+
+                if(next)
+                {
+                    tail_ = next;
+                    return tail;
+                }
+
+                if(tail != head_.load(std::memory_order_acquire))
+                    return nullptr;
+
+                push(&stub_);
+                next = tail->next_.load(std::memory_order_acquire);
+                if(next)
+                {
+                    tail_ = next;
+                    return tail;
+                }
+
+                return nullptr;
+            }
+
+        private:
+
+            struct stub_op : executor_op
+            {
+                stub_op(complete_fn f)
+                    : executor_op(f)
+                {}
+            };
+
+            std::atomic<executor_op*> head_;
+            executor_op* tail_;
+            stub_op stub_;
+        };
+
+        // ---------------------------------------------------------------------
+        //
+        struct strand_submit_dispatch
+        {
+            template<typename Executor, typename Closure, typename Allocator>
+            static void submit(Executor& ex, Closure&& c, Allocator const& alloc)
+            {
+                ex.dispatch(std::forward<Closure>(c), alloc);
+            }
+        };
+
+        struct strand_submit_post
+        {
+            template<typename Executor, typename Closure, typename Allocator>
+            static void submit(Executor& ex, Closure&& c, Allocator const& alloc)
+            {
+                ex.post(std::forward<Closure>(c), alloc);
+            }
+        };
+
+        struct strand_submit_defer
+        {
+            template<typename Executor, typename Closure, typename Allocator>
+            static void submit(Executor& ex, Closure&& c, Allocator const& alloc)
+            {
+                ex.defer(std::forward<Closure>(c), alloc);
+            }
+        };
+
+        // ---------------------------------------------------------------------
+        // State shared by all copies of a strand. pending_ counts queued
+        // closures and doubles as the running flag: whoever moves it off
+        // zero owns the queue until it returns to zero.
+        template<typename Executor>
+        class strand_impl
+            : public std::enable_shared_from_this<strand_impl<Executor>>
+        {
+        public:
+
+            explicit strand_impl(Executor ex)
+                : executor_(std::move(ex))
+                , pending_(0)
+            {}
+
+            Executor const& inner_executor() const
+            {
+                return executor_;
+            }
+
+            bool running_in_this_thread() const
+            {
+                return current() == this;
+            }
+
+            // Returns true if the caller is now responsible for scheduling a
+            // drain of the queue.
+            template<typename Function, typename Allocator>
+            bool enqueue(Function&& f, Allocator const& alloc)
+            {
+                queue_.push(make_executor_op<executor_op>(std::forward<Function>(f), alloc));
+                return pending_.fetch_add(1, std::memory_order_acq_rel) == 0;
+            }
+
+            // The drain is submitted with the allocator of the closure that
+            // started it, and keeps using it for any reschedules.
+            template<typename Submitter, typename Allocator>
+            void schedule(Allocator const& alloc)
+            {
+                Submitter::submit(
+                    executor_,
+                    drain_closure<Allocator>{this->shared_from_this(), alloc},
+                    alloc);
+            }
+
+        private:
+
+            template<typename Allocator>
+            struct drain_closure
+            {
+                std::shared_ptr<strand_impl> impl_;
+                Allocator allocator_;
+
+                void operator()()
+                {
+                    impl_->drain(allocator_);
+                }
+            };
+
+            // Restores the current strand and reschedules if a closure
+            // throws, so the remaining work isn't lost.
+            template<typename Allocator>
+            class drain_guard
+            {
+            public:
+
+                drain_guard(strand_impl* impl, Allocator const& alloc)
+                    : impl_(impl)
+                    , allocator_(alloc)
+                    , previous_(current())
+                {
+                    current() = impl;
+                }
+
+                ~drain_guard()
+                {
+                    current() = previous_;
+                    if(impl_)
+                    {
+                        if(impl_->pending_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                            impl_->template schedule<strand_submit_post>(allocator_);
+                    }
+                }
+
+                void release()
+                {
+                    impl_ = nullptr;
+                }
+
+            private:
+
+                strand_impl* impl_;
+                Allocator const& allocator_;
+                strand_impl const* previous_;
+            };
+
+            template<typename Allocator>
+            void drain(Allocator const& alloc)
+            {
+                drain_guard<Allocator> guard(this, alloc);
+
+                // Yield back to the executor periodically so one busy strand
+                // can't monopolise a thread.
+                std::size_t budget = 64;
+                while(true)
+                {
+                    executor_op* op;
+                    while(!(op = queue_.pop()))
+                    {
+                        // pending_ says there's work, so a producer is
+                        // part way through its push.
+                    }
+
+                    op->complete();
+
+                    if(pending_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    {
+                        guard.release();
+                        return;
+                    }
+
+                    if(--budget == 0)
+                    {
+                        guard.release();
+                        schedule<strand_submit_post>(alloc);
+                        return;
+                    }
+                }
+            }
+
+            static strand_impl const*& current()
+            {
+                static thread_local strand_impl const* current_ = nullptr;
+                return current_;
+            }
+
+            Executor executor_;
+            strand_queue queue_;
+            std::atomic<std::size_t> pending_;
+        };
+    }
+
+    // -------------------------------------------------------------------------
+    // Copies of a strand share the same queue. The inner executor must
+    // provide dispatch, post and defer taking a closure and an allocator;
+    // the strand hands it the allocator its own caller submitted with.
+    template<typename Executor>
+    class strand
+    {
+    private:
+
+        typedef detail::strand_impl<Executor> impl_type;
+
+    public:
+
+        typedef Executor inner_executor_type;
+
+        explicit strand(Executor ex)
+            : impl_(std::make_shared<impl_type>(std::move(ex)))
+        {}
+
+        template<typename Allocator>
+        strand(std::allocator_arg_t, Allocator const& alloc, Executor ex)
+            : impl_(std::allocate_shared<impl_type>(alloc, std::move(ex)))
+        {}
+
+        // Allows a strand to be passed directly to future::then.
+        strand get_executor() const noexcept
+        {
+            return *this;
+        }
+
+        inner_executor_type get_inner_executor() const noexcept
+        {
+            return impl_->inner_executor();
+        }
+
+        auto& context() const noexcept
+        {
+            return impl_->inner_executor().context();
+        }
+
+        void on_work_started() const noexcept
+        {
+            impl_->inner_executor().on_work_started();
+        }
+
+        void on_work_finished() const noexcept
+        {
+            impl_->inner_executor().on_work_finished();
+        }
+
+        bool running_in_this_thread() const noexcept
+        {
+            return impl_->running_in_this_thread();
+        }
+
+        // Runs the closure immediately if we're already inside this strand.
+        template<typename Function, typename Allocator = future_default_allocator>
+        void dispatch(Function&& f, Allocator const& alloc = Allocator()) const
+        {
+            if(impl_->running_in_this_thread())
+            {
+                typename std::decay<Function>::type func(std::forward<Function>(f));
+                func();
+                return;
+            }
+
+            if(impl_->enqueue(std::forward<Function>(f), alloc))
+                impl_->template schedule<detail::strand_submit_dispatch>(alloc);
+        }
+
+        template<typename Function, typename Allocator = future_default_allocator>
+        void post(Function&& f, Allocator const& alloc = Allocator()) const
+        {
+            if(impl_->enqueue(std::forward<Function>(f), alloc))
+                impl_->template schedule<detail::strand_submit_post>(alloc);
+        }
+
+        template<typename Function, typename Allocator = future_default_allocator>
+        void defer(Function&& f, Allocator const& alloc = Allocator()) const
+        {
+            if(impl_->enqueue(std::forward<Function>(f), alloc))
+                impl_->template schedule<detail::strand_submit_defer>(alloc);
+        }
+
+        friend bool operator==(strand const& lhs, strand const& rhs) noexcept
+        {
+            return lhs.impl_ == rhs.impl_;
+        }
+
+        friend bool operator!=(strand const& lhs, strand const& rhs) noexcept
+        {
+            return lhs.impl_ != rhs.impl_;
+        }
+
+    private:
+
+        std::shared_ptr<impl_type> impl_;
+    };
+
+    template<typename Executor>
+    strand<Executor> make_strand(Executor ex)
+    {
+        return strand<Executor>(std::move(ex));
+    }
+}
+
+#endif // DAILY_FUTURE_STRAND_HPP_
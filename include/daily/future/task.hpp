@@ -0,0 +1,562 @@
+// ****************************************************************************
+// daily/future/task.hpp
+//
+// A lazy coroutine type that only starts running when it is awaited. The
+// result is stored in the coroutine frame so awaiting a task from another
+// coroutine doesn't allocate a shared state. A task can be converted to a
+// daily::future when a non-coroutine consumer needs the result.
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#pragma once
+#ifndef DAILY_FUTURE_TASK_HPP_
+#define DAILY_FUTURE_TASK_HPP_
+
+#if !defined(__cpp_impl_coroutine)
+#  error "daily/future/task.hpp requires C++20 coroutine support."
+#endif
+
+#include <boost/config.hpp>
+#include <boost/optional.hpp>
+#include <boost/core/no_exceptions_support.hpp>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <utility>
+#include "daily/future/future.hpp"
+#include "daily/future/default_allocator.hpp"
+
+// -----------------------------------------------------------------------------
+//
+namespace daily
+{
+    template<typename Result = void>
+    class task;
+
+    // -------------------------------------------------------------------------
+    //
+    namespace detail
+    {
+        // ---------------------------------------------------------------------
+        // Coroutine frames are allocated with the allocator passed as
+        // (std::allocator_arg, alloc) leading the coroutine's parameters, the
+        // same convention promise uses. A footer holding the allocator and a
+        // deallocation function is placed after the frame so operator delete
+        // can find its way back without knowing the allocator type.
+        typedef void (*frame_deallocate_fn)(void*, std::size_t);
+
+        inline std::size_t frame_footer_offset(std::size_t frame_size)
+        {
+            return (frame_size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+        }
+
+        struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) frame_block
+        {
+            char data[__STDCPP_DEFAULT_NEW_ALIGNMENT__];
+        };
+
+        template<typename Allocator>
+        struct frame_footer
+        {
+            typedef typename std::allocator_traits<
+                Allocator
+            >::template rebind_alloc<frame_block> allocator_type;
+
+            frame_footer(Allocator const& alloc)
+                : deallocate_(&deallocate)
+                , allocator_(alloc)
+            {}
+
+            static std::size_t num_blocks(std::size_t frame_size)
+            {
+                static_assert(
+                    alignof(frame_footer) <= alignof(std::max_align_t),
+                    "Over aligned allocators are not supported."
+                );
+
+                return (frame_footer_offset(frame_size) + sizeof(frame_footer) + sizeof(frame_block) - 1)
+                    / sizeof(frame_block);
+            }
+
+            static void* allocate(Allocator const& alloc, std::size_t frame_size)
+            {
+                allocator_type block_alloc(alloc);
+                char* frame = reinterpret_cast<char*>(
+                    std::allocator_traits<allocator_type>::allocate(
+                        block_alloc, num_blocks(frame_size)));
+                new(frame + frame_footer_offset(frame_size)) frame_footer(alloc);
+                return frame;
+            }
+
+            static void deallocate(void* p, std::size_t frame_size)
+            {
+                char* frame = static_cast<char*>(p);
+                frame_footer* footer =
+                    reinterpret_cast<frame_footer*>(frame + frame_footer_offset(frame_size));
+                allocator_type block_alloc(std::move(footer->allocator_));
+                footer->~frame_footer();
+                std::allocator_traits<allocator_type>::deallocate(
+                    block_alloc, reinterpret_cast<frame_block*>(frame), num_blocks(frame_size));
+            }
+
+            // Must be first so the type erased delete can find it.
+            frame_deallocate_fn deallocate_;
+            allocator_type allocator_;
+        };
+
+        struct frame_allocation
+        {
+            static void* operator new(std::size_t size)
+            {
+                return frame_footer<future_default_allocator>::allocate(
+                    future_default_allocator(), size);
+            }
+
+            // Forced inline so the frame is seen to come from the allocator
+            // rather than from this operator new, which would otherwise be
+            // flagged as mismatched with the sized delete below.
+            template<typename Allocator, typename... Args>
+            BOOST_FORCEINLINE static void* operator new(
+                std::size_t size,
+                std::allocator_arg_t, Allocator const& alloc,
+                Args const&...)
+            {
+                return frame_footer<Allocator>::allocate(alloc, size);
+            }
+
+            // Member function coroutines receive the object first.
+            template<typename This, typename Allocator, typename... Args>
+            BOOST_FORCEINLINE static void* operator new(
+                std::size_t size,
+                This const&, std::allocator_arg_t, Allocator const& alloc,
+                Args const&...)
+            {
+                return frame_footer<Allocator>::allocate(alloc, size);
+            }
+
+            static void operator delete(void* p, std::size_t size)
+            {
+                char* footer = static_cast<char*>(p) + frame_footer_offset(size);
+                (*reinterpret_cast<frame_deallocate_fn*>(footer))(p, size);
+            }
+
+            // Matching placement forms. Coroutine frames are always released
+            // through the sized delete, so these are never called.
+            template<typename Allocator, typename... Args>
+            static void operator delete(
+                void*, std::allocator_arg_t, Allocator const&, Args const&...)
+            {}
+
+            template<typename This, typename Allocator, typename... Args>
+            static void operator delete(
+                void*, This const&, std::allocator_arg_t, Allocator const&, Args const&...)
+            {}
+        };
+
+        // ---------------------------------------------------------------------
+        // Base promise type for all tasks, handles the continuation and the
+        // exception.
+        class task_promise_base : public frame_allocation
+        {
+        public:
+
+            struct final_awaiter
+            {
+                bool await_ready() const noexcept
+                {
+                    return false;
+                }
+
+                template<typename Promise>
+                std::coroutine_handle<> await_suspend(
+                    std::coroutine_handle<Promise> h) noexcept
+                {
+                    // Symmetric transfer back to whoever awaited us.
+                    if(h.promise().continuation_)
+                        return h.promise().continuation_;
+                    return std::noop_coroutine();
+                }
+
+                void await_resume() const noexcept
+                {}
+            };
+
+            std::suspend_always initial_suspend() const noexcept
+            {
+                return {};
+            }
+
+            final_awaiter final_suspend() const noexcept
+            {
+                return {};
+            }
+
+            void unhandled_exception()
+            {
+                exception_ = std::current_exception();
+            }
+
+            void set_continuation(std::coroutine_handle<> continuation)
+            {
+                continuation_ = continuation;
+            }
+
+            bool has_exception() const
+            {
+                return exception_ ? true : false;
+            }
+
+            std::exception_ptr get_exception() const
+            {
+                return exception_;
+            }
+
+        protected:
+
+            void check_exception()
+            {
+                if(exception_)
+                    std::rethrow_exception(exception_);
+            }
+
+        private:
+
+            std::coroutine_handle<> continuation_;
+            std::exception_ptr exception_;
+        };
+
+        // ---------------------------------------------------------------------
+        // Adds the result.
+        template<typename Result>
+        class task_promise : public task_promise_base
+        {
+        public:
+
+            typedef boost::optional<Result> storage_type;
+
+            task<Result> get_return_object();
+
+            template<typename R>
+            void return_value(R&& r)
+            {
+                result_ = std::forward<R>(r);
+            }
+
+            Result get()
+            {
+                this->check_exception();
+                return *std::move(result_);
+            }
+
+        private:
+
+            storage_type result_;
+        };
+
+        // ---------------------------------------------------------------------
+        // Adds the result with a void specialization.
+        template<>
+        class task_promise<void> : public task_promise_base
+        {
+        public:
+
+            task<void> get_return_object();
+
+            void return_void()
+            {}
+
+            void get()
+            {
+                this->check_exception();
+            }
+        };
+
+        // ---------------------------------------------------------------------
+        // Adds the result with a ref specialization.
+        template<typename Result>
+        class task_promise<Result&> : public task_promise_base
+        {
+        public:
+
+            typedef Result* storage_type;
+
+            task<Result&> get_return_object();
+
+            void return_value(Result& r)
+            {
+                result_ = &r;
+            }
+
+            Result& get()
+            {
+                this->check_exception();
+                return *result_;
+            }
+
+        private:
+
+            storage_type result_ = nullptr;
+        };
+
+        // ---------------------------------------------------------------------
+        // Fire and forget coroutine used to drive a task into a promise when
+        // a future is requested. Destroys itself on completion.
+        struct task_future_driver
+        {
+            struct promise_type : frame_allocation
+            {
+                task_future_driver get_return_object() const noexcept
+                {
+                    return {};
+                }
+
+                std::suspend_never initial_suspend() const noexcept
+                {
+                    return {};
+                }
+
+                std::suspend_never final_suspend() const noexcept
+                {
+                    return {};
+                }
+
+                void return_void()
+                {}
+
+                void unhandled_exception()
+                {
+                    std::terminate();
+                }
+            };
+        };
+
+        template<typename Promise>
+        struct task_completion_awaiter
+        {
+            std::coroutine_handle<Promise> handle_;
+
+            bool await_ready() const noexcept
+            {
+                return handle_.done();
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+            {
+                handle_.promise().set_continuation(awaiting);
+                return handle_;
+            }
+
+            Promise& await_resume() const noexcept
+            {
+                return handle_.promise();
+            }
+        };
+
+        struct task_access
+        {
+            template<typename Result>
+            static auto completion(task<Result>& t) noexcept
+            {
+                return t.completion();
+            }
+        };
+
+        template<typename Result>
+        struct task_result_setter
+        {
+            static void set(task_promise<Result>& from, promise<Result>& to)
+            {
+                to.set_value(from.get());
+            }
+        };
+
+        template<>
+        struct task_result_setter<void>
+        {
+            static void set(task_promise<void>& from, promise<void>& to)
+            {
+                from.get();
+                to.set_value();
+            }
+        };
+
+        template<typename Result, typename Allocator>
+        task_future_driver drive_task(
+            std::allocator_arg_t, Allocator const&,
+            task<Result> t, promise<Result> p)
+        {
+            task_promise<Result>& state = co_await task_access::completion(t);
+            if(state.has_exception())
+            {
+                p.set_exception(state.get_exception());
+                co_return;
+            }
+
+            BOOST_TRY
+            {
+                task_result_setter<Result>::set(state, p);
+            }
+            // Exceptions thrown by continue_on::set continuations are already
+            // stored in the continuation's state, and there is nobody left
+            // here to report them to.
+            BOOST_CATCH(...)
+            {}
+            BOOST_CATCH_END
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    //
+    template<typename Result>
+    class task
+    {
+    public:
+
+        typedef detail::task_promise<Result> promise_type;
+
+    private:
+
+        typedef std::coroutine_handle<promise_type> handle_type;
+
+        struct awaiter : detail::task_completion_awaiter<promise_type>
+        {
+            Result await_resume()
+            {
+                return this->handle_.promise().get();
+            }
+        };
+
+    public:
+
+        task() noexcept
+        {}
+
+        ~task()
+        {
+            if(handle_)
+                handle_.destroy();
+        }
+
+        // move support
+        task(task&& other) noexcept
+            : handle_(std::exchange(other.handle_, nullptr))
+        {}
+
+        task& operator=(task&& other) noexcept
+        {
+            if(&other != this)
+            {
+                if(handle_)
+                    handle_.destroy();
+                handle_ = std::exchange(other.handle_, nullptr);
+            }
+            return *this;
+        }
+
+        // no copy
+        task(task const& other) = delete;
+        task& operator=(task const& other) = delete;
+
+        void swap(task& other) noexcept
+        {
+            std::swap(handle_, other.handle_);
+        }
+
+        bool valid() const noexcept
+        {
+            return handle_ ? true : false;
+        }
+
+        bool is_ready() const
+        {
+            assert(valid());
+            return handle_.done();
+        }
+
+        // Starts the task on first await, the awaiting coroutine is
+        // resumed by the thread that completes the task.
+        awaiter operator co_await() && noexcept
+        {
+            assert(valid());
+            return awaiter{{handle_}};
+        }
+
+        // Starts the task and returns a future that will receive its result.
+        // This is the only place a shared state is allocated.
+        future<Result> get_future() &&
+        {
+            return std::move(*this).get_future(std::allocator_arg, future_default_allocator());
+        }
+
+        template<typename Allocator>
+        future<Result> get_future(std::allocator_arg_t, Allocator const& alloc) &&
+        {
+            if(!valid())
+            {
+                BOOST_THROW_EXCEPTION(future_error(future_errc::no_state));
+            }
+
+            promise<Result> p(std::allocator_arg, alloc);
+            future<Result> f = p.get_future();
+            detail::drive_task(std::allocator_arg, alloc, std::move(*this), std::move(p));
+            return f;
+        }
+
+    private:
+
+        template<typename>
+        friend class detail::task_promise;
+
+        friend struct detail::task_access;
+
+        explicit task(handle_type h) noexcept
+            : handle_(h)
+        {}
+
+        detail::task_completion_awaiter<promise_type> completion() noexcept
+        {
+            return {handle_};
+        }
+
+        handle_type handle_;
+    };
+
+    template<typename Result>
+    void swap(task<Result>& lhs, task<Result>& rhs) noexcept
+    {
+        lhs.swap(rhs);
+    }
+
+    // -------------------------------------------------------------------------
+    //
+    namespace detail
+    {
+        template<typename Result>
+        task<Result> task_promise<Result>::get_return_object()
+        {
+            return task<Result>(
+                std::coroutine_handle<task_promise<Result>>::from_promise(*this));
+        }
+
+        inline task<void> task_promise<void>::get_return_object()
+        {
+            return task<void>(
+                std::coroutine_handle<task_promise<void>>::from_promise(*this));
+        }
+
+        template<typename Result>
+        task<Result&> task_promise<Result&>::get_return_object()
+        {
+            return task<Result&>(
+                std::coroutine_handle<task_promise<Result&>>::from_promise(*this));
+        }
+    }
+}
+
+#endif // DAILY_FUTURE_TASK_HPP_
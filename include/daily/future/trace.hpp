@@ -0,0 +1,436 @@
+// ****************************************************************************
+// daily/future/trace.hpp
+//
+// Optional lifecycle tracing for promises, futures and continuations,
+// exported as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+// Define DAILY_FUTURE_ENABLE_TRACING (consistently, in every translation
+// unit) to turn it on. When off the hooks compile to nothing.
+//
+// Each promise starts a chain with a new flow id which every continuation
+// attached to it inherits, so the viewer draws arrows between the slices
+// of one chain across threads. Slices are recorded for promise creation,
+// set_value/set_exception, blocking waits, and each continuation's
+// execution on whichever thread ran it. Executor continuations also record
+// an instant when they're submitted, labelled with the policy.
+//
+// Events go to a per thread ring buffer of DAILY_FUTURE_TRACE_BUFFER_SIZE
+// events, oldest overwritten first, so tracing can be left on and dumped
+// after the fact. The buffers of the last DAILY_FUTURE_TRACE_RETAINED_BUFFERS
+// threads to exit are kept for the dump, beyond that new threads take over
+// the oldest, ie;
+//
+//   std::ofstream out("trace.json");
+//   daily::write_trace(out);
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#pragma once
+#ifndef DAILY_FUTURE_TRACE_HPP_
+#define DAILY_FUTURE_TRACE_HPP_
+
+#include <cstdint>
+#include <ostream>
+
+#if defined(DAILY_FUTURE_ENABLE_TRACING)
+#  include <atomic>
+#  include <chrono>
+#  include <deque>
+#  include <memory>
+#  include <mutex>
+#  include <vector>
+#endif
+
+#if !defined(DAILY_FUTURE_TRACE_BUFFER_SIZE)
+#  define DAILY_FUTURE_TRACE_BUFFER_SIZE 65536
+#endif
+
+#if !defined(DAILY_FUTURE_TRACE_RETAINED_BUFFERS)
+#  define DAILY_FUTURE_TRACE_RETAINED_BUFFERS 16
+#endif
+
+// -----------------------------------------------------------------------------
+//
+namespace daily
+{
+#if defined(DAILY_FUTURE_ENABLE_TRACING)
+    constexpr bool tracing_enabled = true;
+#else
+    constexpr bool tracing_enabled = false;
+#endif
+
+    // -------------------------------------------------------------------------
+    //
+    namespace detail
+    {
+#if defined(DAILY_FUTURE_ENABLE_TRACING)
+
+        struct trace_event
+        {
+            char const* name;
+            char const* category;
+            std::uint64_t start_ns;
+            std::uint64_t duration_ns;
+            std::uint64_t flow_id;
+            bool instant;
+            bool flow_start;
+        };
+
+        // Written only by its owning thread, the mutex is uncontended
+        // except while a dump is in progress.
+        class trace_buffer
+        {
+        public:
+
+            explicit trace_buffer(std::size_t thread_index)
+                : events_(DAILY_FUTURE_TRACE_BUFFER_SIZE)
+                , thread_index_(thread_index)
+            {}
+
+            void push(trace_event const& e)
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                events_[next_ % events_.size()] = e;
+                ++next_;
+            }
+
+            template<typename Visitor>
+            void visit(Visitor&& v)
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                std::size_t count = next_ < events_.size() ? next_ : events_.size();
+                for(std::size_t i = next_ - count; i < next_; ++i)
+                    v(events_[i % events_.size()]);
+            }
+
+            void clear()
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                next_ = 0;
+            }
+
+            // Hands a retired buffer to a new thread.
+            void reset(std::size_t thread_index)
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                next_ = 0;
+                thread_index_ = thread_index;
+            }
+
+            std::size_t thread_index() const
+            {
+                return thread_index_;
+            }
+
+        private:
+
+            std::mutex mutex_;
+            std::vector<trace_event> events_;
+            std::size_t next_ = 0;
+            std::size_t thread_index_;
+        };
+
+        // Buffers outlive their threads so a dump after a pool has been
+        // joined still has its events. Retired buffers are reused once
+        // DAILY_FUTURE_TRACE_RETAINED_BUFFERS of them are held, so memory
+        // is bounded by the peak number of live threads.
+        class trace_registry
+        {
+        public:
+
+            static trace_registry& instance()
+            {
+                static trace_registry registry;
+                return registry;
+            }
+
+            // Null once this thread's buffer has been retired, for events
+            // recorded by later thread_local destructors.
+            trace_buffer* this_thread_buffer()
+            {
+                static thread_local bool retired = false;
+                if(retired)
+                    return nullptr;
+
+                static thread_local buffer_lease lease(*this, retired);
+                return &lease.buffer();
+            }
+
+            template<typename Visitor>
+            void visit(Visitor&& v)
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                for(auto&& b : buffers_)
+                    v(*b);
+            }
+
+            std::uint64_t now_ns() const
+            {
+                return static_cast<std::uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - epoch_).count());
+            }
+
+            std::uint64_t new_flow_id()
+            {
+                return next_flow_id_.fetch_add(1, std::memory_order_relaxed);
+            }
+
+        private:
+
+            class buffer_lease
+            {
+            public:
+
+                buffer_lease(trace_registry& registry, bool& retired)
+                    : registry_(registry)
+                    , buffer_(registry.acquire())
+                    , retired_(retired)
+                {}
+
+                ~buffer_lease()
+                {
+                    registry_.retire(buffer_);
+                    retired_ = true;
+                }
+
+                buffer_lease(buffer_lease const&) = delete;
+                buffer_lease& operator=(buffer_lease const&) = delete;
+
+                trace_buffer& buffer() const
+                {
+                    return *buffer_;
+                }
+
+            private:
+
+                trace_registry& registry_;
+                trace_buffer* buffer_;
+                bool& retired_;
+            };
+
+            trace_registry()
+                : epoch_(std::chrono::steady_clock::now())
+                , next_flow_id_(1)
+            {}
+
+            trace_buffer* acquire()
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                std::size_t thread_index = ++num_threads_;
+                if(!retired_.empty() && retired_.size() >= DAILY_FUTURE_TRACE_RETAINED_BUFFERS)
+                {
+                    trace_buffer* buffer = retired_.front();
+                    retired_.pop_front();
+                    buffer->reset(thread_index);
+                    return buffer;
+                }
+
+                buffers_.push_back(std::make_unique<trace_buffer>(thread_index));
+                return buffers_.back().get();
+            }
+
+            void retire(trace_buffer* buffer)
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                retired_.push_back(buffer);
+            }
+
+            std::mutex mutex_;
+            std::vector<std::unique_ptr<trace_buffer>> buffers_;
+            std::deque<trace_buffer*> retired_;
+            std::size_t num_threads_ = 0;
+            std::chrono::steady_clock::time_point epoch_;
+            std::atomic<std::uint64_t> next_flow_id_;
+        };
+
+        inline void trace_record(
+            char const* name,
+            char const* category,
+            std::uint64_t start_ns,
+            std::uint64_t duration_ns,
+            std::uint64_t flow_id,
+            bool instant,
+            bool flow_start = false)
+        {
+            if(trace_buffer* buffer = trace_registry::instance().this_thread_buffer())
+                buffer->push({ name, category, start_ns, duration_ns, flow_id, instant, flow_start });
+        }
+
+        inline void trace_instant(char const* name, char const* category, std::uint64_t flow_id)
+        {
+            trace_record(name, category, trace_registry::instance().now_ns(), 0, flow_id, true);
+        }
+
+        // Records a slice covering its lifetime.
+        class trace_scope
+        {
+        public:
+
+            trace_scope(char const* name, char const* category, std::uint64_t flow_id)
+                : name_(name)
+                , category_(category)
+                , flow_id_(flow_id)
+                , start_ns_(trace_registry::instance().now_ns())
+            {}
+
+            ~trace_scope()
+            {
+                trace_record(
+                    name_, category_, start_ns_,
+                    trace_registry::instance().now_ns() - start_ns_,
+                    flow_id_, false);
+            }
+
+            trace_scope(trace_scope const&) = delete;
+            trace_scope& operator=(trace_scope const&) = delete;
+
+        private:
+
+            char const* name_;
+            char const* category_;
+            std::uint64_t flow_id_;
+            std::uint64_t start_ns_;
+        };
+
+        // Base of the shared states, carries the chain's flow id.
+        class shared_state_trace
+        {
+        public:
+
+            std::uint64_t trace_id() const
+            {
+                return trace_id_;
+            }
+
+            void start_trace()
+            {
+                trace_id_ = trace_registry::instance().new_flow_id();
+                trace_record(
+                    "promise", "promise",
+                    trace_registry::instance().now_ns(), 0,
+                    trace_id_, true, true);
+            }
+
+            void inherit_trace(shared_state_trace const& parent)
+            {
+                trace_id_ = parent.trace_id_;
+            }
+
+        private:
+
+            std::uint64_t trace_id_ = 0;
+        };
+
+#else
+
+        inline void trace_instant(char const*, char const*, std::uint64_t)
+        {}
+
+        class trace_scope
+        {
+        public:
+
+            trace_scope(char const*, char const*, std::uint64_t)
+            {}
+
+            trace_scope(trace_scope const&) = delete;
+            trace_scope& operator=(trace_scope const&) = delete;
+        };
+
+        class shared_state_trace
+        {
+        public:
+
+            std::uint64_t trace_id() const
+            {
+                return 0;
+            }
+
+            void start_trace()
+            {}
+
+            void inherit_trace(shared_state_trace const&)
+            {}
+        };
+
+#endif
+    }
+
+    // -------------------------------------------------------------------------
+    // Writes every buffered event as a Chrome trace JSON object. Safe to call
+    // while other threads are still recording.
+    inline void write_trace(std::ostream& out)
+    {
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+#if defined(DAILY_FUTURE_ENABLE_TRACING)
+        bool first = true;
+        auto separator = [&out, &first]() -> std::ostream&
+        {
+            if(!first)
+                out << ",";
+            first = false;
+            return out << "\n";
+        };
+
+        auto micros = [](std::uint64_t ns)
+        {
+            return static_cast<double>(ns) / 1000.0;
+        };
+
+        auto old_precision = out.precision(3);
+        auto old_flags = out.setf(std::ios::fixed, std::ios::floatfield);
+        detail::trace_registry::instance().visit([&](detail::trace_buffer& buffer)
+        {
+            std::size_t tid = buffer.thread_index();
+            separator()
+                << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << tid
+                << ",\"args\":{\"name\":\"thread " << tid << "\"}}";
+
+            buffer.visit([&](detail::trace_event const& e)
+            {
+                separator()
+                    << "{\"ph\":\"" << (e.instant ? "i" : "X")
+                    << "\",\"name\":\"" << e.name
+                    << "\",\"cat\":\"" << e.category
+                    << "\",\"ts\":" << micros(e.start_ns);
+                if(e.instant)
+                    out << ",\"s\":\"t\"";
+                else
+                    out << ",\"dur\":" << micros(e.duration_ns);
+                out << ",\"pid\":1,\"tid\":" << tid
+                    << ",\"args\":{\"chain\":" << e.flow_id << "}}";
+
+                if(e.flow_id == 0)
+                    return;
+
+                separator()
+                    << "{\"ph\":\"" << (e.flow_start ? "s" : "t")
+                    << "\",\"name\":\"chain\",\"cat\":\"daily.flow\",\"id\":" << e.flow_id
+                    << ",\"ts\":" << micros(e.start_ns)
+                    << ",\"pid\":1,\"tid\":" << tid << "}";
+            });
+        });
+        out.precision(old_precision);
+        out.flags(old_flags);
+#endif
+        out << "\n]}\n";
+    }
+
+    // Discards all buffered events.
+    inline void clear_trace()
+    {
+#if defined(DAILY_FUTURE_ENABLE_TRACING)
+        detail::trace_registry::instance().visit([](detail::trace_buffer& buffer)
+        {
+            buffer.clear();
+        });
+#endif
+    }
+}
+
+#endif // DAILY_FUTURE_TRACE_HPP_
@@ -17,6 +17,12 @@
 
 #include "daily/future/future.hpp"
 #include "daily/future/default_allocator.hpp"
+#include "daily/future/pool_allocator.hpp"
+#include <boost/core/no_exceptions_support.hpp>
+#include <exception>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 
 // -----------------------------------------------------------------------------
@@ -24,7 +30,232 @@
 namespace daily
 {
     template<typename Allocator = future_default_allocator>
-    struct use_future_t
+    struct use_future_t;
+
+    template<typename Allocator, typename Continuation>
+    class use_future_then_t;
+
+    namespace detail
+    {
+        // What the arguments of a completion signature are stored as; none
+        // is void, one is itself and more are packed into a tuple.
+        template<typename... Args>
+        struct completion_result
+        {
+            typedef std::tuple<Args...> type;
+
+            static void set(promise<type>& p, Args... args)
+            {
+                p.set_value(type(std::move(args)...));
+            }
+
+            template<typename Function>
+            static auto call(Function& f, Args... args)
+                -> decltype(f(std::declval<type>()))
+            {
+                return f(type(std::move(args)...));
+            }
+        };
+
+        template<>
+        struct completion_result<>
+        {
+            typedef void type;
+
+            static void set(promise<void>& p)
+            {
+                p.set_value();
+            }
+
+            template<typename Function>
+            static auto call(Function& f) -> decltype(f())
+            {
+                return f();
+            }
+        };
+
+        template<typename Arg>
+        struct completion_result<Arg>
+        {
+            typedef Arg type;
+
+            static void set(promise<type>& p, Arg arg)
+            {
+                p.set_value(std::move(arg));
+            }
+
+            template<typename Function>
+            static auto call(Function& f, Arg arg) -> decltype(f(std::declval<Arg>()))
+            {
+                return f(std::move(arg));
+            }
+        };
+
+        // Satisfies p with what f returns when given the completion's
+        // result, or with what it throws.
+        template<typename Result, typename Function, typename... Args>
+        void complete_continuation(promise<Result>& p, Function& f, Args... args)
+        {
+            set_from_call<Result>::set(p, [&]
+            {
+                return completion_result<Args...>::call(f, std::move(args)...);
+            });
+        }
+
+        template<typename Result, typename Function, typename Tuple, std::size_t... I>
+        void complete_continuation_tuple(
+            promise<Result>& p, Function& f, Tuple& args, std::index_sequence<I...>)
+        {
+            complete_continuation(p, f, std::get<I>(std::move(args))...);
+        }
+
+        // Runs the continuation on the thread completing the operation,
+        // which continue_on::set and continue_on::any both allow.
+        template<statistic Statistic, typename Function>
+        class inline_continuation
+        {
+        public:
+
+            typedef Function function_type;
+
+            explicit inline_continuation(Function f)
+                : function_(std::move(f))
+            {}
+
+            template<typename Result, typename Allocator, typename... Args>
+            void complete(promise<Result>& p, Allocator const&, Args... args)
+            {
+                count_statistic(Statistic);
+                complete_continuation(p, function_, std::move(args)...);
+            }
+
+        private:
+
+            Function function_;
+        };
+
+        // Hands the continuation, the promise and the arguments to the
+        // executor in one closure.
+        template<typename Submitter, typename Executor, typename Function>
+        class submit_continuation
+        {
+        public:
+
+            typedef Function function_type;
+
+            submit_continuation(Executor ex, Function f)
+                : executor_(std::move(ex))
+                , function_(std::move(f))
+            {}
+
+            template<typename Result, typename Allocator, typename... Args>
+            void complete(promise<Result>& p, Allocator const& alloc, Args... args)
+            {
+                auto closure = [
+                    p = std::move(p),
+                    f = std::move(function_),
+                    values = std::make_tuple(std::move(args)...)
+                ]() mutable
+                {
+                    count_statistic(Submitter::continuation_statistic);
+                    complete_continuation_tuple(
+                        p, f, values, std::index_sequence_for<Args...>());
+                };
+
+                Submitter::submit(executor_, std::move(closure), alloc);
+            }
+
+        private:
+
+            Executor executor_;
+            Function function_;
+        };
+
+        template<typename Policy>
+        struct completion_submitter;
+
+        template<>
+        struct completion_submitter<execute::dispatch_t>
+        {
+            typedef submit_dispatch type;
+        };
+
+        template<>
+        struct completion_submitter<execute::post_t>
+        {
+            typedef submit_post type;
+        };
+
+        template<>
+        struct completion_submitter<execute::defer_t>
+        {
+            typedef submit_defer type;
+        };
+
+        // Gives use_future_t, and its memory resource specialization,
+        // then(). There's no continue_on::get, running the continuation
+        // from get() needs a state of its own, which is what this avoids.
+        template<typename Allocator>
+        class use_future_then_support
+        {
+        public:
+
+            template<typename F>
+            auto then(continue_on::set_t, F&& f) const
+            {
+                typedef inline_continuation<
+                    statistic::continuations_set, typename std::decay<F>::type
+                > continuation;
+                return with(continuation(std::forward<F>(f)));
+            }
+
+            template<typename F>
+            auto then(continue_on::any_t, F&& f) const
+            {
+                typedef inline_continuation<
+                    statistic::continuations_any, typename std::decay<F>::type
+                > continuation;
+                return with(continuation(std::forward<F>(f)));
+            }
+
+            template<typename Policy, typename Executor, typename F>
+            auto then(Policy, Executor&& ex, F&& f) const
+            {
+                typedef typename std::decay<decltype(ex.get_executor())>::type executor_type;
+                typedef submit_continuation<
+                    typename completion_submitter<Policy>::type,
+                    executor_type,
+                    typename std::decay<F>::type
+                > continuation;
+                return with(continuation(ex.get_executor(), std::forward<F>(f)));
+            }
+
+        private:
+
+            template<typename Continuation>
+            use_future_then_t<Allocator, Continuation> with(Continuation c) const
+            {
+                return use_future_then_t<Allocator, Continuation>(
+                    static_cast<use_future_t<Allocator> const&>(*this), std::move(c));
+            }
+        };
+    }
+
+    // The token. then() makes one that also carries a continuation, which
+    // the handler runs itself when the operation completes, rather than
+    // attaching it to the future afterward, ie;
+    //
+    //   auto f = dispatch(pool, read, daily::use_future.then(
+    //       daily::continue_on::set, parse));
+    //
+    // costs one state and no extra lock, where
+    //
+    //   auto f = dispatch(pool, read, daily::use_future).then(
+    //       daily::continue_on::set, parse);
+    //
+    // costs two states and a lock to attach parse.
+    template<typename Allocator>
+    struct use_future_t : detail::use_future_then_support<Allocator>
     {
         constexpr use_future_t() noexcept
         {}
@@ -43,32 +274,231 @@ namespace daily
         Allocator allocator_;
     };
 
+#if defined(DAILY_FUTURE_USE_MEMORY_RESOURCE)
+    // The default token is constructed before any thread has installed a
+    // resource, so unless given one it picks up the calling thread's when
+    // the operation starts.
+    template<>
+    struct use_future_t<future_default_allocator>
+        : detail::use_future_then_support<future_default_allocator>
+    {
+        constexpr use_future_t() noexcept
+        {}
+
+        explicit use_future_t(future_default_allocator const& alloc) noexcept
+            : resource_(alloc.resource())
+        {}
+
+        future_default_allocator get_allocator() const noexcept
+        {
+            return resource_
+                ? future_default_allocator(resource_)
+                : future_default_allocator();
+        }
+
+    private:
+
+        std::pmr::memory_resource* resource_ = nullptr;
+    };
+#endif
+
+    // Takes the shared state from the pool allocator. The handler passes
+    // the same allocator on to the executor, so once the pool has warmed
+    // up an operation started with this token doesn't touch the heap, ie;
+    //
+    //   auto f = dispatch(pool, get_one, daily::use_pooled_future);
+    //
+    typedef use_future_t<pool_allocator<void>> use_pooled_future_t;
+
+    // A token whose handler takes a leading error_code and sets a non zero
+    // one as the future's exception, a completion_error, instead of as part
+    // of the value, ie;
+    //
+    //   // daily::future<std::size_t> rather than
+    //   // daily::future<std::tuple<std::error_code, std::size_t>>
+    //   auto f = async_read(s, buf, daily::map_error_code(daily::use_future));
+    //
+    template<typename Allocator = future_default_allocator>
+    struct use_future_error_code_t : use_future_t<Allocator>
+    {
+        constexpr use_future_error_code_t() noexcept
+        {}
+
+        constexpr explicit use_future_error_code_t(use_future_t<Allocator> const& token) noexcept
+            : use_future_t<Allocator>(token)
+        {}
+
+        // map_error_code and then() don't combine.
+        template<typename... T>
+        void then(T&&...) const = delete;
+    };
+
+    // A use_future token with a continuation, made by use_future_t::then.
+    template<typename Allocator, typename Continuation>
+    class use_future_then_t
+    {
+    public:
+
+        use_future_then_t(use_future_t<Allocator> const& token, Continuation c)
+            : token_(token)
+            , continuation_(std::move(c))
+        {}
+
+        Allocator get_allocator() const noexcept
+        {
+            return token_.get_allocator();
+        }
+
+    private:
+
+        template<typename, typename, typename...>
+        friend class then_promise_handler;
+
+        use_future_t<Allocator> token_;
+        Continuation continuation_;
+    };
+
+    template<typename Allocator>
+    constexpr use_future_error_code_t<Allocator> map_error_code(
+        use_future_t<Allocator> const& token) noexcept
+    {
+        return use_future_error_code_t<Allocator>(token);
+    }
+
+    // What a map_error_code token stores for a failed operation. Unlike
+    // std::system_error it doesn't format a message, so recording one is
+    // a small allocation for the exception and nothing is thrown until
+    // someone calls get().
+    class completion_error : public std::exception
+    {
+    public:
+
+        explicit completion_error(std::error_code ec) noexcept
+            : code_(ec)
+        {}
+
+        std::error_code const& code() const noexcept
+        {
+            return code_;
+        }
+
+        char const* what() const noexcept override
+        {
+            return code_.category().name();
+        }
+
+    private:
+
+        std::error_code code_;
+    };
+
 #if defined(_MSC_VER)
     __declspec(selectany) use_future_t<> use_future;
+    __declspec(selectany) use_pooled_future_t use_pooled_future;
 #elif __GNUC__ == 6 && __GNUC_MINOR__ == 1
     const use_future_t<> use_future;
+    const use_pooled_future_t use_pooled_future;
 #else
     constexpr use_future_t<> use_future;
+    constexpr use_pooled_future_t use_pooled_future;
 #endif
 
-    template <typename... Args>
+    template <typename Allocator, typename... Args>
     class promise_handler
     {
     public:
 
-        typedef promise<Args...> promise_type;
+        typedef typename detail::completion_result<Args...>::type result_type;
+        typedef promise<result_type> promise_type;
+
+        // The associated allocator. Executors allocate the operation that
+        // carries the handler with it, so the token's allocator covers
+        // both the operation and the shared state.
+        typedef Allocator allocator_type;
 
-        template<typename Allocator>
         promise_handler(use_future_t<Allocator> const& tag)
             : promise_(std::allocator_arg, tag.get_allocator())
+            , allocator_(tag.get_allocator())
         {}
 
+        allocator_type get_allocator() const noexcept
+        {
+            return allocator_;
+        }
+
         void operator()(Args... args)
         {
-            promise_.set_value(std::move(args)...);
+            detail::completion_result<Args...>::set(promise_, std::move(args)...);
         }
         
         promise_type promise_;
+
+    private:
+
+        allocator_type allocator_;
+    };
+
+    // The handler for a token with a continuation. The continuation is
+    // given what promise_handler would have set and the future gets what
+    // it returns.
+    template <typename Allocator, typename Continuation, typename... Args>
+    class then_promise_handler
+    {
+    public:
+
+        typedef decltype(
+            detail::completion_result<Args...>::call(
+                std::declval<typename Continuation::function_type&>(),
+                std::declval<Args>()...)
+        ) result_type;
+
+        typedef promise<result_type> promise_type;
+        typedef Allocator allocator_type;
+
+        then_promise_handler(use_future_then_t<Allocator, Continuation> token)
+            : promise_(std::allocator_arg, token.get_allocator())
+            , allocator_(token.get_allocator())
+            , continuation_(std::move(token.continuation_))
+        {}
+
+        allocator_type get_allocator() const noexcept
+        {
+            return allocator_;
+        }
+
+        void operator()(Args... args)
+        {
+            continuation_.complete(promise_, allocator_, std::move(args)...);
+        }
+
+        promise_type promise_;
+
+    private:
+
+        allocator_type allocator_;
+        Continuation continuation_;
+    };
+
+    // The handler for a map_error_code token, Args are what follows the
+    // error_code.
+    template <typename Allocator, typename... Args>
+    class error_code_promise_handler : public promise_handler<Allocator, Args...>
+    {
+    public:
+
+        using promise_handler<Allocator, Args...>::promise_handler;
+
+        void operator()(std::error_code const& ec, Args... args)
+        {
+            if(ec)
+            {
+                // make_exception_ptr doesn't need to throw to capture it.
+                this->promise_.set_exception(std::make_exception_ptr(completion_error(ec)));
+                return;
+            }
+
+            promise_handler<Allocator, Args...>::operator()(std::move(args)...);
+        }
     };
 
 } // namespace daily
@@ -80,17 +510,58 @@ namespace std {  namespace experimental
     template<typename Allocator, typename R, typename... Args>
     struct handler_type<daily::use_future_t<Allocator>, R(Args...)>
     {
-        typedef daily::promise_handler<Args...> type;
+        typedef daily::promise_handler<Allocator, Args...> type;
+    };
+
+    template<typename Allocator, typename Continuation, typename R, typename... Args>
+    struct handler_type<daily::use_future_then_t<Allocator, Continuation>, R(Args...)>
+    {
+        typedef daily::then_promise_handler<Allocator, Continuation, Args...> type;
+    };
+
+    template<typename Allocator, typename R, typename... Args>
+    struct handler_type<daily::use_future_error_code_t<Allocator>, R(std::error_code, Args...)>
+    {
+        typedef daily::error_code_promise_handler<Allocator, Args...> type;
+    };
+
+    template <typename Allocator, typename... Args>
+    class async_result<daily::promise_handler<Allocator, Args...>>
+    {
+    public:
+
+        typedef daily::promise_handler<Allocator, Args...> handler_type;
+        typedef typename handler_type::promise_type promise_type;
+        typedef daily::future<typename handler_type::result_type> type;
+
+        async_result(handler_type& handler)
+            : future_(handler.promise_.get_future())
+        {}
+
+        type get() { return std::move(future_); }
+
+    private:
+
+        type future_;
+    };
+
+    template <typename Allocator, typename... Args>
+    class async_result<daily::error_code_promise_handler<Allocator, Args...>>
+        : public async_result<daily::promise_handler<Allocator, Args...>>
+    {
+    public:
+
+        using async_result<daily::promise_handler<Allocator, Args...>>::async_result;
     };
 
-    template <typename... Args>
-    class async_result<daily::promise_handler<Args...>>
+    template <typename Allocator, typename Continuation, typename... Args>
+    class async_result<daily::then_promise_handler<Allocator, Continuation, Args...>>
     {
     public:
 
-        typedef daily::promise_handler<Args...> handler_type;
-        typedef daily::promise<Args...> promise_type;
-        typedef daily::future<Args...> type;
+        typedef daily::then_promise_handler<Allocator, Continuation, Args...> handler_type;
+        typedef typename handler_type::promise_type promise_type;
+        typedef daily::future<typename handler_type::result_type> type;
 
         async_result(handler_type& handler)
             : future_(handler.promise_.get_future())
@@ -375,4 +375,37 @@ BOOST_AUTO_TEST_CASE( future_alloc_set_get_chain_continuation )
     BOOST_TEST_CHECK(get_ran == false);
     BOOST_TEST_CHECK(f3.get() == 4);
     BOOST_TEST_CHECK(get_ran == true);
-}
\ No newline at end of file
+}
+
+BOOST_AUTO_TEST_CASE( future_recycled_promise )
+{
+    daily::promise<int> p;
+    daily::future<int> f;
+    CheckAllocations check;
+    for(int i = 0; i < 100; ++i)
+    {
+        f = p.get_future();
+        p.set_value(i);
+        BOOST_TEST_CHECK(f.get() == i);
+        f = daily::future<int>();
+        BOOST_TEST_CHECK(p.recycle());
+    }
+}
+
+BOOST_AUTO_TEST_CASE( future_alloc_packaged_task )
+{
+    LinearAllocator<char> alloc;
+    CheckAllocations check;
+    char large[128] = { 1 };
+    daily::packaged_task<int(int)> pt(
+        std::allocator_arg, alloc,
+        [large](int i) { return large[0] + i; });
+    daily::packaged_task<int(int)> moved(std::move(pt));
+    daily::future<int> f = moved.get_future();
+    moved(1);
+    BOOST_TEST_CHECK(f.get() == 2);
+    moved.reset();
+    f = moved.get_future();
+    moved(2);
+    BOOST_TEST_CHECK(f.get() == 3);
+}
@@ -0,0 +1,168 @@
+// ****************************************************************************
+// daily/future/test/chain_arena.cpp
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#define BOOST_TEST_MODULE ChainArena
+#include <boost/test/unit_test.hpp>
+#include "daily/future/future.hpp"
+#include "daily/future/chain_arena.hpp"
+#include "test_thread_pool.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+namespace {
+
+    std::atomic<long> live_allocations(0);
+
+    int add_one(int i)
+    {
+        return i + 1;
+    }
+
+    std::string to_string(int i)
+    {
+        return std::to_string(i);
+    }
+}
+
+// Tracks everything that reaches the system so the arena's blocks can be
+// seen going away.
+void* operator new(std::size_t size)
+{
+    void* p = std::malloc(size ? size : 1);
+    if(!p)
+        throw std::bad_alloc();
+    ++live_allocations;
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    if(p)
+    {
+        --live_allocations;
+        std::free(p);
+    }
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    operator delete(p);
+}
+
+BOOST_AUTO_TEST_CASE( chain_arena_whole_chain )
+{
+    long const before = live_allocations;
+    long during = 0;
+    std::size_t root_bytes = 0;
+    std::size_t chain_bytes = 0;
+    {
+        auto pa = daily::make_arena_promise<int>(4096);
+        root_bytes = pa.second.bytes_allocated();
+        daily::future<std::string> f = pa.first.get_future()
+            .then(daily::continue_on::any, add_one, pa.second)
+            .then(daily::continue_on::get, add_one, pa.second)
+            .then(daily::continue_on::any, to_string, pa.second);
+        chain_bytes = pa.second.bytes_allocated();
+        during = live_allocations - before;
+        pa.first.set_value(1);
+        BOOST_TEST_CHECK(f.get() == "3");
+        BOOST_TEST_CHECK(pa.second.bytes_reserved() == 4096u);
+    }
+
+    // One block for the whole chain, gone with it.
+    BOOST_TEST_CHECK(root_bytes > 0u);
+    BOOST_TEST_CHECK(chain_bytes > root_bytes);
+    BOOST_TEST_CHECK(during == 1);
+    BOOST_TEST_CHECK(live_allocations == before);
+}
+
+BOOST_AUTO_TEST_CASE( chain_arena_outlives_promise )
+{
+    long const before = live_allocations;
+    daily::future<int> f;
+    {
+        auto pa = daily::make_arena_promise<int>();
+        f = pa.first.get_future().then(daily::continue_on::any, add_one, pa.second);
+        pa.first.set_value(1);
+    }
+
+    BOOST_TEST_CHECK(live_allocations > before);
+    BOOST_TEST_CHECK(f.get() == 2);
+    f = daily::future<int>();
+    BOOST_TEST_CHECK(live_allocations == before);
+}
+
+// The future drops the root's alias before its own leaf state, so the
+// arena has to survive the root's memory being freed first.
+BOOST_AUTO_TEST_CASE( chain_arena_root_freed_first )
+{
+    long const before = live_allocations;
+    {
+        daily::future<int> f;
+        {
+            auto pa = daily::make_arena_promise<int>();
+            f = pa.first.get_future().then(daily::continue_on::any, add_one, pa.second);
+            pa.first.set_value(1);
+        }
+
+        BOOST_TEST_CHECK(f.get() == 2);
+    }
+
+    BOOST_TEST_CHECK(live_allocations == before);
+}
+
+BOOST_AUTO_TEST_CASE( chain_arena_grows )
+{
+    long const before = live_allocations;
+    {
+        auto pa = daily::make_arena_promise<int>(256);
+        daily::future<int> f = pa.first.get_future();
+        for(int i = 0; i < 32; ++i)
+            f = f.then(daily::continue_on::any, add_one, pa.second);
+
+        BOOST_TEST_CHECK(pa.second.bytes_reserved() > 256u);
+        BOOST_TEST_CHECK(pa.second.bytes_allocated() <= pa.second.bytes_reserved());
+        pa.first.set_value(0);
+        BOOST_TEST_CHECK(f.get() == 32);
+    }
+
+    BOOST_TEST_CHECK(live_allocations == before);
+}
+
+BOOST_AUTO_TEST_CASE( chain_arena_executor_continuations )
+{
+    long const before = live_allocations;
+    {
+        test_thread_pool pool(2);
+        {
+            auto pa = daily::make_arena_promise<int>();
+            daily::future<int> f = pa.first.get_future()
+                .then(daily::execute::post, pool, add_one, pa.second)
+                .then(daily::execute::dispatch, pool, add_one, pa.second);
+            pa.first.set_value(0);
+            BOOST_TEST_CHECK(f.get() == 2);
+        }
+
+        pool.join();
+    }
+
+    BOOST_TEST_CHECK(live_allocations == before);
+}
+
+BOOST_AUTO_TEST_CASE( chain_arena_allocator_equality )
+{
+    auto a = daily::make_arena_promise<void>();
+    auto b = daily::make_arena_promise<void>();
+    BOOST_TEST_CHECK((a.second == daily::chain_arena_allocator<int>(a.second)));
+    BOOST_TEST_CHECK((a.second != b.second));
+}
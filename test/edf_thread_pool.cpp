@@ -0,0 +1,192 @@
+// ****************************************************************************
+// daily/future/test/edf_thread_pool.cpp
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#define BOOST_TEST_MODULE EdfThreadPool
+#include <boost/test/unit_test.hpp>
+#include "daily/future/future.hpp"
+#include "daily/future/edf_thread_pool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+    // Blocks the pool's only thread until released so work can be queued
+    // up behind it.
+    struct gate
+    {
+        gate(daily::edf_thread_pool& pool)
+        {
+            std::promise<void> started;
+            std::future<void> s = started.get_future();
+            std::shared_future<void> f = release_.get_future().share();
+            pool.get_executor().post(
+                [f, started = std::move(started)]() mutable
+                {
+                    started.set_value();
+                    f.wait();
+                }
+            );
+            s.wait();
+        }
+
+        void open()
+        {
+            release_.set_value();
+        }
+
+        std::promise<void> release_;
+    };
+}
+
+BOOST_AUTO_TEST_CASE( edf_order )
+{
+    daily::edf_thread_pool pool(1);
+    gate g(pool);
+    auto now = daily::deadline_clock::now();
+    std::vector<int> order;
+    for(int i : { 3, 1, 4, 0, 2 })
+    {
+        pool.get_executor()
+            .with_deadline(now + std::chrono::seconds(i))
+            .post([&order, i] { order.push_back(i); });
+    }
+
+    g.open();
+    pool.join();
+    BOOST_TEST_CHECK(order == (std::vector<int>{ 0, 1, 2, 3, 4 }), boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE( edf_inherit_deadline )
+{
+    daily::edf_thread_pool pool(2);
+    auto deadline = daily::deadline_clock::now() + std::chrono::seconds(1);
+    daily::promise<int> p;
+    daily::future<daily::deadline_clock::time_point> f;
+    {
+        daily::deadline_scope scope(deadline);
+        pool.get_executor().post([&p] { p.set_value(1); });
+        f = p.get_future().then(
+            daily::execute::post,
+            pool.get_executor(),
+            [](int)
+            {
+                return daily::deadline_scope::current();
+            }
+        );
+    }
+
+    bool inherited = f.get() == deadline;
+    bool restored = daily::deadline_scope::current() == daily::deadline_clock::time_point::max();
+    BOOST_TEST_CHECK(inherited == true);
+    BOOST_TEST_CHECK(restored == true);
+}
+
+BOOST_AUTO_TEST_CASE( edf_drop_expired )
+{
+    daily::edf_thread_pool pool(1, daily::expired_work::drop);
+    gate g(pool);
+    std::atomic<int> ran(0);
+    auto now = daily::deadline_clock::now();
+    pool.get_executor().with_deadline(now).post([&ran] { ++ran; });
+    pool.get_executor().with_timeout(std::chrono::hours(1)).post([&ran] { ++ran; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    g.open();
+    pool.join();
+    BOOST_TEST_CHECK(ran == 1);
+    BOOST_TEST_CHECK(pool.num_expired() == 1);
+}
+
+BOOST_AUTO_TEST_CASE( edf_drop_expired_breaks_promise )
+{
+    daily::edf_thread_pool pool(1, daily::expired_work::drop);
+    daily::promise<int> p;
+    daily::future<int> f = p.get_future().then(
+        daily::execute::post,
+        pool.get_executor().with_deadline(daily::deadline_clock::now()),
+        [](int r) { return r + 1; }
+    );
+
+    daily::promise<void> q;
+    daily::future<void> g = q.get_future();
+    pool.get_executor().with_deadline(daily::deadline_clock::now()).post(
+        [q = std::move(q)]() mutable { q.set_value(); }
+    );
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    p.set_value(1);
+    pool.join();
+    BOOST_TEST_CHECK(pool.num_expired() == 2);
+    BOOST_CHECK_EXCEPTION(
+        f.get(), daily::future_error,
+        [](daily::future_error const& e) { return e.code() == daily::future_errc::broken_promise; }
+    );
+    BOOST_CHECK_THROW(g.get(), daily::future_error);
+}
+
+BOOST_AUTO_TEST_CASE( edf_continuation_throws )
+{
+    daily::edf_thread_pool pool(1);
+    daily::promise<int> p;
+    daily::future<int> f = p.get_future().then(
+        daily::execute::post,
+        pool.get_executor(),
+        [](int) -> int { throw std::runtime_error("failed"); }
+    );
+
+    p.set_value(1);
+    BOOST_CHECK_THROW(f.get(), std::runtime_error);
+
+    // The worker survived the throw.
+    daily::promise<void> q;
+    daily::future<void> g = q.get_future();
+    pool.get_executor().post([&q] { q.set_value(); });
+    g.get();
+    pool.join();
+}
+
+BOOST_AUTO_TEST_CASE( edf_executor_equality )
+{
+    daily::edf_thread_pool pool(1);
+    auto now = daily::deadline_clock::now();
+    auto ex = pool.get_executor();
+    BOOST_TEST_CHECK((ex == pool.get_executor()));
+    BOOST_TEST_CHECK((ex.with_deadline(now) == ex.with_deadline(now)));
+    BOOST_TEST_CHECK((ex.with_deadline(now) != ex.with_deadline(now + std::chrono::seconds(1))));
+    BOOST_TEST_CHECK((ex != ex.with_deadline(now)));
+}
+
+BOOST_AUTO_TEST_CASE( edf_stress )
+{
+    daily::edf_thread_pool pool(4);
+    std::atomic<int> count(0);
+    std::vector<std::thread> producers;
+    for(int i = 0; i < 4; ++i)
+    {
+        producers.emplace_back([&pool, &count, i]
+        {
+            for(int j = 0; j < 10000; ++j)
+            {
+                pool.get_executor()
+                    .with_timeout(std::chrono::microseconds((i * j) % 997))
+                    .post([&count] { ++count; });
+            }
+        });
+    }
+
+    for(auto&& t : producers)
+        t.join();
+
+    pool.join();
+    BOOST_TEST_CHECK(count == 40000);
+}
@@ -18,6 +18,8 @@
 #include <boost/mpl/vector.hpp>
 #include <boost/thread/executors/thread_executor.hpp>
 #include "daily/future/future.hpp"
+#include "test_thread_pool.hpp"
+#include <atomic>
 #include <thread>
 
 template<typename T>
@@ -405,6 +407,32 @@ BOOST_AUTO_TEST_CASE( future_multithread_get_continuation )
     }	
 }
 
+BOOST_AUTO_TEST_CASE( future_multithread_any_continuation )
+{
+    boost::executors::thread_executor pool;
+    int repeat = 100;
+    while(repeat--)
+    {
+        std::atomic<int> runs(0);
+        daily::promise<int> p;
+        daily::future<int> f = p.get_future();
+        auto f2 = f.then(daily::continue_on::any, [&runs](int v) { ++runs; return v * 2; });
+        pool.submit([&p, repeat] { p.set_value(repeat); });
+        BOOST_TEST_CHECK(f2.get() == (2 * repeat));
+        BOOST_TEST_CHECK(runs == 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( future_any_continuation_runs_once )
+{
+    int runs = 0;
+    daily::promise<int> p;
+    auto f = p.get_future().then(daily::continue_on::any, [&runs](int v) { ++runs; return v; });
+    p.set_value(1);
+    BOOST_TEST_CHECK(f.get() == 1);
+    BOOST_TEST_CHECK(runs == 1);
+}
+
 BOOST_AUTO_TEST_CASE( promise_future_get_throws )
 {
     // We don't need to test each specialization here because
@@ -511,6 +539,174 @@ BOOST_AUTO_TEST_CASE(future_wait)
     run_delayed.join();
 }
 
+BOOST_AUTO_TEST_CASE(future_observers)
+{
+    daily::promise<void> promise;
+    daily::future<void> future = promise.get_future();
+    BOOST_TEST_CHECK(future.valid());
+    BOOST_TEST_CHECK(!future.is_ready());
+    BOOST_TEST_CHECK(!future.has_value());
+    BOOST_TEST_CHECK(!future.has_exception());
+    promise.set_value();
+    BOOST_TEST_CHECK(future.is_ready());
+    BOOST_TEST_CHECK(future.has_value());
+    BOOST_TEST_CHECK(!future.has_exception());
+    future.get();
+    BOOST_TEST_CHECK(!future.valid());
+}
+
+BOOST_AUTO_TEST_CASE(future_try_get)
+{
+    daily::promise<int> promise;
+    daily::future<int> future = promise.get_future();
+    BOOST_TEST_CHECK(!future.try_get());
+    BOOST_TEST_CHECK(future.valid());
+    promise.set_value(5);
+    boost::optional<int> result = future.try_get();
+    BOOST_TEST_CHECK((result && *result == 5));
+    BOOST_TEST_CHECK(!future.valid());
+
+    int i = 0;
+    daily::promise<int&> ref_promise;
+    daily::future<int&> ref_future = ref_promise.get_future();
+    BOOST_TEST_CHECK(!ref_future.try_get());
+    ref_promise.set_value(i);
+    boost::optional<int&> ref_result = ref_future.try_get();
+    BOOST_TEST_CHECK((ref_result && &*ref_result == &i));
+
+    daily::promise<void> void_promise;
+    daily::future<void> void_future = void_promise.get_future();
+    BOOST_TEST_CHECK(!void_future.try_get());
+    void_promise.set_value();
+    BOOST_TEST_CHECK(void_future.try_get());
+}
+
+BOOST_AUTO_TEST_CASE(future_try_get_throws)
+{
+    daily::promise<std::unique_ptr<int>> promise;
+    daily::future<std::unique_ptr<int>> future = promise.get_future();
+    promise.set_exception(std::make_exception_ptr(std::runtime_error("failed")));
+    BOOST_TEST_CHECK(future.has_exception());
+    BOOST_TEST_CHECK(!future.has_value());
+    BOOST_CHECK_THROW(future.try_get(), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(future_poll_is_ready)
+{
+    daily::promise<int> promise;
+    daily::future<int> future = promise.get_future();
+    std::thread run_delayed([&]
+    {
+        promise.set_value(5);
+    });
+    while(!future.is_ready())
+        std::this_thread::yield();
+    BOOST_TEST_CHECK(*future.try_get() == 5);
+    run_delayed.join();
+}
+
+BOOST_AUTO_TEST_CASE(promise_recycle)
+{
+    daily::promise<int> promise;
+    BOOST_TEST_CHECK(promise.generation() == 0);
+    for(int i = 0; i < 3; ++i)
+    {
+        daily::future<int> future = promise.get_future();
+        BOOST_TEST_CHECK(!promise.recycle());
+        promise.set_value(i);
+        BOOST_TEST_CHECK(future.get() == i);
+        // Still held by the future, even though it's been retrieved.
+        BOOST_TEST_CHECK(!promise.recycle());
+        future = daily::future<int>();
+        BOOST_TEST_CHECK(promise.recycle());
+        BOOST_TEST_CHECK(promise.generation() == static_cast<unsigned>(i + 1));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(promise_recycle_continuation)
+{
+    daily::promise<int> promise;
+    for(int i = 0; i < 3; ++i)
+    {
+        daily::future<int> future = promise.get_future().then(
+            daily::continue_on::set, [](int v) { return v * 2; });
+        BOOST_TEST_CHECK(!promise.recycle());
+        promise.set_value(i);
+        BOOST_TEST_CHECK(future.get() == i * 2);
+        future = daily::future<int>();
+        BOOST_TEST_CHECK(promise.recycle());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(promise_recycle_clears_state)
+{
+    daily::promise<std::unique_ptr<int>> promise;
+    daily::future<std::unique_ptr<int>> future = promise.get_future();
+    promise.set_exception(std::make_exception_ptr(std::runtime_error("failed")));
+    future = daily::future<std::unique_ptr<int>>();
+    BOOST_TEST_CHECK(promise.recycle());
+
+    future = promise.get_future();
+    BOOST_TEST_CHECK(!future.is_ready());
+    BOOST_TEST_CHECK(!future.has_exception());
+    promise.set_value(std::make_unique<int>(5));
+    BOOST_TEST_CHECK(*future.get() == 5);
+
+    // Dropping an unsatisfied round doesn't break the promise.
+    future = daily::future<std::unique_ptr<int>>();
+    BOOST_TEST_CHECK(promise.recycle());
+    future = promise.get_future();
+    future = daily::future<std::unique_ptr<int>>();
+    BOOST_TEST_CHECK(promise.recycle());
+    future = promise.get_future();
+    BOOST_TEST_CHECK(!future.is_ready());
+}
+
+BOOST_AUTO_TEST_CASE(promise_recycle_across_threads)
+{
+    daily::promise<int> promise;
+    int repeat = 1000;
+    while(repeat--)
+    {
+        daily::future<int> future = promise.get_future();
+        std::thread consumer([f = std::move(future), repeat]() mutable
+        {
+            BOOST_CHECK(f.get() == repeat);
+        });
+        promise.set_value(repeat);
+        consumer.join();
+        BOOST_CHECK(promise.recycle());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(executor_continuation_releases_chain)
+{
+    test_thread_pool pool(1);
+    std::shared_ptr<int> captured = std::make_shared<int>(1);
+    std::weak_ptr<int> alive = captured;
+    {
+        // Never satisfied, the promise breaks.
+        daily::promise<int> p;
+        auto f = p.get_future().then(
+            daily::execute::post, pool, [captured](int i) { return i + *captured; });
+        captured.reset();
+    }
+    BOOST_TEST_CHECK(alive.expired());
+
+    captured = std::make_shared<int>(1);
+    alive = captured;
+    {
+        daily::promise<int> p;
+        auto f = p.get_future().then(
+            daily::execute::post, pool, [captured](int i) { return i + *captured; });
+        captured.reset();
+        p.set_value(1);
+        BOOST_TEST_CHECK(f.get() == 2);
+    }
+    pool.join();
+    BOOST_TEST_CHECK(alive.expired());
+}
+
 // The following tests were lifted from 
 // https://github.com/skarupke/compile_time/blob/master/await/then_future.cpp
 // as a few edge cases I missed.
@@ -0,0 +1,114 @@
+// ****************************************************************************
+// daily/future/test/introspection.cpp
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#define DAILY_FUTURE_ENABLE_INTROSPECTION
+#define DAILY_FUTURE_INTROSPECTION_SLOTS 8
+#define BOOST_TEST_MODULE Introspection
+#include <boost/test/unit_test.hpp>
+#include "daily/future/future.hpp"
+#include "test_thread_pool.hpp"
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+
+BOOST_AUTO_TEST_CASE( introspection_pending_chain )
+{
+    BOOST_TEST_CHECK(daily::get_pending_futures().empty());
+
+    daily::promise<int> p;
+    daily::future<int> f;
+    {
+        daily::creation_site_scope site("stalled_chain");
+        f = p.get_future().then(daily::continue_on::any, [](int i) { return i + 1; });
+    }
+
+    auto pending = daily::get_pending_futures();
+    BOOST_TEST_REQUIRE(pending.size() == 2u);
+
+    // Oldest first, and the continuation waits on the promise.
+    BOOST_TEST_CHECK(std::string(pending[0].policy) == "promise");
+    BOOST_TEST_CHECK(pending[0].site == nullptr);
+    BOOST_TEST_CHECK(std::string(pending[1].policy) == "continue_on::any");
+    BOOST_TEST_CHECK(std::string(pending[1].site) == "stalled_chain");
+    BOOST_TEST_CHECK(pending[1].parent == pending[0].state);
+    BOOST_TEST_CHECK(pending[0].age.count() >= pending[1].age.count());
+
+    BOOST_TEST_CHECK(daily::get_pending_futures(1).size() == 1u);
+
+    p.set_value(1);
+    BOOST_TEST_CHECK(daily::get_pending_futures().empty());
+    BOOST_TEST_CHECK(f.get() == 2);
+}
+
+BOOST_AUTO_TEST_CASE( introspection_blocked_waiters )
+{
+    daily::promise<void> p;
+    daily::future<void> f = p.get_future();
+    std::thread waiter([&f] { f.wait(); });
+
+    while(daily::get_pending_futures().empty() ||
+          daily::get_pending_futures()[0].blocked_waiters == 0)
+    {
+        std::this_thread::yield();
+    }
+
+    std::stringstream dump;
+    daily::dump_pending_futures(dump);
+    BOOST_TEST_CHECK(dump.str().find("blocked_waiters=1") != std::string::npos);
+    BOOST_TEST_CHECK(dump.str().find("policy=promise") != std::string::npos);
+
+    p.set_value();
+    waiter.join();
+    BOOST_TEST_CHECK(daily::get_pending_futures().empty());
+}
+
+BOOST_AUTO_TEST_CASE( introspection_slots_released )
+{
+    test_thread_pool pool(1);
+    for(int i = 0; i < 100; ++i)
+    {
+        daily::promise<int> p;
+        daily::future<int> f = p.get_future()
+            .then(daily::execute::post, pool, [](int i) { return i + 1; });
+        BOOST_TEST_CHECK(daily::get_pending_futures().size() == 2u);
+        p.set_value(i);
+        BOOST_TEST_CHECK(f.get() == i + 1);
+    }
+    pool.join();
+
+    // More states than slots, but never more live at once.
+    std::stringstream dump;
+    daily::dump_pending_futures(dump);
+    BOOST_TEST_CHECK(dump.str().find("registry full") == std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE( introspection_registry_full )
+{
+    std::vector<daily::promise<int>> promises(10);
+    std::stringstream dump;
+    daily::dump_pending_futures(dump, 3);
+    BOOST_TEST_CHECK(daily::get_pending_futures().size() == 8u);
+    BOOST_TEST_CHECK(dump.str().find("oldest 3") != std::string::npos);
+    BOOST_TEST_CHECK(dump.str().find("(2 states not tracked, registry full)") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE( introspection_registry_recovers )
+{
+    {
+        std::vector<daily::promise<int>> promises(10);
+        BOOST_TEST_CHECK(daily::get_pending_futures().size() == 8u);
+    }
+
+    // Freed slots are reserved again once the table drains.
+    std::vector<daily::promise<int>> promises(8);
+    BOOST_TEST_CHECK(daily::get_pending_futures().size() == 8u);
+}
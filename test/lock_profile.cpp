@@ -0,0 +1,103 @@
+// ****************************************************************************
+// daily/future/test/lock_profile.cpp
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#define DAILY_FUTURE_ENABLE_LOCK_PROFILING
+#define BOOST_TEST_MODULE LockProfile
+#include <boost/test/unit_test.hpp>
+#include "daily/future/future.hpp"
+#include "test_thread_pool.hpp"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+BOOST_AUTO_TEST_CASE( lock_profile_sites )
+{
+    daily::promise<int> p;
+    daily::future<int> f = p.get_future()
+        .then(daily::continue_on::any, [](int i) { return i + 1; });
+    BOOST_TEST_CHECK(!f.is_ready());
+    p.set_value(0);
+    BOOST_TEST_CHECK(f.get() == 1);
+
+    daily::lock_profile profile = f.chain_lock_profile();
+    BOOST_TEST_CHECK(profile[daily::lock_site::then].acquisitions == 1);
+    BOOST_TEST_CHECK(profile[daily::lock_site::set_value].acquisitions == 1);
+    BOOST_TEST_CHECK(profile[daily::lock_site::continuation].acquisitions == 1);
+    BOOST_TEST_CHECK(profile[daily::lock_site::get].acquisitions == 1);
+    // The observers read the state without locking.
+    BOOST_TEST_CHECK(profile.total().acquisitions == 4);
+    BOOST_TEST_CHECK(profile.total().contended_acquisitions == 0);
+
+    // The promise sees the same chain.
+    BOOST_TEST_CHECK(
+        p.chain_lock_profile().total().acquisitions == profile.total().acquisitions);
+}
+
+BOOST_AUTO_TEST_CASE( lock_profile_executor_continuation )
+{
+    test_thread_pool pool(1);
+    {
+        daily::promise<int> p;
+        daily::future<int> f = p.get_future()
+            .then(daily::execute::post, pool, [](int i) { return i + 1; });
+        p.set_value(0);
+        BOOST_TEST_CHECK(f.get() == 1);
+        BOOST_TEST_CHECK(
+            f.chain_lock_profile()[daily::lock_site::continuation].acquisitions == 1);
+    }
+    pool.join();
+}
+
+BOOST_AUTO_TEST_CASE( lock_profile_blocked_get_excludes_wait )
+{
+    daily::promise<int> p;
+    daily::future<int> f = p.get_future();
+    std::thread setter([&p]
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        p.set_value(1);
+    });
+
+    BOOST_TEST_CHECK(f.get() == 1);
+    setter.join();
+
+    // The condition variable releases the mutex while blocked, so the
+    // 20ms sleep shows up as neither hold nor wait time.
+    daily::lock_profile profile = f.chain_lock_profile();
+    BOOST_TEST_CHECK(profile[daily::lock_site::get].acquisitions >= 2);
+    BOOST_TEST_CHECK(profile[daily::lock_site::get].hold_ns < 10000000);
+}
+
+BOOST_AUTO_TEST_CASE( lock_profile_global_total )
+{
+    daily::lock_profile before = daily::get_lock_profile();
+    {
+        daily::promise<void> p;
+        daily::future<void> f = p.get_future();
+        p.set_value();
+        f.get();
+    }
+
+    daily::lock_profile after = daily::get_lock_profile();
+    BOOST_TEST_CHECK(
+        after[daily::lock_site::set_value].acquisitions -
+        before[daily::lock_site::set_value].acquisitions == 1);
+    BOOST_TEST_CHECK(
+        after[daily::lock_site::get].acquisitions -
+        before[daily::lock_site::get].acquisitions == 1);
+}
+
+BOOST_AUTO_TEST_CASE( lock_profile_names )
+{
+    BOOST_TEST_CHECK(daily::lock_profiling_enabled);
+    BOOST_TEST_CHECK(
+        std::string(daily::lock_site_name(daily::lock_site::continuation)) == "continuation");
+}
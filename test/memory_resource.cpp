@@ -0,0 +1,147 @@
+// ****************************************************************************
+// daily/future/test/memory_resource.cpp
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#define DAILY_FUTURE_USE_MEMORY_RESOURCE
+#define BOOST_TEST_MODULE MemoryResource
+#include <boost/test/unit_test.hpp>
+#include "daily/future/future.hpp"
+#include "daily/future/memory_resource.hpp"
+#include "test_thread_pool.hpp"
+
+#include <cstddef>
+#include <memory_resource>
+#include <thread>
+
+namespace {
+
+    // Counts what passes through to the upstream resource.
+    class counting_resource : public std::pmr::memory_resource
+    {
+    public:
+
+        std::size_t allocations = 0;
+        std::size_t deallocations = 0;
+        std::size_t live_bytes = 0;
+
+    private:
+
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override
+        {
+            ++allocations;
+            live_bytes += bytes;
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+
+        void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+        {
+            ++deallocations;
+            live_bytes -= bytes;
+            std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+        }
+
+        bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override
+        {
+            return this == &other;
+        }
+    };
+
+    int add_one(int i)
+    {
+        return i + 1;
+    }
+}
+
+BOOST_AUTO_TEST_CASE( memory_resource_thread_default )
+{
+    BOOST_TEST_CHECK(daily::get_future_memory_resource() == std::pmr::get_default_resource());
+
+    counting_resource resource;
+    {
+        daily::future_memory_resource_scope scope(&resource);
+        BOOST_TEST_CHECK(daily::get_future_memory_resource() == &resource);
+
+        daily::promise<int> p;
+        daily::future<int> f = p.get_future()
+            .then(daily::continue_on::any, add_one)
+            .then(add_one);
+        BOOST_TEST_CHECK(resource.allocations == 3u);
+        p.set_value(0);
+        BOOST_TEST_CHECK(f.get() == 2);
+    }
+
+    BOOST_TEST_CHECK(daily::get_future_memory_resource() == std::pmr::get_default_resource());
+    BOOST_TEST_CHECK(resource.deallocations == 3u);
+    BOOST_TEST_CHECK(resource.live_bytes == 0u);
+}
+
+BOOST_AUTO_TEST_CASE( memory_resource_scope_is_per_thread )
+{
+    counting_resource resource;
+    daily::future_memory_resource_scope scope(&resource);
+    std::thread other([]
+    {
+        daily::promise<void> p;
+        p.set_value();
+    });
+    other.join();
+
+    BOOST_TEST_CHECK(resource.allocations == 0u);
+}
+
+BOOST_AUTO_TEST_CASE( memory_resource_freed_on_other_thread )
+{
+    counting_resource resource;
+    test_thread_pool pool(1);
+    {
+        daily::future<int> f;
+        {
+            daily::future_memory_resource_scope scope(&resource);
+            daily::promise<int> p;
+            f = p.get_future().then(daily::execute::post, pool, add_one);
+            p.set_value(0);
+        }
+
+        // Released outside the scope, still returned to the arena.
+        BOOST_TEST_CHECK(f.get() == 1);
+    }
+    pool.join();
+    BOOST_TEST_CHECK(resource.allocations >= 2u);
+    BOOST_TEST_CHECK(resource.live_bytes == 0u);
+}
+
+BOOST_AUTO_TEST_CASE( memory_resource_monotonic_arena )
+{
+    alignas(std::max_align_t) char buffer[4096];
+    counting_resource upstream;
+    {
+        std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer), &upstream);
+        daily::future_memory_resource_scope scope(&arena);
+        for(int i = 0; i < 4; ++i)
+        {
+            daily::promise<int> p;
+            daily::future<int> f = p.get_future().then(add_one);
+            p.set_value(i);
+            BOOST_TEST_CHECK(f.get() == i + 1);
+        }
+    }
+
+    BOOST_TEST_CHECK(upstream.allocations == 0u);
+}
+
+BOOST_AUTO_TEST_CASE( memory_resource_explicit_allocator )
+{
+    counting_resource resource;
+    daily::resource_allocator<void> alloc(&resource);
+    daily::promise<int> p(std::allocator_arg, alloc);
+    daily::future<int> f = p.get_future().then(daily::continue_on::get, add_one, alloc);
+    p.set_value(1);
+    BOOST_TEST_CHECK(f.get() == 2);
+    BOOST_TEST_CHECK(resource.allocations == 2u);
+}
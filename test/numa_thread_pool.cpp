@@ -0,0 +1,87 @@
+// ****************************************************************************
+// daily/future/test/numa_thread_pool.cpp
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#define BOOST_TEST_MODULE NumaThreadPool
+#include <boost/test/unit_test.hpp>
+#include "daily/future/future.hpp"
+#include "daily/future/numa_thread_pool.hpp"
+
+#include <atomic>
+#include <vector>
+
+namespace {
+
+    // Two nodes sharing cpu 0 so the test runs anywhere.
+    daily::numa_topology two_nodes()
+    {
+        std::vector<std::vector<unsigned>> node_cpus = { { 0 }, { 0 } };
+        return daily::numa_topology(node_cpus);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( numa_system_topology )
+{
+    daily::numa_topology const& topology = daily::numa_topology::system();
+    BOOST_TEST_CHECK(topology.num_nodes() >= 1u);
+    for(std::size_t i = 0; i < topology.num_nodes(); ++i)
+    {
+        BOOST_TEST_CHECK(topology.cpus(i).empty() == false);
+        BOOST_TEST_CHECK(topology.steal_order(i).size() == topology.num_nodes() - 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( numa_allocator_reuse )
+{
+    daily::numa_thread_pool pool(two_nodes(), 1);
+    daily::numa_allocator<int> alloc = pool.get_executor(1).get_allocator<int>();
+    BOOST_TEST_CHECK(alloc.node() == 1u);
+    int* a = alloc.allocate(4);
+    alloc.deallocate(a, 4);
+    int* b = alloc.allocate(4);
+    BOOST_TEST_CHECK(a == b);
+    alloc.deallocate(b, 4);
+    BOOST_TEST_CHECK((alloc != pool.get_executor(0).get_allocator<int>()));
+}
+
+BOOST_AUTO_TEST_CASE( numa_continuation )
+{
+    daily::numa_thread_pool pool(two_nodes(), 2);
+    std::vector<daily::future<int>> futures;
+    std::vector<daily::promise<int>> promises;
+    for(std::size_t i = 0; i < 100; ++i)
+    {
+        auto ex = pool.get_executor(i % pool.num_nodes());
+        promises.emplace_back(std::allocator_arg, ex.get_allocator());
+        futures.push_back(promises.back().get_future().then(
+            daily::execute::post,
+            ex,
+            [](int v) { return v * 2; },
+            ex.get_allocator()
+        ));
+    }
+
+    for(auto&& p : promises)
+        p.set_value(2);
+
+    for(auto&& f : futures)
+        BOOST_TEST_CHECK(f.get() == 4);
+}
+
+BOOST_AUTO_TEST_CASE( numa_steal )
+{
+    daily::numa_thread_pool pool(two_nodes(), 1);
+    std::atomic<int> count(0);
+    auto ex = pool.get_executor(0);
+    for(int i = 0; i < 10000; ++i)
+        ex.post([&count] { ++count; });
+
+    pool.join();
+    BOOST_TEST_CHECK(count == 10000);
+}
@@ -12,10 +12,142 @@
 #include <boost/test/unit_test.hpp>
 #include "daily/future/future.hpp"
 
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+
+static std::atomic<std::size_t> num_allocations(0);
+void * operator new(size_t size)
+{
+    ++num_allocations;
+    return malloc(size);
+}
+void operator delete(void * ptr) noexcept
+{
+    free(ptr);
+}
+void operator delete(void * ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
 BOOST_AUTO_TEST_CASE( packaged_task )
 {
 	daily::packaged_task<int(int)> pt([](int i) { return i * 2; });
 	daily::future<int> f = pt.get_future();
 	pt(5);
 	BOOST_TEST_CHECK(f.get() == 10);
-} 
\ No newline at end of file
+}
+
+BOOST_AUTO_TEST_CASE( packaged_task_void )
+{
+    bool ran = false;
+    daily::packaged_task<void()> pt([&ran] { ran = true; });
+    daily::future<void> f = pt.get_future();
+    pt();
+    BOOST_TEST_CHECK(ran);
+    BOOST_TEST_CHECK(f.has_value());
+}
+
+BOOST_AUTO_TEST_CASE( packaged_task_throws )
+{
+    daily::packaged_task<int()> pt([]() -> int { throw std::runtime_error("failed"); });
+    daily::future<int> f = pt.get_future();
+    pt();
+    BOOST_CHECK_THROW(f.get(), std::runtime_error);
+    BOOST_CHECK_THROW(pt(), daily::future_error);
+}
+
+BOOST_AUTO_TEST_CASE( packaged_task_continuation_throws )
+{
+    daily::packaged_task<int()> pt([] { return 1; });
+    daily::future<int> f2 = pt.get_future().then(
+        daily::continue_on::set,
+        [](int) -> int { throw std::runtime_error("failed"); }
+    );
+    // The continuation's exception reaches the caller as it would from
+    // promise::set_value, rather than being set on the satisfied promise.
+    BOOST_CHECK_THROW(pt(), std::runtime_error);
+    BOOST_CHECK_THROW(f2.get(), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE( packaged_task_move_only )
+{
+    std::unique_ptr<int> p(new int(5));
+    daily::packaged_task<int()> pt([p = std::move(p)] { return *p; });
+    daily::packaged_task<int()> moved(std::move(pt));
+    BOOST_TEST_CHECK(!pt.valid());
+    BOOST_TEST_CHECK(moved.valid());
+
+    daily::packaged_task<int()> assigned;
+    BOOST_TEST_CHECK(!assigned.valid());
+    assigned = std::move(moved);
+    daily::future<int> f = assigned.get_future();
+    assigned();
+    BOOST_TEST_CHECK(f.get() == 5);
+
+    daily::packaged_task<int()> other([] { return 1; });
+    swap(assigned, other);
+    daily::future<int> f2 = assigned.get_future();
+    assigned();
+    BOOST_TEST_CHECK(f2.get() == 1);
+}
+
+BOOST_AUTO_TEST_CASE( packaged_task_large_callable )
+{
+    std::array<int, 64> values;
+    values.fill(1);
+    daily::packaged_task<int(int)> pt([values](int i) { return values[0] + i; });
+    daily::packaged_task<int(int)> moved(std::move(pt));
+    daily::future<int> f = moved.get_future();
+    moved(1);
+    BOOST_TEST_CHECK(f.get() == 2);
+}
+
+BOOST_AUTO_TEST_CASE( packaged_task_inline_callable )
+{
+    int base = 1;
+    std::size_t before = num_allocations;
+    daily::packaged_task<int(int)> pt([base](int i) { return base + i; });
+    // Only the state.
+    BOOST_TEST_CHECK(num_allocations - before == 1u);
+    daily::packaged_task<int(int)> moved(std::move(pt));
+    BOOST_TEST_CHECK(num_allocations - before == 1u);
+}
+
+BOOST_AUTO_TEST_CASE( packaged_task_reset )
+{
+    daily::packaged_task<int(int)> pt([](int i) { return i * 2; });
+    daily::future<int> f = pt.get_future();
+    pt(1);
+    BOOST_TEST_CHECK(f.get() == 2);
+    f = daily::future<int>();
+
+    std::size_t before = num_allocations;
+    for(int i = 0; i < 100; ++i)
+    {
+        pt.reset();
+        f = pt.get_future();
+        pt(i);
+        BOOST_TEST_CHECK(f.get() == i * 2);
+        f = daily::future<int>();
+    }
+    BOOST_TEST_CHECK(num_allocations == before);
+}
+
+BOOST_AUTO_TEST_CASE( packaged_task_reset_breaks_held_future )
+{
+    daily::packaged_task<int(int)> pt([](int i) { return i * 2; });
+    daily::future<int> f = pt.get_future();
+    pt.reset();
+    BOOST_CHECK_THROW(f.get(), daily::future_error);
+
+    daily::future<int> f2 = pt.get_future();
+    pt(2);
+    BOOST_TEST_CHECK(f2.get() == 4);
+
+    daily::packaged_task<int(int)> empty;
+    BOOST_CHECK_THROW(empty.reset(), daily::future_error);
+}
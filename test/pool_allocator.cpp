@@ -0,0 +1,120 @@
+// ****************************************************************************
+// daily/future/test/pool_allocator.cpp
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#define BOOST_TEST_MODULE PoolAllocator
+#include <boost/test/unit_test.hpp>
+#include "daily/future/future.hpp"
+#include "daily/future/pool_allocator.hpp"
+#include "test_thread_pool.hpp"
+
+#include <thread>
+#include <vector>
+
+namespace {
+
+    int add_one(int i)
+    {
+        return i + 1;
+    }
+
+    daily::future<int> make_chain(int depth)
+    {
+        daily::pool_allocator<void> alloc;
+        daily::promise<int> p(std::allocator_arg, alloc);
+        daily::future<int> f = p.get_future();
+        for(int i = 0; i < depth; ++i)
+            f = f.then(daily::continue_on::any, add_one, alloc);
+        p.set_value(0);
+        return f;
+    }
+}
+
+BOOST_AUTO_TEST_CASE( pool_allocator_size_classes )
+{
+    BOOST_TEST_CHECK(daily::detail::pool_size_class(1) == 0u);
+    BOOST_TEST_CHECK(daily::detail::pool_size_class(32) == 0u);
+    BOOST_TEST_CHECK(daily::detail::pool_size_class(33) == 1u);
+    BOOST_TEST_CHECK(
+        daily::detail::pool_size_class(daily::pool_max_block_size) ==
+        daily::detail::pool_num_size_classes - 1);
+}
+
+BOOST_AUTO_TEST_CASE( pool_allocator_recycles )
+{
+    BOOST_TEST_CHECK(make_chain(4).get() == 4);
+    daily::pool_allocator_statistics before = daily::get_pool_allocator_statistics();
+    for(int i = 0; i < 1000; ++i)
+        BOOST_TEST_CHECK(make_chain(4).get() == 4);
+
+    daily::pool_allocator_statistics after = daily::get_pool_allocator_statistics();
+    BOOST_TEST_CHECK(after.allocations - before.allocations == 5000u);
+    BOOST_TEST_CHECK(after.deallocations - before.deallocations == 5000u);
+    BOOST_TEST_CHECK(after.thread_cache_hits - before.thread_cache_hits == 5000u);
+    BOOST_TEST_CHECK(after.slabs == before.slabs);
+}
+
+BOOST_AUTO_TEST_CASE( pool_allocator_cross_thread_frees )
+{
+    std::size_t const count = 20 * daily::detail::pool_batch_size;
+    daily::pool_allocator_statistics before = daily::get_pool_allocator_statistics();
+
+    // Built here, released on another thread, several times over so the
+    // releasing thread's blocks have to find their way back.
+    for(int round = 0; round < 4; ++round)
+    {
+        std::vector<daily::future<int>> futures;
+        for(std::size_t i = 0; i < count; ++i)
+            futures.push_back(make_chain(1));
+
+        std::thread consumer([&futures]
+        {
+            for(auto&& f : futures)
+                BOOST_TEST_CHECK(f.get() == 1);
+            futures.clear();
+        });
+        consumer.join();
+    }
+
+    daily::pool_allocator_statistics after = daily::get_pool_allocator_statistics();
+    BOOST_TEST_CHECK(after.global_returns > before.global_returns);
+    BOOST_TEST_CHECK(after.global_refills > before.global_refills);
+    BOOST_TEST_CHECK(after.allocations - before.allocations == 4 * 2 * count);
+    BOOST_TEST_CHECK(after.deallocations - before.deallocations == 4 * 2 * count);
+
+    // Later rounds run on recycled blocks rather than new slabs.
+    BOOST_TEST_CHECK(
+        after.slabs - before.slabs <= 2 * 2 * count / daily::detail::pool_batch_size + 2);
+}
+
+BOOST_AUTO_TEST_CASE( pool_allocator_executor_continuations )
+{
+    test_thread_pool pool(2);
+    {
+        daily::pool_allocator<void> alloc;
+        daily::promise<int> p(std::allocator_arg, alloc);
+        daily::future<int> f = p.get_future()
+            .then(daily::execute::post, pool, add_one, alloc)
+            .then(daily::execute::dispatch, pool, add_one, alloc);
+        p.set_value(0);
+        BOOST_TEST_CHECK(f.get() == 2);
+    }
+    pool.join();
+}
+
+BOOST_AUTO_TEST_CASE( pool_allocator_oversize )
+{
+    daily::pool_allocator_statistics before = daily::get_pool_allocator_statistics();
+    daily::pool_allocator<char> alloc;
+    char* p = alloc.allocate(daily::pool_max_block_size + 1);
+    alloc.deallocate(p, daily::pool_max_block_size + 1);
+    daily::pool_allocator_statistics after = daily::get_pool_allocator_statistics();
+    BOOST_TEST_CHECK(after.oversize_allocations - before.oversize_allocations == 1u);
+    BOOST_TEST_CHECK((daily::pool_allocator<int>() == daily::pool_allocator<char>()));
+}
@@ -0,0 +1,92 @@
+// ****************************************************************************
+// daily/future/test/priority_thread_pool.cpp
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#define BOOST_TEST_MODULE PriorityThreadPool
+#include <boost/test/unit_test.hpp>
+#include "daily/future/future.hpp"
+#include "daily/future/priority_thread_pool.hpp"
+
+#include <chrono>
+#include <future>
+#include <vector>
+
+namespace {
+
+    // Blocks the pool's only thread until released so work can be queued
+    // up behind it.
+    struct gate
+    {
+        gate(daily::priority_thread_pool& pool)
+        {
+            std::shared_future<void> f = release_.get_future().share();
+            pool.get_executor(daily::priority::high).post([f] { f.wait(); });
+        }
+
+        void open()
+        {
+            release_.set_value();
+        }
+
+        std::promise<void> release_;
+    };
+}
+
+BOOST_AUTO_TEST_CASE( priority_order )
+{
+    daily::priority_thread_pool pool(1, 3, std::chrono::hours(1));
+    gate g(pool);
+    std::vector<std::size_t> order;
+    for(std::size_t p : { daily::priority::low, daily::priority::normal, daily::priority::high })
+        pool.get_executor(p).post([&order, p] { order.push_back(p); });
+
+    g.open();
+    pool.join();
+    BOOST_TEST_CHECK(order == (std::vector<std::size_t>{ 0, 1, 2 }), boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE( priority_aging )
+{
+    daily::priority_thread_pool pool(1, 3, std::chrono::milliseconds(1));
+    gate g(pool);
+    std::vector<std::size_t> order;
+    pool.get_executor(daily::priority::low).post([&order] { order.push_back(daily::priority::low); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    pool.get_executor(daily::priority::high).post([&order] { order.push_back(daily::priority::high); });
+    g.open();
+    pool.join();
+    BOOST_TEST_CHECK(order == (std::vector<std::size_t>{ 2, 0 }), boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE( priority_continuation )
+{
+    daily::priority_thread_pool pool(1, 3, std::chrono::hours(1));
+    gate g(pool);
+    std::vector<int> order;
+    daily::promise<int> bulk;
+    daily::promise<int> interactive;
+    daily::future<void> f1 = bulk.get_future().then(
+        daily::execute::post,
+        pool.get_executor(daily::priority::low),
+        [&order](int i) { order.push_back(i); }
+    );
+
+    daily::future<void> f2 = interactive.get_future().then(
+        daily::execute::post,
+        pool.get_executor().with_priority(daily::priority::high),
+        [&order](int i) { order.push_back(i); }
+    );
+
+    bulk.set_value(1);
+    interactive.set_value(2);
+    g.open();
+    f1.get();
+    f2.get();
+    BOOST_TEST_CHECK(order == (std::vector<int>{ 2, 1 }), boost::test_tools::per_element());
+}
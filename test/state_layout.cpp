@@ -0,0 +1,76 @@
+// ****************************************************************************
+// daily/future/test/state_layout.cpp
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#define DAILY_FUTURE_ENABLE_CACHE_LINE_SEPARATION
+#define BOOST_TEST_MODULE StateLayout
+#include <boost/test/unit_test.hpp>
+#include "daily/future/future.hpp"
+#include "test_thread_pool.hpp"
+
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+    int add_one(int i)
+    {
+        return i + 1;
+    }
+}
+
+BOOST_AUTO_TEST_CASE( state_layout_separated )
+{
+    BOOST_TEST_CHECK(daily::cache_line_separation_enabled);
+    BOOST_TEST_CHECK(
+        sizeof(daily::detail::future_shared_state_base) > daily::cache_line_size);
+}
+
+BOOST_AUTO_TEST_CASE( state_layout_flags )
+{
+    typedef daily::detail::promise_future_shared_state<int> state_type;
+    state_type state;
+    std::unique_lock<daily::detail::chain_mutex> lk = state.lock();
+    BOOST_TEST_CHECK(!state.is_finished());
+    BOOST_TEST_CHECK(state.is_valid(lk));
+    BOOST_TEST_CHECK(!state.has_exception(lk));
+
+    state.set_finished_with_result(1, lk);
+    BOOST_TEST_CHECK(state.is_finished());
+    BOOST_TEST_CHECK(state.has_value(lk));
+    BOOST_TEST_CHECK(state.get(lk) == 1);
+    BOOST_TEST_CHECK(!state.is_valid(lk));
+}
+
+BOOST_AUTO_TEST_CASE( state_layout_exception )
+{
+    daily::promise<int> p;
+    daily::future<int> f = p.get_future();
+    p.set_exception(std::make_exception_ptr(std::runtime_error("failed")));
+    BOOST_TEST_CHECK(f.is_ready());
+    BOOST_TEST_CHECK(f.has_exception());
+    BOOST_TEST_CHECK(!f.has_value());
+    BOOST_CHECK_THROW(f.get(), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE( state_layout_cross_thread )
+{
+    test_thread_pool pool(2);
+    {
+        daily::promise<int> p;
+        daily::future<int> f = p.get_future()
+            .then(daily::execute::post, pool, add_one)
+            .then(daily::continue_on::any, add_one);
+        std::thread producer([&p] { p.set_value(0); });
+        BOOST_TEST_CHECK(f.get() == 2);
+        producer.join();
+    }
+    pool.join();
+}
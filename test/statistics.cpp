@@ -0,0 +1,142 @@
+// ****************************************************************************
+// daily/future/test/statistics.cpp
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#define DAILY_FUTURE_ENABLE_STATISTICS
+#define BOOST_TEST_MODULE Statistics
+#include <boost/test/unit_test.hpp>
+#include "daily/future/future.hpp"
+#include "test_thread_pool.hpp"
+
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace {
+
+    // Difference of one statistic since construction.
+    class statistics_delta
+    {
+    public:
+
+        statistics_delta()
+            : start_(daily::get_statistics())
+        {}
+
+        std::int64_t operator[](daily::statistic s) const
+        {
+            return daily::get_statistics()[s] - start_[s];
+        }
+
+    private:
+
+        daily::statistics_snapshot start_;
+    };
+}
+
+BOOST_AUTO_TEST_CASE( statistics_promise_lifecycle )
+{
+    statistics_delta delta;
+    {
+        daily::promise<int> p;
+        daily::future<int> f = p.get_future();
+        BOOST_TEST_CHECK(delta[daily::statistic::promises_created] == 1);
+        BOOST_TEST_CHECK(delta[daily::statistic::shared_states_live] == 1);
+        BOOST_TEST_CHECK(delta[daily::statistic::shared_state_bytes_live] > 0);
+        p.set_value(1);
+        BOOST_TEST_CHECK(f.get() == 1);
+    }
+
+    BOOST_TEST_CHECK(delta[daily::statistic::futures_satisfied] == 1);
+    BOOST_TEST_CHECK(delta[daily::statistic::shared_states_live] == 0);
+    BOOST_TEST_CHECK(delta[daily::statistic::shared_state_bytes_live] == 0);
+}
+
+BOOST_AUTO_TEST_CASE( statistics_exceptions )
+{
+    statistics_delta delta;
+    daily::promise<int> p;
+    daily::future<int> f = p.get_future();
+    p.set_exception(std::make_exception_ptr(std::runtime_error("")));
+    BOOST_CHECK_THROW(f.get(), std::runtime_error);
+    BOOST_TEST_CHECK(delta[daily::statistic::exceptions_set] == 1);
+}
+
+BOOST_AUTO_TEST_CASE( statistics_continue_on_policies )
+{
+    statistics_delta delta;
+    {
+        daily::promise<int> p;
+        daily::future<int> f = p.get_future()
+            .then(daily::continue_on::any, [](int i) { return i + 1; })
+            .then(daily::continue_on::set, [](int i) { return i + 1; })
+            .then(daily::continue_on::get, [](int i) { return i + 1; });
+        BOOST_TEST_CHECK(delta[daily::statistic::shared_states_live] == 4);
+        p.set_value(0);
+        BOOST_TEST_CHECK(f.get() == 3);
+    }
+
+    BOOST_TEST_CHECK(delta[daily::statistic::continuations_any] == 1);
+    BOOST_TEST_CHECK(delta[daily::statistic::continuations_set] == 1);
+    BOOST_TEST_CHECK(delta[daily::statistic::continuations_get] == 1);
+    BOOST_TEST_CHECK(delta[daily::statistic::futures_satisfied] == 4);
+    BOOST_TEST_CHECK(delta[daily::statistic::shared_states_live] == 0);
+}
+
+BOOST_AUTO_TEST_CASE( statistics_execute_policies )
+{
+    statistics_delta delta;
+    test_thread_pool pool(1);
+    {
+        daily::promise<int> p;
+        daily::future<int> f = p.get_future()
+            .then(daily::execute::dispatch, pool, [](int i) { return i + 1; })
+            .then(daily::execute::post, pool, [](int i) { return i + 1; })
+            .then(daily::execute::defer, pool, [](int i) { return i + 1; });
+        p.set_value(0);
+        BOOST_TEST_CHECK(f.get() == 3);
+    }
+
+    BOOST_TEST_CHECK(delta[daily::statistic::continuations_dispatch] == 1);
+    BOOST_TEST_CHECK(delta[daily::statistic::continuations_post] == 1);
+    BOOST_TEST_CHECK(delta[daily::statistic::continuations_defer] == 1);
+    pool.join();
+}
+
+BOOST_AUTO_TEST_CASE( statistics_blocked_waits )
+{
+    statistics_delta delta;
+    daily::promise<int> p;
+    daily::future<int> f = p.get_future();
+    std::thread setter([&p]
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        p.set_value(1);
+    });
+
+    BOOST_TEST_CHECK(f.get() == 1);
+    setter.join();
+    BOOST_TEST_CHECK(delta[daily::statistic::blocked_waits] == 1);
+    BOOST_TEST_CHECK(delta[daily::statistic::blocked_wait_ns] >= 10000000);
+
+    // Ready futures don't count as blocking.
+    daily::promise<int> ready;
+    daily::future<int> rf = ready.get_future();
+    ready.set_value(2);
+    rf.get();
+    BOOST_TEST_CHECK(delta[daily::statistic::blocked_waits] == 1);
+}
+
+BOOST_AUTO_TEST_CASE( statistics_names )
+{
+    BOOST_TEST_CHECK(daily::statistics_enabled);
+    BOOST_TEST_CHECK(
+        std::string(daily::statistic_name(daily::statistic::blocked_wait_ns)) == "blocked_wait_ns");
+}
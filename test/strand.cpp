@@ -0,0 +1,204 @@
+// ****************************************************************************
+// daily/future/test/strand.cpp
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#define BOOST_TEST_MODULE Strand
+#include <boost/test/unit_test.hpp>
+#include "daily/future/future.hpp"
+#include "daily/future/strand.hpp"
+#include "test_thread_pool.hpp"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    template<typename T>
+    struct tagged_allocator
+    {
+        typedef T value_type;
+
+        explicit tagged_allocator(int tag)
+            : tag_(tag)
+        {}
+
+        template<typename U>
+        tagged_allocator(tagged_allocator<U> const& other)
+            : tag_(other.tag_)
+        {}
+
+        T* allocate(std::size_t n)
+        {
+            return std::allocator<T>().allocate(n);
+        }
+
+        void deallocate(T* p, std::size_t n)
+        {
+            std::allocator<T>().deallocate(p, n);
+        }
+
+        int tag_;
+    };
+
+    template<typename T, typename U>
+    bool operator==(tagged_allocator<T> const& a, tagged_allocator<U> const& b)
+    {
+        return a.tag_ == b.tag_;
+    }
+
+    template<typename T, typename U>
+    bool operator!=(tagged_allocator<T> const& a, tagged_allocator<U> const& b)
+    {
+        return !(a == b);
+    }
+
+    // Runs closures immediately, recording the tag of the allocator they
+    // were submitted with.
+    struct recording_executor
+    {
+        template<typename Function, typename Allocator>
+        void dispatch(Function&& f, Allocator const& alloc) const
+        {
+            run(f, alloc);
+        }
+
+        template<typename Function, typename Allocator>
+        void post(Function&& f, Allocator const& alloc) const
+        {
+            run(f, alloc);
+        }
+
+        template<typename Function, typename Allocator>
+        void defer(Function&& f, Allocator const& alloc) const
+        {
+            run(f, alloc);
+        }
+
+        template<typename Function, typename T>
+        void run(Function& f, tagged_allocator<T> const& alloc) const
+        {
+            *tag_ = alloc.tag_;
+            f();
+        }
+
+        template<typename Function>
+        void run(Function& f, daily::future_default_allocator const&) const
+        {
+            *tag_ = 0;
+            f();
+        }
+
+        int* tag_;
+    };
+}
+
+BOOST_AUTO_TEST_CASE( strand_serializes )
+{
+    test_thread_pool pool(8);
+    auto strand = daily::make_strand(pool.get_executor());
+    std::atomic<int> in_flight(0);
+    std::atomic<bool> overlapped(false);
+    int count = 0;
+
+    std::vector<std::thread> producers;
+    for(int i = 0; i < 4; ++i)
+    {
+        producers.emplace_back([&]
+        {
+            for(int j = 0; j < 10000; ++j)
+            {
+                strand.post([&]
+                {
+                    if(in_flight.fetch_add(1) != 0)
+                        overlapped = true;
+                    // Unsynchronised on purpose, the strand is the lock.
+                    ++count;
+                    in_flight.fetch_sub(1);
+                }, daily::future_default_allocator());
+            }
+        });
+    }
+
+    for(auto&& t : producers)
+        t.join();
+
+    pool.join();
+    BOOST_TEST_CHECK(overlapped == false);
+    BOOST_TEST_CHECK(count == 40000);
+}
+
+BOOST_AUTO_TEST_CASE( strand_dispatch_inline )
+{
+    test_thread_pool pool(2);
+    auto strand = daily::make_strand(pool.get_executor());
+    std::atomic<bool> inline_ran(false);
+    std::atomic<bool> done(false);
+    strand.post([&]
+    {
+        bool ran = false;
+        strand.dispatch([&ran] { ran = true; });
+        inline_ran = ran;
+        done = true;
+    });
+
+    pool.join();
+    BOOST_TEST_CHECK(done == true);
+    BOOST_TEST_CHECK(inline_ran == true);
+}
+
+BOOST_AUTO_TEST_CASE( strand_continuations )
+{
+    test_thread_pool pool(8);
+    auto strand = daily::make_strand(pool.get_executor());
+    int total = 0;
+    std::vector<daily::promise<int>> promises(1000);
+    std::vector<daily::future<void>> futures;
+    for(auto&& p : promises)
+    {
+        futures.push_back(p.get_future().then(
+            daily::execute::post,
+            strand,
+            [&total](int i)
+            {
+                total += i;
+            }
+        ));
+    }
+
+    std::thread setter([&promises]
+    {
+        for(std::size_t i = 0; i < promises.size(); i += 2)
+            promises[i].set_value(1);
+    });
+
+    for(std::size_t i = 1; i < promises.size(); i += 2)
+        promises[i].set_value(1);
+
+    setter.join();
+    for(auto&& f : futures)
+        f.get();
+
+    BOOST_TEST_CHECK(total == 1000);
+}
+
+BOOST_AUTO_TEST_CASE( strand_forwards_allocator )
+{
+    int tag = -1;
+    auto strand = daily::make_strand(recording_executor{&tag});
+    bool ran = false;
+    strand.post([&ran] { ran = true; }, tagged_allocator<char>(7));
+    BOOST_TEST_CHECK(ran == true);
+    BOOST_TEST_CHECK(tag == 7);
+    strand.dispatch([] {}, daily::future_default_allocator());
+    BOOST_TEST_CHECK(tag == 0);
+    strand.defer([] {}, tagged_allocator<char>(3));
+    BOOST_TEST_CHECK(tag == 3);
+}
@@ -0,0 +1,171 @@
+// ****************************************************************************
+// daily/future/test/task.cpp
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#define BOOST_TEST_MODULE Task
+#include <boost/test/unit_test.hpp>
+#include "daily/future/task.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+namespace {
+
+    std::atomic<std::size_t> num_allocations(0);
+    std::atomic<std::size_t> num_frees(0);
+
+    template <class T>
+    struct CountingAllocator
+    {
+        typedef T value_type;
+
+        CountingAllocator()
+        {}
+
+        template <class U>
+        CountingAllocator(CountingAllocator<U> const&)
+        {}
+
+        T* allocate(std::size_t n)
+        {
+            ++num_allocations;
+            return std::allocator<T>().allocate(n);
+        }
+
+        void deallocate(T* p, std::size_t n)
+        {
+            ++num_frees;
+            std::allocator<T>().deallocate(p, n);
+        }
+    };
+
+    daily::task<int> get_one()
+    {
+        co_return 1;
+    }
+
+    daily::task<int> add_one(daily::task<int> t)
+    {
+        int v = co_await std::move(t);
+        co_return v + 1;
+    }
+
+    daily::task<void> set_flag(bool& flag)
+    {
+        flag = true;
+        co_return;
+    }
+
+    daily::task<int&> get_ref(int& r)
+    {
+        co_return r;
+    }
+
+    daily::task<int> throws()
+    {
+        throw std::logic_error("");
+        co_return 1;
+    }
+
+    template<typename Allocator>
+    daily::task<int> allocated_one(std::allocator_arg_t, Allocator const&)
+    {
+        co_return 1;
+    }
+
+    daily::task<int> from_future(daily::future<int> f)
+    {
+        co_return f.get();
+    }
+}
+
+BOOST_AUTO_TEST_CASE( task_is_lazy )
+{
+    bool ran = false;
+    daily::task<void> t = set_flag(ran);
+    BOOST_TEST_CHECK(t.valid() == true);
+    BOOST_TEST_CHECK(ran == false);
+    daily::future<void> f = std::move(t).get_future();
+    BOOST_TEST_CHECK(ran == true);
+    BOOST_TEST_CHECK(f.is_ready() == true);
+    f.get();
+}
+
+BOOST_AUTO_TEST_CASE( task_await_chain )
+{
+    daily::future<int> f = add_one(add_one(get_one())).get_future();
+    BOOST_TEST_CHECK(f.get() == 3);
+}
+
+BOOST_AUTO_TEST_CASE( task_ref )
+{
+    int result = 1;
+    daily::future<int&> f = get_ref(result).get_future();
+    BOOST_TEST_CHECK(&f.get() == &result);
+}
+
+BOOST_AUTO_TEST_CASE( task_throws )
+{
+    daily::future<int> f = add_one(throws()).get_future();
+    bool exception_caught = false;
+    try
+    {
+        f.get();
+    }
+    catch(std::logic_error&)
+    {
+        exception_caught = true;
+    }
+    BOOST_TEST_CHECK(exception_caught == true);
+}
+
+BOOST_AUTO_TEST_CASE( task_future_continuation )
+{
+    bool continued = false;
+    daily::future<int> f = add_one(get_one()).get_future().then(
+        daily::continue_on::set,
+        [&continued](int i)
+        {
+            continued = true;
+            return i * 2;
+        }
+    );
+
+    BOOST_TEST_CHECK(continued == true);
+    BOOST_TEST_CHECK(f.get() == 4);
+}
+
+BOOST_AUTO_TEST_CASE( task_cross_thread )
+{
+    daily::promise<int> p;
+    daily::task<int> t = add_one(from_future(p.get_future()));
+    std::thread setter([&p] { p.set_value(5); });
+    daily::future<int> f = std::move(t).get_future();
+    BOOST_TEST_CHECK(f.get() == 6);
+    setter.join();
+}
+
+BOOST_AUTO_TEST_CASE( task_alloc_frame )
+{
+    CountingAllocator<char> alloc;
+    {
+        daily::task<int> t = allocated_one(std::allocator_arg, alloc);
+        BOOST_TEST_CHECK(num_allocations == 1);
+    }
+    BOOST_TEST_CHECK(num_frees == 1);
+
+    daily::future<int> f = allocated_one(std::allocator_arg, alloc)
+        .get_future(std::allocator_arg, alloc);
+    BOOST_TEST_CHECK(f.get() == 1);
+    BOOST_TEST_CHECK(num_allocations == num_frees + 1);
+    f = daily::future<int>();
+    BOOST_TEST_CHECK(num_allocations == num_frees);
+}
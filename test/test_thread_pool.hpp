@@ -0,0 +1,188 @@
+// ****************************************************************************
+// daily/future/test/test_thread_pool.hpp
+//
+// Minimal thread pool modelling the executor requirements used by
+// future::then so the executor adapters can be tested without the
+// executors TS implementation.
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#pragma once
+#ifndef DAILY_FUTURE_TEST_TESTTHREADPOOL_HPP_
+#define DAILY_FUTURE_TEST_TESTTHREADPOOL_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class test_thread_pool
+{
+public:
+
+    class executor_type
+    {
+    public:
+
+        test_thread_pool& context() const noexcept
+        {
+            return *pool_;
+        }
+
+        void on_work_started() const noexcept
+        {}
+
+        void on_work_finished() const noexcept
+        {}
+
+        template<typename Function, typename Allocator>
+        void dispatch(Function&& f, Allocator const&) const
+        {
+            if(pool_->running_in_this_thread())
+            {
+                typename std::decay<Function>::type func(std::forward<Function>(f));
+                func();
+            }
+            else
+            {
+                pool_->push(std::forward<Function>(f));
+            }
+        }
+
+        template<typename Function, typename Allocator>
+        void post(Function&& f, Allocator const&) const
+        {
+            pool_->push(std::forward<Function>(f));
+        }
+
+        template<typename Function, typename Allocator>
+        void defer(Function&& f, Allocator const&) const
+        {
+            pool_->push(std::forward<Function>(f));
+        }
+
+    private:
+
+        friend class test_thread_pool;
+
+        explicit executor_type(test_thread_pool* pool)
+            : pool_(pool)
+        {}
+
+        test_thread_pool* pool_;
+    };
+
+    explicit test_thread_pool(std::size_t num_threads = 4)
+    {
+        while(num_threads--)
+            threads_.emplace_back([this] { run(); });
+    }
+
+    ~test_thread_pool()
+    {
+        join();
+    }
+
+    executor_type get_executor() noexcept
+    {
+        return executor_type(this);
+    }
+
+    // Waits for all queued work to finish and stops the threads.
+    void join()
+    {
+        {
+            std::unique_lock<std::mutex> lk(mutex_);
+            stop_ = true;
+        }
+        ready_.notify_all();
+        for(auto&& t : threads_)
+        {
+            if(t.joinable())
+                t.join();
+        }
+    }
+
+private:
+
+    struct closure_base
+    {
+        virtual ~closure_base() {}
+        virtual void run() = 0;
+    };
+
+    template<typename Function>
+    struct closure : closure_base
+    {
+        closure(Function f)
+            : f_(std::move(f))
+        {}
+
+        void run() override
+        {
+            f_();
+        }
+
+        Function f_;
+    };
+
+    template<typename Function>
+    void push(Function&& f)
+    {
+        typedef typename std::decay<Function>::type function_type;
+        std::unique_ptr<closure_base> c(
+            new closure<function_type>(std::forward<Function>(f)));
+        {
+            std::unique_lock<std::mutex> lk(mutex_);
+            queue_.push_back(std::move(c));
+        }
+        ready_.notify_one();
+    }
+
+    bool running_in_this_thread() const
+    {
+        return current() == this;
+    }
+
+    void run()
+    {
+        current() = this;
+        std::unique_lock<std::mutex> lk(mutex_);
+        while(true)
+        {
+            while(queue_.empty() && !stop_)
+                ready_.wait(lk);
+
+            if(queue_.empty())
+                return;
+
+            std::unique_ptr<closure_base> c = std::move(queue_.front());
+            queue_.pop_front();
+            lk.unlock();
+            c->run();
+            c.reset();
+            lk.lock();
+        }
+    }
+
+    static test_thread_pool const*& current()
+    {
+        static thread_local test_thread_pool const* current_ = nullptr;
+        return current_;
+    }
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<std::unique_ptr<closure_base>> queue_;
+    std::vector<std::thread> threads_;
+    bool stop_ = false;
+};
+
+#endif // DAILY_FUTURE_TEST_TESTTHREADPOOL_HPP_
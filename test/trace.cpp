@@ -0,0 +1,160 @@
+// ****************************************************************************
+// daily/future/test/trace.cpp
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#define DAILY_FUTURE_ENABLE_TRACING
+#define DAILY_FUTURE_TRACE_BUFFER_SIZE 16
+#define DAILY_FUTURE_TRACE_RETAINED_BUFFERS 4
+#define BOOST_TEST_MODULE Trace
+#include <boost/test/unit_test.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include "daily/future/future.hpp"
+#include "test_thread_pool.hpp"
+
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace {
+
+    boost::property_tree::ptree dump_trace()
+    {
+        std::stringstream json;
+        daily::write_trace(json);
+        boost::property_tree::ptree tree;
+        boost::property_tree::read_json(json, tree);
+        return tree;
+    }
+
+    std::size_t num_trace_threads()
+    {
+        std::size_t threads = 0;
+        boost::property_tree::ptree trace = dump_trace();
+        for(auto&& e : trace.get_child("traceEvents"))
+        {
+            if(e.second.get<std::string>("ph") == "M")
+                ++threads;
+        }
+
+        return threads;
+    }
+}
+
+BOOST_AUTO_TEST_CASE( trace_chain_across_threads )
+{
+    daily::clear_trace();
+    test_thread_pool pool(1);
+    {
+        daily::promise<int> p;
+        daily::future<int> f = p.get_future()
+            .then(daily::continue_on::any, [](int i) { return i + 1; })
+            .then(daily::execute::post, pool, [](int i) { return i + 1; });
+        p.set_value(0);
+        BOOST_TEST_CHECK(f.get() == 2);
+    }
+    pool.join();
+
+    // name/category -> flow ids seen, and the threads each ran on.
+    std::map<std::string, std::set<std::string>> flows;
+    std::map<std::string, std::string> threads;
+    boost::property_tree::ptree trace = dump_trace();
+    for(auto&& e : trace.get_child("traceEvents"))
+    {
+        std::string ph = e.second.get<std::string>("ph");
+        if(ph != "X" && ph != "i")
+            continue;
+
+        std::string key = e.second.get<std::string>("name") + "/" + e.second.get<std::string>("cat");
+        flows[key].insert(e.second.get<std::string>("args.chain"));
+        threads[key] = e.second.get<std::string>("tid");
+    }
+
+    BOOST_TEST_CHECK(flows.count("promise/promise") == 1);
+    BOOST_TEST_CHECK(flows.count("set_value/promise") == 1);
+    BOOST_TEST_CHECK(flows.count("continuation/continue_on::any") == 1);
+    BOOST_TEST_CHECK(flows.count("schedule/execute::post") == 1);
+    BOOST_TEST_CHECK(flows.count("continuation/execute::post") == 1);
+
+    // Every event belongs to the one chain.
+    std::string chain = *flows["promise/promise"].begin();
+    for(auto&& f : flows)
+    {
+        BOOST_TEST_CHECK(f.second.size() == 1);
+        BOOST_TEST_CHECK(*f.second.begin() == chain);
+    }
+
+    // The posted continuation ran on the pool's thread.
+    BOOST_TEST_CHECK(threads["continuation/execute::post"] != threads["set_value/promise"]);
+    BOOST_TEST_CHECK(threads["continuation/continue_on::any"] == threads["set_value/promise"]);
+}
+
+BOOST_AUTO_TEST_CASE( trace_separate_chains )
+{
+    daily::clear_trace();
+    daily::promise<void> a;
+    daily::promise<void> b;
+    a.set_value();
+    b.set_value();
+
+    std::set<std::string> chains;
+    boost::property_tree::ptree trace = dump_trace();
+    for(auto&& e : trace.get_child("traceEvents"))
+    {
+        if(e.second.get<std::string>("ph") == "s")
+            chains.insert(e.second.get<std::string>("id"));
+    }
+
+    BOOST_TEST_CHECK(chains.size() == 2);
+}
+
+BOOST_AUTO_TEST_CASE( trace_ring_buffer_wraps )
+{
+    daily::clear_trace();
+    for(int i = 0; i < 100; ++i)
+    {
+        daily::promise<int> p;
+        p.set_value(i);
+    }
+
+    std::size_t slices = 0;
+    boost::property_tree::ptree trace = dump_trace();
+    for(auto&& e : trace.get_child("traceEvents"))
+    {
+        std::string ph = e.second.get<std::string>("ph");
+        if(ph == "X" || ph == "i")
+            ++slices;
+    }
+
+    BOOST_TEST_CHECK(slices == DAILY_FUTURE_TRACE_BUFFER_SIZE);
+}
+
+BOOST_AUTO_TEST_CASE( trace_reuses_retired_buffers )
+{
+    auto trace_on_new_thread = []
+    {
+        std::thread t([]
+        {
+            daily::promise<int> p;
+            p.set_value(1);
+        });
+        t.join();
+    };
+
+    for(int i = 0; i < DAILY_FUTURE_TRACE_RETAINED_BUFFERS + 1; ++i)
+        trace_on_new_thread();
+
+    std::size_t const threads = num_trace_threads();
+    for(int i = 0; i < 100; ++i)
+        trace_on_new_thread();
+
+    BOOST_TEST_CHECK(num_trace_threads() == threads);
+}
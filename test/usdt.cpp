@@ -0,0 +1,72 @@
+// ****************************************************************************
+// daily/future/test/usdt.cpp
+//
+// Copyright Chris Glover 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// ****************************************************************************
+#define DAILY_FUTURE_ENABLE_USDT
+#define BOOST_TEST_MODULE Usdt
+#include <boost/test/unit_test.hpp>
+#include "daily/future/future.hpp"
+#include "test_thread_pool.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+    // Looks for the provider and probe name pair that each .note.stapsdt
+    // entry carries in our own executable.
+    bool has_probe(std::string const& image, char const* name)
+    {
+        std::string key = std::string("daily_future") + '\0' + name + '\0';
+        return image.find(key) != std::string::npos;
+    }
+}
+
+BOOST_AUTO_TEST_CASE( usdt_probes_run )
+{
+    test_thread_pool pool(1);
+    {
+        daily::promise<int> p;
+        daily::future<int> f = p.get_future()
+            .then(daily::continue_on::any, [](int i) { return i + 1; })
+            .then(daily::execute::post, pool, [](int i) { return i + 1; });
+        p.set_value(0);
+        BOOST_TEST_CHECK(f.get() == 2);
+    }
+
+    {
+        daily::promise<int> p;
+        daily::future<int> f = p.get_future();
+        p.set_exception(std::make_exception_ptr(std::runtime_error("")));
+        BOOST_CHECK_THROW(f.get(), std::runtime_error);
+    }
+
+    pool.join();
+}
+
+#if DAILY_FUTURE_USDT_AVAILABLE && defined(__linux__)
+BOOST_AUTO_TEST_CASE( usdt_probes_in_image )
+{
+    std::ifstream exe("/proc/self/exe", std::ios::binary);
+    std::string image(
+        (std::istreambuf_iterator<char>(exe)),
+        std::istreambuf_iterator<char>());
+    BOOST_TEST_REQUIRE(!image.empty());
+
+    BOOST_TEST_CHECK(has_probe(image, "set_finished"));
+    BOOST_TEST_CHECK(has_probe(image, "set_finished_with_exception"));
+    BOOST_TEST_CHECK(has_probe(image, "set_continuation"));
+    BOOST_TEST_CHECK(has_probe(image, "wait_begin"));
+    BOOST_TEST_CHECK(has_probe(image, "wait_end"));
+    BOOST_TEST_CHECK(has_probe(image, "executor_submit"));
+    BOOST_TEST_CHECK(has_probe(image, "continuation_run"));
+}
+#endif
@@ -17,6 +17,24 @@
 
 #include "daily/future/use_future.hpp"
 
+#include <atomic>
+#include <cstdlib>
+
+static std::atomic<std::size_t> num_allocations(0);
+void * operator new(size_t size)
+{
+    ++num_allocations;
+    return malloc(size);
+}
+void operator delete(void * ptr) noexcept
+{
+    free(ptr);
+}
+void operator delete(void * ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
 float get_one()
 {
     return 1.f;
@@ -127,4 +145,194 @@ BOOST_AUTO_TEST_CASE( future_use_future_stress )
 
     pool.join();
     BOOST_TEST_CHECK(result.load() == 0.f);
-}
\ No newline at end of file
+}
+
+BOOST_AUTO_TEST_CASE( future_use_pooled_future )
+{
+    typedef std::experimental::handler_type<
+        daily::use_pooled_future_t, void(float)
+    >::type handler_type;
+    static_assert(
+        std::is_same<
+            std::experimental::associated_allocator<handler_type>::type,
+            daily::pool_allocator<void>
+        >::value,
+        "The token's allocator should be associated with its handler."
+    );
+
+    std::experimental::thread_pool pool;
+    daily::pool_allocator_statistics before = daily::get_pool_allocator_statistics();
+    int count = 1000;
+    while(count--)
+    {
+        auto f = std::experimental::dispatch(
+            pool,
+            get_one,
+            daily::use_pooled_future
+        );
+
+        BOOST_TEST_CHECK(f.get() == 1.f);
+    }
+
+    daily::pool_allocator_statistics after = daily::get_pool_allocator_statistics();
+    BOOST_TEST_CHECK(after.allocations - before.allocations >= 1000u);
+    BOOST_TEST_CHECK(after.oversize_allocations == before.oversize_allocations);
+    pool.join();
+}
+
+namespace {
+
+    template<typename Token, typename Signature>
+    struct completion
+    {
+        typedef typename std::experimental::handler_type<
+            Token, Signature
+        >::type handler_type;
+
+        typedef std::experimental::async_result<handler_type> result_type;
+
+        explicit completion(Token const& token)
+            : handler(token)
+            , result(handler)
+        {}
+
+        handler_type handler;
+        result_type result;
+    };
+}
+
+BOOST_AUTO_TEST_CASE( future_use_pooled_future_steady_state )
+{
+    typedef completion<daily::use_pooled_future_t, void(float)> completion_type;
+
+    // The first round fills this thread's pool cache.
+    {
+        completion_type c(daily::use_pooled_future);
+        daily::future<float> f = c.result.get();
+        c.handler(1.f);
+        BOOST_TEST_CHECK(f.get() == 1.f);
+    }
+
+    std::size_t before = num_allocations;
+    int completed = 0;
+    for(int i = 0; i < 1000; ++i)
+    {
+        completion_type c(daily::use_pooled_future);
+        daily::future<float> f = c.result.get();
+        c.handler(1.f);
+        if(f.get() == 1.f)
+            ++completed;
+    }
+
+    BOOST_TEST_CHECK(num_allocations == before);
+    BOOST_TEST_CHECK(completed == 1000);
+}
+
+BOOST_AUTO_TEST_CASE( future_use_future_multiple_arguments )
+{
+    completion<daily::use_future_t<>, void(int, float)> c(daily::use_future);
+    daily::future<std::tuple<int, float>> f = c.result.get();
+    c.handler(1, 2.f);
+    BOOST_TEST_CHECK((f.get() == std::make_tuple(1, 2.f)));
+
+    completion<daily::use_future_t<>, void(std::error_code, std::size_t)> ec(daily::use_future);
+    daily::future<std::tuple<std::error_code, std::size_t>> f2 = ec.result.get();
+    ec.handler(std::make_error_code(std::errc::connection_reset), 3);
+    auto r = f2.get();
+    BOOST_TEST_CHECK((std::get<0>(r) == std::errc::connection_reset));
+    BOOST_TEST_CHECK(std::get<1>(r) == 3u);
+}
+
+BOOST_AUTO_TEST_CASE( future_use_future_map_error_code )
+{
+    typedef daily::use_future_error_code_t<> token_type;
+    token_type token = daily::map_error_code(daily::use_future);
+
+    completion<token_type, void(std::error_code, std::size_t)> ok(token);
+    daily::future<std::size_t> f = ok.result.get();
+    ok.handler(std::error_code(), 3);
+    BOOST_TEST_CHECK(f.get() == 3u);
+
+    completion<token_type, void(std::error_code, std::size_t)> failed(token);
+    daily::future<std::size_t> f2 = failed.result.get();
+    failed.handler(std::make_error_code(std::errc::connection_reset), 0);
+    BOOST_TEST_CHECK(f2.has_exception());
+    bool caught = false;
+    try
+    {
+        f2.get();
+    }
+    catch(daily::completion_error const& e)
+    {
+        caught = e.code() == std::errc::connection_reset;
+    }
+    BOOST_TEST_CHECK(caught);
+
+    completion<token_type, void(std::error_code)> void_ok(token);
+    daily::future<void> f3 = void_ok.result.get();
+    void_ok.handler(std::error_code());
+    BOOST_TEST_CHECK(f3.has_value());
+}
+
+BOOST_AUTO_TEST_CASE( future_use_future_then_set )
+{
+    std::experimental::thread_pool pool;
+    auto f = std::experimental::dispatch(
+        pool,
+        get_one,
+        daily::use_future.then(
+            daily::continue_on::set, [](float f) { return f * 2; })
+    );
+
+    BOOST_TEST_CHECK(f.get() == 2.f);
+
+    auto token = daily::use_future.then(
+        daily::continue_on::any, [](std::tuple<int, int> t)
+        {
+            return std::get<0>(t) + std::get<1>(t);
+        });
+    completion<decltype(token), void(int, int)> c(token);
+    daily::future<int> f2 = c.result.get();
+    c.handler(1, 2);
+    BOOST_TEST_CHECK(f2.is_ready());
+    BOOST_TEST_CHECK(f2.get() == 3);
+}
+
+BOOST_AUTO_TEST_CASE( future_use_future_then_throws )
+{
+    auto token = daily::use_future.then(
+        daily::continue_on::set, [](float f) -> float
+        {
+            throw std::logic_error("");
+        });
+    completion<decltype(token), void(float)> c(token);
+    daily::future<float> f = c.result.get();
+    c.handler(1.f);
+    BOOST_TEST_CHECK(f.has_exception());
+    BOOST_CHECK_THROW(f.get(), std::logic_error);
+}
+
+BOOST_AUTO_TEST_CASE( future_use_future_then_executor )
+{
+    std::experimental::thread_pool pool;
+    std::experimental::loop_scheduler looper;
+    bool has_run = false;
+    auto f = std::experimental::dispatch(
+        pool,
+        get_one,
+        daily::use_future.then(
+            daily::execute::post,
+            looper,
+            [&has_run](float f)
+            {
+                has_run = true;
+                return f * 2.f;
+            })
+    );
+
+    pool.join();
+    BOOST_TEST_CHECK(has_run == false);
+    looper.run();
+    BOOST_TEST_CHECK(has_run == true);
+    BOOST_TEST_CHECK(f.get() == 2.f);
+}